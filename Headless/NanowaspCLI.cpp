@@ -0,0 +1,704 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Runs Microbee configurations with no display, for unattended testing.  The emulation runs
+// as fast as possible up to a time or cycle limit, with keys typed from the command line at
+// given (emulated) times, and the screen is dumped as text or as a PGM image at exit.  The
+// frames can also be recorded as they're generated, as raw pixels and hashes (see
+// FrameRecorder).  Several configurations are run at once on a pool of threads.
+//
+// Alternatively each configuration can be run with every Z80 engine side by side, checking
+// that the machines' states stay the same (for testing the block cache and native code).
+
+
+#include "stdafx.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "Microbee.h"
+#include "MicrobeePool.h"
+#include "VideoSink.h"
+#include "FrameBuffer.h"
+#include "FrameCopy.h"
+#include "FrameRecorder.h"
+#include "InputSource.h"
+#include "Keyboard.h"
+#include "Z80/Z80CPU.h"
+#include "utils/BinaryWriter.h"
+#include "utils/Hash.h"
+
+
+/*! \brief Keeps a copy of the last frame generated, and passes each frame to a FrameRecorder
+ *
+ *  The bitmaps in a VideoFrame are only valid until the emulation carries on, so the frame is
+ *  kept as a FrameCopy to be dumped at exit.
+ */
+class CaptureSink : public VideoSink
+{
+public:
+    CaptureSink() : frames(0), recorder(NULL), mbee(NULL) {}
+
+    //! Records the frames of \p mbee_ with \p recorder_ as they're generated
+    void SetRecorder(FrameRecorder *recorder_, Microbee *mbee_)
+    {
+        recorder = recorder_;
+        mbee = mbee_;
+    }
+
+    virtual void ShowFrame(const VideoFrame &frame_)
+    {
+        if (recorder != NULL)
+            recorder->Record(frame_, mbee->GetTime() / (1000 * Microbee::cTicksPerMicro));
+
+        frames++;
+        if (!frame_.changed && frames > 1)
+            return;  // Same as the copy already held
+
+        last.Assign(frame_);
+    }
+
+    //! Returns true if a frame has been generated
+    bool HaveFrame() const { return frames > 0; }
+
+    //! Writes the character codes as text, one line per character row
+    void WriteText(std::ostream &os) const
+    {
+        const VideoFrame &frame = last.Frame();
+        const word spr = frame.scans_per_row;
+
+        for (word i = 0; i < frame.rows; i++)
+        {
+            std::string line;
+            for (word j = 0; j < frame.cols; j++)
+            {
+                const int cell = i * frame.cols + j;
+                const byte c = frame.codes[cell];
+
+                if (c >= 0x20 && c < 0x7F)
+                    line += char(c);
+                else if (c >= 0x80 && !Blank(frame.glyphs[cell], spr))
+                    line += '?';  // PCG character, which can't be represented
+                else
+                    line += ' ';
+            }
+
+            line.erase(line.find_last_not_of(' ') + 1);
+            os << line << '\n';
+        }
+    }
+
+    //! Writes the pixels as a binary greyscale PGM image, including the cursor
+    void WritePGM(std::ostream &os) const
+    {
+        FrameBuffer fb;
+        fb.Render(last.Frame());
+
+        os << "P5\n" << fb.Width() << ' ' << fb.Height() << "\n255\n";
+        if (fb.Pixels() != NULL)
+            os.write((const char *)fb.Pixels(), (std::streamsize)fb.Width() * fb.Height());
+    }
+
+private:
+    FrameCopy last;  //!< Last frame generated
+    int frames;  //!< Number of frames generated
+    FrameRecorder *recorder;  //!< NULL if frames aren't being recorded
+    Microbee *mbee;  //!< For the time of each frame recorded
+
+    static bool Blank(const byte *bmp, word spr)
+    {
+        for (word k = 0; k < spr; k++)
+            if (bmp[k] != 0)
+                return false;
+        return true;
+    }
+};
+
+
+/*! \brief Types keys from a script
+ *
+ *  Each character is held for cHoldMillis then released for cHoldMillis before the next one,
+ *  timed against the emulation so that the result doesn't depend on the host.
+ */
+class ScriptInput : public InputSource
+{
+public:
+    ScriptInput() : mbee(NULL), end(0) {}
+
+    //! Sets the system whose time the script follows (it can't be passed in before it's constructed)
+    void SetMicrobee(Microbee *mbee_) { mbee = mbee_; }
+
+    /*! \brief Adds \p text to be typed from \p millis (or after the previous text, if that's later)
+     *
+     *  \returns false if \p text contains a character that can't be typed
+     */
+    bool AddText(long long millis, const std::string &text)
+    {
+        const Microbee::time_t hold = cHoldMillis * 1000 * Microbee::cTicksPerMicro;
+        Microbee::time_t t = std::max(millis * 1000 * Microbee::cTicksPerMicro, end);
+
+        for (std::string::size_type i = 0; i < text.length(); i++)
+        {
+            char c = text[i];
+            if (c == '\\' && i + 1 < text.length())
+            {
+                switch (text[++i])
+                {
+                case 'n':  c = '\n'; break;
+                case 'e':  c = 27; break;
+                case 'b':  c = '\b'; break;
+                case 't':  c = '\t'; break;
+                case '\\': c = '\\'; break;
+                default:   return false;
+                }
+            }
+
+            Stroke s;
+            s.down = t;
+            s.up = t + hold;
+            if (!MapChar(c, s.key, s.shift))
+                return false;
+            strokes.push_back(s);
+
+            t += 2 * hold;
+        }
+
+        end = t;
+        return true;
+    }
+
+    virtual bool IsPressed(int key)
+    {
+        if (mbee == NULL || strokes.empty())
+            return false;
+
+        // Find the last stroke which has started
+        const Microbee::time_t now = mbee->GetTime();
+        Stroke probe;
+        probe.down = now;
+        std::vector<Stroke>::const_iterator it = std::upper_bound(strokes.begin(), strokes.end(), probe);
+        if (it == strokes.begin())
+            return false;
+        --it;
+
+        return now < it->up && (key == it->key || (it->shift && key == Keyboard::cKeyShift));
+    }
+
+private:
+    struct Stroke
+    {
+        Microbee::time_t down;  //!< Time the key is pressed
+        Microbee::time_t up;  //!< Time the key is released
+        int key;
+        bool shift;
+
+        bool operator< (const Stroke &s) const { return down < s.down; }
+    };
+
+    Microbee *mbee;
+    std::vector<Stroke> strokes;  //!< In order of time
+    Microbee::time_t end;  //!< Time the last stroke has finished
+
+    static const int cHoldMillis = 40;  //!< Time each key is held down, and then up
+
+    /*! \brief Finds the key (and shift) that types \p c on the Microbee's bit paired keyboard
+     *
+     *  Lower case letters are typed unshifted and upper case letters with shift.
+     */
+    static bool MapChar(char c, int &key, bool &shift)
+    {
+        static const char unshifted[] = "0123456789:;,-./";
+        static const char shifted[] =   " !\"#$%&'()*+<=>?";
+        const char *p;
+
+        shift = false;
+
+        if (c >= 'a' && c <= 'z')
+            key = Keyboard::cKeyA + (c - 'a');
+        else if (c >= 'A' && c <= 'Z')
+        {
+            key = Keyboard::cKeyA + (c - 'A');
+            shift = true;
+        }
+        else if (c == ' ')
+            key = Keyboard::cKeySpace;
+        else if (c != '\0' && (p = strchr(unshifted, c)) != NULL)
+            key = Keyboard::cKey0 + int(p - unshifted);
+        else if (c != '\0' && (p = strchr(shifted, c)) != NULL)
+        {
+            key = Keyboard::cKey0 + int(p - shifted);
+            shift = true;
+        }
+        else
+        {
+            switch (c)
+            {
+            case '@':  key = Keyboard::cKeyAt; break;
+            case '`':  key = Keyboard::cKeyAt; shift = true; break;
+            case '[':  key = Keyboard::cKeyLeftBracket; break;
+            case '{':  key = Keyboard::cKeyLeftBracket; shift = true; break;
+            case '\\': key = Keyboard::cKeyBackslash; break;
+            case '|':  key = Keyboard::cKeyBackslash; shift = true; break;
+            case ']':  key = Keyboard::cKeyRightBracket; break;
+            case '}':  key = Keyboard::cKeyRightBracket; shift = true; break;
+            case '^':  key = Keyboard::cKeyCaret; break;
+            case '~':  key = Keyboard::cKeyCaret; shift = true; break;
+            case '\n': key = Keyboard::cKeyReturn; break;
+            case 27:   key = Keyboard::cKeyEscape; break;
+            case '\b': key = Keyboard::cKeyBackspace; break;
+            case '\t': key = Keyboard::cKeyTab; break;
+            default:   return false;
+            }
+        }
+
+        return true;
+    }
+};
+
+
+static void Usage()
+{
+    std::cerr <<
+        "Usage: nanowasp-cli [options] config.xml...\n"
+        "\n"
+        "  --time MS         Run for MS milliseconds of emulated time (default 10000)\n"
+        "  --cycles N        Run for N Z80 clock cycles instead\n"
+        "  --keys MS:TEXT    Type TEXT from MS milliseconds (may be repeated).  Escapes are\n"
+        "                    \\n (return), \\e (escape), \\b (backspace), \\t (tab) and \\\\\n"
+        "  --dump text|pgm   Dump the screen at exit as text (the default) or a PGM image\n"
+        "  -o FILE           Write the dump to FILE instead of standard output.  With several\n"
+        "                    configurations FILE is a directory, and each dump is named after\n"
+        "                    its configuration\n"
+        "  --frames FILE     Record each frame that differs from the one before as raw pixels\n"
+        "  --bpp 1|8         Bits per pixel for --frames (default 8)\n"
+        "  --hashes FILE     Record a line for each frame that differs from the one before: the\n"
+        "                    frame number, emulated milliseconds, width, height and 64-bit hash\n"
+        "                    of its pixels.  For --frames and --hashes, FILE may be - for\n"
+        "                    standard output (for one of them, and only with -o), and with\n"
+        "                    several configurations is a directory as for -o\n"
+        "  --threads N       Run the configurations on N threads (default one per CPU)\n"
+        "  --compare-engines MS\n"
+        "                    Instead of dumping the screen, run each configuration with each Z80\n"
+        "                    engine (interpreter, blocks and jit) side by side, and compare the\n"
+        "                    state of every device (the CPU's registers and timing, the memory,\n"
+        "                    etc.) every MS milliseconds of emulated time.  Exits with status 1\n"
+        "                    at the first difference\n";
+}
+
+
+//! A configuration being run
+struct Instance
+{
+    std::string config_file;
+    ScriptInput input;
+    CaptureSink video;
+    Microbee *mbee;
+    std::string error;  //!< Why the instance failed, empty if it ran
+
+    std::ofstream frames_file, hashes_file;
+    FrameRecorder *recorder;
+
+    Instance() : mbee(NULL), recorder(NULL) {}
+    ~Instance() { delete mbee; delete recorder; }
+};
+
+
+//! Returns the name of \p config_file without its directory or extension
+static std::string BaseName(const std::string &config_file)
+{
+    std::string name = config_file.substr(config_file.find_last_of("/\\") + 1);
+    return name.substr(0, name.find_last_of('.'));
+}
+
+
+/*! \brief Opens the output for \p inst named \p name, or returns std::cout if \p name is "-"
+ *
+ *  With several configurations, \p name is a directory and the file in it is named after the
+ *  configuration, with \p ext.  Returns NULL, setting the instance's error, if the file can't
+ *  be opened.
+ */
+static std::ostream *OpenOutput(Instance &inst, std::ofstream &file, const std::string &name, bool several, const char *ext)
+{
+    if (name == "-")
+        return &std::cout;
+
+    const std::string path = several ? name + "/" + BaseName(inst.config_file) + ext : name;
+
+    file.open(path.c_str(), std::ios::out | std::ios::binary);
+    if (!file)
+    {
+        inst.error = "can't write " + path;
+        return NULL;
+    }
+
+    return &file;
+}
+
+
+//! Returns the <device> element of the first CPU in the configuration of \p mbee
+static const TiXmlElement *FindZ80(const Microbee &mbee)
+{
+    const TiXmlElement *el = mbee.GetConfig().FirstChildElement("device");
+    for (; el != NULL; el = el->NextSiblingElement("device"))
+        if (std::string(el->Attribute("class")) == "Z80CPU")
+            break;
+    return el;
+}
+
+
+//! Returns the time to run \p mbee until, for --time \p time_limit or --cycles \p cycle_limit
+static Microbee::time_t Limit(Microbee &mbee, long long time_limit, long long cycle_limit)
+{
+    if (cycle_limit == 0)
+        return time_limit * 1000 * Microbee::cTicksPerMicro;
+
+    // Limit by the clock of the first CPU in the configuration
+    return cycle_limit * mbee.GetDevice<Z80CPU>(FindZ80(mbee)->Attribute("id"))->GetTicksPerCycle();
+}
+
+
+//! The engines compared by --compare-engines, the first being the reference
+static const char *const cEngines[] = { "interpreter", "blocks", "jit" };
+static const int cNumEngines = sizeof(cEngines) / sizeof(cEngines[0]);
+
+
+/*! \brief Hashes the state of each device of \p mbee, and of its schedule
+ *
+ *  \p names receives the id of each device (in the order of the configuration) followed by
+ *  "schedule", and \p digests the hash of each one's saved state.
+ */
+static void DigestState(Microbee &mbee, std::vector<std::string> &names, std::vector<unsigned long long> &digests)
+{
+    names.clear();
+    digests.clear();
+
+    const TiXmlElement *el = mbee.GetConfig().FirstChildElement("device");
+    for (; ; el = el->NextSiblingElement("device"))
+    {
+        std::ostringstream stream(std::ostringstream::out | std::ostringstream::binary);
+        BinaryWriter writer(stream);
+
+        if (el != NULL)
+        {
+            names.push_back(el->Attribute("id"));
+            mbee.GetDevice<Device>(names.back())->SaveState(writer);
+        }
+        else
+        {
+            names.push_back("schedule");
+            mbee.SaveSchedule(writer);
+        }
+
+        Hash64 hash;
+        hash.Add(stream.str());
+        digests.push_back(hash.Value());
+
+        if (el == NULL)
+            break;
+    }
+}
+
+
+/*! \brief Runs \p config_file with each of cEngines side by side until \p limit, for --compare-engines
+ *
+ *  The machines are stopped every \p interval ticks, and the states of their devices compared
+ *  with the first's.  Returns false, having written the first difference (or the error) to
+ *  standard error, if they differ or can't be run.
+ */
+static bool CompareEngines(const std::string &config_file, const ScriptInput &input, long long interval_ms,
+                           long long time_limit, long long cycle_limit)
+{
+    std::vector<Instance*> runs;
+    std::string error;
+    bool same = true;
+
+    try
+    {
+        for (int e = 0; e < cNumEngines; e++)
+        {
+            runs.push_back(new Instance);
+            Instance &run = *runs.back();
+
+            run.config_file = config_file;
+            run.input = input;
+            run.mbee = new Microbee(run.video, run.input, config_file.c_str());
+            run.input.SetMicrobee(run.mbee);
+
+            // Every CPU runs with the engine
+            const TiXmlElement *el = run.mbee->GetConfig().FirstChildElement("device");
+            for (; el != NULL; el = el->NextSiblingElement("device"))
+                if (std::string(el->Attribute("class")) == "Z80CPU")
+                    run.mbee->GetDevice<Z80CPU>(el->Attribute("id"))->SetEngine(cEngines[e]);
+        }
+
+        const Microbee::time_t limit = Limit(*runs[0]->mbee, time_limit, cycle_limit);
+        const Microbee::time_t interval = interval_ms * 1000 * Microbee::cTicksPerMicro;
+        std::vector<std::string> names, ref_names;
+        std::vector<unsigned long long> digests, ref_digests;
+        int compared = 0;
+
+        for (Microbee::time_t until = std::min(interval, limit); same; until = std::min(until + interval, limit))
+        {
+            for (int e = 0; e < cNumEngines; e++)
+            {
+                Microbee &mbee = *runs[e]->mbee;
+                while (mbee.GetTime() < until)
+                    mbee.RunSlice();
+
+                if (e == 0)
+                {
+                    DigestState(mbee, ref_names, ref_digests);
+                    continue;
+                }
+
+                DigestState(mbee, names, digests);
+                if (digests == ref_digests)
+                    continue;
+
+                std::cerr << "nanowasp-cli: " << config_file << ": " << cEngines[e] << " differs from " << cEngines[0]
+                          << " at " << mbee.GetTime() / (1000 * Microbee::cTicksPerMicro) << " ms in:";
+                for (size_t i = 0; i < names.size(); i++)
+                    if (digests[i] != ref_digests[i])
+                        std::cerr << ' ' << names[i];
+                std::cerr << '\n';
+                same = false;
+            }
+
+            compared++;
+            if (until == limit)
+                break;
+        }
+
+        if (same)
+            std::cout << config_file << ": the engines match at all " << compared << " points\n";
+    }
+    catch (ConfigError &e)
+    {
+        error = std::string("configuration error: ") + e.what();
+    }
+    catch (std::exception &e)
+    {
+        error = e.what();
+    }
+
+    for (std::vector<Instance*>::iterator it = runs.begin(); it != runs.end(); it++)
+        delete *it;
+
+    if (!error.empty())
+    {
+        std::cerr << "nanowasp-cli: " << config_file << ": " << error << '\n';
+        return false;
+    }
+
+    return same;
+}
+
+
+int main(int argc, char *argv[])
+{
+    std::vector<Instance*> instances;
+    const char *out_file = NULL;
+    const char *frames_name = NULL;
+    const char *hashes_name = NULL;
+    int bpp = 8;
+    std::string dump = "text";
+    long long time_limit = 10000;
+    long long cycle_limit = 0;
+    unsigned int threads = 0;
+    long long compare_interval = 0;
+    ScriptInput input;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg(argv[i]);
+        const bool has_value = i + 1 < argc;
+
+        if (arg == "--time" && has_value)
+            time_limit = atoll(argv[++i]);
+        else if (arg == "--cycles" && has_value)
+            cycle_limit = atoll(argv[++i]);
+        else if (arg == "--keys" && has_value)
+        {
+            const std::string keys(argv[++i]);
+            const std::string::size_type colon = keys.find(':');
+            if (colon == std::string::npos || !input.AddText(atoll(keys.c_str()), keys.substr(colon + 1)))
+            {
+                std::cerr << "nanowasp-cli: can't type \"" << keys << "\"\n";
+                return 2;
+            }
+        }
+        else if (arg == "--dump" && has_value)
+            dump = argv[++i];
+        else if (arg == "-o" && has_value)
+            out_file = argv[++i];
+        else if (arg == "--frames" && has_value)
+            frames_name = argv[++i];
+        else if (arg == "--bpp" && has_value)
+            bpp = atoi(argv[++i]);
+        else if (arg == "--hashes" && has_value)
+            hashes_name = argv[++i];
+        else if (arg == "--threads" && has_value)
+            threads = atoi(argv[++i]);
+        else if (arg == "--compare-engines" && has_value)
+        {
+            compare_interval = atoll(argv[++i]);
+            if (compare_interval <= 0)
+            {
+                Usage();
+                return 2;
+            }
+        }
+        else if (arg[0] != '-')
+        {
+            instances.push_back(new Instance);
+            instances.back()->config_file = argv[i];
+        }
+        else
+        {
+            Usage();
+            return 2;
+        }
+    }
+
+    const bool several = instances.size() > 1;
+
+    // At most one of the dump, --frames and --hashes can go to standard output
+    const bool frames_stdout = frames_name != NULL && std::string(frames_name) == "-";
+    const bool hashes_stdout = hashes_name != NULL && std::string(hashes_name) == "-";
+    if (instances.empty() || (dump != "text" && dump != "pgm") || time_limit <= 0 || cycle_limit < 0 ||
+        (several && dump == "pgm" && out_file == NULL) || (bpp != 1 && bpp != 8) ||
+        (several && (frames_stdout || hashes_stdout)) ||
+        ((frames_stdout || hashes_stdout) && out_file == NULL) || (frames_stdout && hashes_stdout) ||
+        (compare_interval > 0 && (frames_name != NULL || hashes_name != NULL)))
+    {
+        Usage();
+        return 2;
+    }
+
+    if (compare_interval > 0)
+    {
+        int result = 0;
+        for (std::vector<Instance*>::iterator it = instances.begin(); it != instances.end(); it++)
+        {
+            if (!CompareEngines((*it)->config_file, input, compare_interval, time_limit, cycle_limit))
+                result = 1;
+            delete *it;
+        }
+
+        return result;
+    }
+
+
+    MicrobeePool pool(threads);
+
+    for (std::vector<Instance*>::iterator it = instances.begin(); it != instances.end(); it++)
+    {
+        Instance &inst = **it;
+        inst.input = input;
+
+        std::ostream *frames = NULL, *hashes = NULL;
+        if (frames_name != NULL && (frames = OpenOutput(inst, inst.frames_file, frames_name, several, ".raw")) == NULL)
+            continue;
+        if (hashes_name != NULL && (hashes = OpenOutput(inst, inst.hashes_file, hashes_name, several, ".hashes")) == NULL)
+            continue;
+
+        try
+        {
+            inst.mbee = new Microbee(inst.video, inst.input, inst.config_file.c_str());
+            inst.input.SetMicrobee(inst.mbee);
+
+            if (frames != NULL || hashes != NULL)
+            {
+                inst.recorder = new FrameRecorder(frames, bpp, hashes);
+                inst.video.SetRecorder(inst.recorder, inst.mbee);
+            }
+
+            pool.Add(*inst.mbee, Limit(*inst.mbee, time_limit, cycle_limit));
+        }
+        catch (ConfigError &e)
+        {
+            inst.error = std::string("configuration error: ") + e.what();
+        }
+        catch (std::exception &e)
+        {
+            inst.error = e.what();
+        }
+    }
+
+    pool.Run();
+
+
+    int result = 0;
+
+    for (std::vector<Instance*>::iterator it = instances.begin(); it != instances.end(); it++)
+    {
+        Instance &inst = **it;
+
+        if (inst.error.empty() && inst.mbee != NULL && pool.GetError(*inst.mbee) != NULL)
+            inst.error = pool.GetError(*inst.mbee);
+        if (inst.error.empty() && !inst.video.HaveFrame())
+            inst.error = "no frames were generated";
+
+        if (!inst.error.empty())
+        {
+            std::cerr << "nanowasp-cli: " << inst.config_file << ": " << inst.error << '\n';
+            result = 1;
+            continue;
+        }
+
+        std::ofstream file;
+        if (out_file != NULL)
+        {
+            std::string name = out_file;
+            if (several)
+                name += "/" + BaseName(inst.config_file) + (dump == "pgm" ? ".pgm" : ".txt");
+
+            file.open(name.c_str(), std::ios::out | std::ios::binary);
+            if (!file)
+            {
+                std::cerr << "nanowasp-cli: can't write " << name << '\n';
+                result = 1;
+                continue;
+            }
+        }
+        else if (several)
+            std::cout << "==> " << inst.config_file << " <==\n";
+
+        std::ostream &os = out_file != NULL ? file : std::cout;
+
+        if (dump == "pgm")
+            inst.video.WritePGM(os);
+        else
+            inst.video.WriteText(os);
+
+        if (!os)
+            result = 1;
+    }
+
+    for (std::vector<Instance*>::iterator it = instances.begin(); it != instances.end(); it++)
+        delete *it;
+
+    return result;
+}
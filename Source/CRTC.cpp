@@ -21,16 +21,11 @@
 #include "stdafx.h"
 #include "CRTC.h"
 
-#ifdef __WXOSX__
-#include <OpenGL/glu.h>
-#else
-#include <GL/glu.h>
-#endif
-
-#include "Terminal.h"
 #include "CRTCMemory.h"
 #include "Keyboard.h"
 
+#include <algorithm>
+
 
 /*! \p config_ must contain a <connect> to the associated CRTCMemory and Keyboard devices. */
 CRTC::CRTC(Microbee &mbee_, const TiXmlElement &config_) :
@@ -40,15 +35,15 @@ CRTC::CRTC(Microbee &mbee_, const TiXmlElement &config_) :
     config(&xml_config),
     crtc_mem(NULL),
     keyb(NULL),
-    scr(mbee.GetTerminal()),
-    gl_ctx(NULL)
+    video(mbee.GetVideoSink()),
+    frame_disp_start(0),
+    redraw(true)
 {
-}
-
-
-CRTC::~CRTC()
-{
-    delete gl_ctx;
+    frame.cols = frame.rows = frame.scans_per_row = 0;
+    frame.cursor = -1;
+    frame.cursor_start = frame.cursor_end = 0;
+    frame.changed = false;
+    frame.glyph_changed.resize(CRTCMemory::cGlyphCount);
 }
 
 
@@ -91,7 +86,9 @@ void CRTC::Reset()
     cursor_on = false;
     blink_rate = 0;
     last_frame_time = emu_time = 0;
-    frame_time = 1;
+    frame_time = cDefaultFrameTime;
+    vblank_time = 0;
+    redraw = true;
 }
 
 
@@ -218,7 +215,7 @@ byte CRTC::PortRead(word addr)
         if (lpen_valid)  // keyb->CheckAll() might set lpen_valid
             status |= cStatus_LPen;
 
-        if (mbee.GetTime() % frame_time < vblank_time)  // This is not quite correct, but probably good enough (GetTime() is absolute, frame_time may change, vblanking occurs at end of frame)
+        if (FramePhase(mbee.GetTime()) < vblank_time)  // This is not quite correct, but probably good enough (frame_time may change, vblanking occurs at end of frame)
             status |= cStatus_VBlank;
 
         return status;
@@ -258,14 +255,39 @@ byte CRTC::PortRead(word addr)
 }
 
 
-Microbee::time_t CRTC::Execute(Microbee::time_t time, Microbee::time_t micros)
+/*! The status port changes at each edge of the vertical blanking period.  The light pen bit
+ *  also changes if a key is pressed, but that can wait for the next time the CPU stops.
+ */
+Microbee::time_t CRTC::PortStableUntil(word addr)
+{
+    switch (addr % cNumPorts)
+    {
+    case cStatus:
+    {
+        const Microbee::time_t now = mbee.GetTime();
+        const Microbee::time_t phase = FramePhase(now);
+        return phase < vblank_time ? now - phase + vblank_time : now - phase + frame_time;
+    }
+
+    case cData:
+        if (reg == cReg_LPenH || reg == cReg_LPenL)
+            return 0;  // Reading clears the light pen
+        return cStable;
+
+    default:
+        return cStable;
+    }
+}
+
+
+Microbee::time_t CRTC::Execute(Microbee::time_t time, Microbee::time_t ticks)
 {
-    emu_time = time + micros;  // Time to update to
+    emu_time = time + ticks;  // Time to update to
     Microbee::time_t delta = emu_time - last_frame_time;
 
     if (delta >= frame_time)
     {
-        Render(); // micros may be a long time, but no point rendering more than one frame
+        Render(); // ticks may be a long time, but no point rendering more than one frame
 
         frame_counter += delta / frame_time;
         last_frame_time = emu_time - delta % frame_time;  // The emulated time the frame really finished
@@ -283,55 +305,106 @@ Microbee::time_t CRTC::Execute(Microbee::time_t time, Microbee::time_t micros)
 }
 
 
+/*! The CRTC is run at the end of each frame, so \p t is normally within a frame of
+ *  last_frame_time and this is just a subtraction.
+ */
+Microbee::time_t CRTC::FramePhase(Microbee::time_t t) const
+{
+    Microbee::time_t phase = t - last_frame_time;
+
+    if (phase < 0 || phase >= frame_time)
+        phase = (phase % frame_time + frame_time) % frame_time;  // The frame length has changed since
+
+    return phase;
+}
+
+
+/*! A cell is dirty if its character or that character's bitmap has changed, or the cursor has
+    moved onto or off it.  When the layout changes every cell is dirty.  If nothing has changed
+    the frame isn't described again, the last description is sent with changed cleared.
+ */
 void CRTC::Render()
 {
-    if (gl_ctx == NULL)
+    const unsigned int cells = (unsigned int)hdisp * vdisp;
+
+    int cursor = -1;
+    const unsigned int cursor_ofs = (cur_pos + cMAddrSize - disp_start) % cMAddrSize;
+    if (cursor_on && cursor_ofs < cells)
+        cursor = cursor_ofs;
+
+    const bool layout_changed = redraw || frame.cols != hdisp || frame.rows != vdisp ||
+                                frame.scans_per_row != scans_per_row || frame_disp_start != disp_start;
+    const bool cursor_changed = cursor != frame.cursor ||
+                                (cursor >= 0 && (cur_start != frame.cursor_start || cur_end != frame.cursor_end));
+
+    if (frame.changed)
     {
-        gl_ctx = new wxGLContext(&scr);  // Here because it's guaranteed to be in the context of this thread
-        gl_ctx->SetCurrent(scr);
-        glMatrixMode(GL_PROJECTION);
-        glLoadIdentity();
-        gluOrtho2D(-0.5, Terminal::width - 0.5, Terminal::height - 0.5, -0.5);
-        glMatrixMode(GL_MODELVIEW);
-        glViewport(0, 0, Terminal::width, Terminal::height);
-        glColor3d(0.0, 1.0, 0.0);
-        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        std::fill(frame.dirty.begin(), frame.dirty.end(), 0);
+        std::fill(frame.glyph_changed.begin(), frame.glyph_changed.end(), 0);
     }
 
-    glClear(GL_COLOR_BUFFER_BIT);
+    if (!layout_changed && !cursor_changed && !crtc_mem->HaveChanges())
+    {
+        frame.changed = false;
+        video.ShowFrame(frame);
+        return;
+    }
 
-    word maddr = disp_start;
+    const int old_cursor = frame.cursor;
 
-    for (word i = 0; i < vdisp; i++)
-    {
-        glRasterPos2i(0, (i+1) * scans_per_row - 1);
-        for (word j = 0; j < hdisp; j++)
-        {
-            const unsigned char *bmp = crtc_mem->GetCharBitmap(maddr, scans_per_row);
+    frame.cols = hdisp;
+    frame.rows = vdisp;
+    frame.scans_per_row = scans_per_row;
+    frame.codes.resize(cells);
+    frame.glyphs.resize(cells);
+    frame.glyph_ids.resize(cells);
+    frame.dirty.resize(cells);
+    frame.cursor = cursor;
+    frame.cursor_start = cur_start;
+    frame.cursor_end = cur_end;
+    frame.changed = false;
 
-            if (cursor_on && maddr == cur_pos)
-            {
-                unsigned char cursor_bmp[CRTCMemory::cBitmapSize];
+    word maddr = disp_start;
 
-                for (word k = 0; k < scans_per_row; k++)
-                {
-                    if ((scans_per_row - k - 1) >= cur_start && (scans_per_row - k - 1) <= cur_end)
-                        cursor_bmp[k] = bmp[k] ^ 0xFF;
-                    else
-                        cursor_bmp[k] = bmp[k];
-                }
+    for (unsigned int i = 0; i < cells; i++)
+    {
+        const byte code = crtc_mem->GetCharCode(maddr);
 
-                bmp = cursor_bmp;
-            }
+        if (layout_changed || crtc_mem->CharCodeChanged(maddr) || crtc_mem->BitmapChanged(code))
+        {
+            frame.codes[i] = code;
+            frame.glyphs[i] = crtc_mem->GetCharBitmap(maddr, scans_per_row);
+            frame.glyph_ids[i] = crtc_mem->GetGlyphIndex(maddr);
+            frame.dirty[i] = 1;
+            frame.changed = true;
+        }
 
-            glBitmap(cCharWidth, scans_per_row, 0.0, 0.0, cCharWidth, 0.0, bmp);
+        maddr = (maddr + 1) % cMAddrSize;
+    }
 
-            maddr = (maddr + 1) % cMAddrSize;
+    for (word i = CRTCMemory::cFirstPCGGlyph; i < CRTCMemory::cGlyphCount; i++)
+    {
+        if (crtc_mem->BitmapChanged(0x80 | (i - CRTCMemory::cFirstPCGGlyph)))
+        {
+            frame.glyph_changed[i] = 1;
+            frame.changed = true;
         }
     }
 
-    glFlush();
-    scr.SwapBuffers();
+    if (cursor_changed)
+    {
+        if (old_cursor >= 0 && (unsigned int)old_cursor < cells)
+            frame.dirty[old_cursor] = 1;
+        if (cursor >= 0)
+            frame.dirty[cursor] = 1;
+        frame.changed = true;
+    }
+
+    frame_disp_start = disp_start;
+    redraw = false;
+    crtc_mem->ClearChanges();
+
+    video.ShowFrame(frame);
 }
 
 
@@ -347,11 +420,11 @@ void CRTC::TriggerLPen(word maddr)
 
 void CRTC::CalcVBlank()
 {
-    frame_time = (Microbee::time_t)htot * ((Microbee::time_t)vtot * scans_per_row + vtot_adj) * 1000000 / cCharClock;
-    vblank_time = (Microbee::time_t)htot * (((Microbee::time_t)vtot - vdisp) * scans_per_row + vtot_adj) * 1000000 / cCharClock;
+    frame_time = (Microbee::time_t)htot * ((Microbee::time_t)vtot * scans_per_row + vtot_adj) * cTicksPerChar;
+    vblank_time = (Microbee::time_t)htot * (((Microbee::time_t)vtot - vdisp) * scans_per_row + vtot_adj) * cTicksPerChar;
 
     if (frame_time == 0)
-        frame_time = 1;  // Ensure we don't divide by zero later
+        frame_time = cDefaultFrameTime;  // Not programmed yet, and the CRTC is run once a frame
 }
 
 void CRTC::SaveState(BinaryWriter& writer)
@@ -378,6 +451,11 @@ void CRTC::SaveState(BinaryWriter& writer)
     
     writer.WriteWord(this->lpen);
     writer.WriteBool(this->lpen_valid);
+
+    // Timing, absent from older saves
+    writer.WriteDWord(this->frame_counter);
+    writer.WriteQWord(this->emu_time);
+    writer.WriteQWord(this->last_frame_time);
 }
 
 void CRTC::RestoreState(BinaryReader& reader)
@@ -404,7 +482,15 @@ void CRTC::RestoreState(BinaryReader& reader)
     
     this->lpen = reader.ReadWord();
     this->lpen_valid = reader.ReadBool();
+
+    if (!reader.AtEnd())
+    {
+        this->frame_counter = reader.ReadDWord();
+        this->emu_time = reader.ReadQWord();
+        this->last_frame_time = reader.ReadQWord();
+    }
     
     this->CalcVBlank();
+    this->redraw = true;
 }
 
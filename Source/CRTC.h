@@ -21,11 +21,10 @@
 #define CRTC_H
 
 #include "PortDevice.h"
-#include <wx/glcanvas.h>
+#include "VideoSink.h"
 #include "Microbee.h"
 
 class Microbee;
-class Terminal;
 class CRTCMemory;
 class Keyboard;
 
@@ -34,7 +33,8 @@ class Keyboard;
  *
  *  The focus of the CRTC emulation is on the CPU-visible interface, and not
  *  the output signals used to drive the actual CRT.  The output signals
- *  that would have been generated are instead rendered directly to the screen.
+ *  that would have been generated are instead described by a VideoFrame at the
+ *  end of each frame, which is passed to the Microbee's VideoSink.
  *
  *  \todo V-blanking status
  */
@@ -43,7 +43,6 @@ class CRTC : public PortDevice
 public:
     //! Construct based on XML \p config_ (primarily used by DeviceFactory)
     CRTC(Microbee &mbee_, const TiXmlElement &config_);
-    ~CRTC();
 
     virtual void LateInit();
     
@@ -54,9 +53,10 @@ public:
 
     virtual void PortWrite(word addr, byte val);
     virtual byte PortRead(word addr);
+    virtual Microbee::time_t PortStableUntil(word addr);
 
 
-    virtual Microbee::time_t Execute(Microbee::time_t time, Microbee::time_t micros);
+    virtual Microbee::time_t Execute(Microbee::time_t time, Microbee::time_t ticks);
     virtual bool Executable() { return true; }
 
     Microbee::time_t GetTime() { return emu_time; };  // CRTC doesn't provide fine-grained time emulation to other devices
@@ -74,8 +74,10 @@ private:
     TiXmlHandle config;  //!< Handle to xml_config
     CRTCMemory *crtc_mem;  //!< Connection to the CRTCMemory device, used for character data
     Keyboard *keyb;  //!< Connection to the Keyboard device, to pass through requests from the CPU
-    Terminal &scr;  //!< Terminal frame to render the display signal to
-    wxGLContext *gl_ctx;  //!< OpenGL rendering context
+    VideoSink &video;  //!< Where frames are sent
+    VideoFrame frame;  //!< Description of the last frame (kept to reuse its storage, and to compare the next one with)
+    word frame_disp_start;  //!< Display Start of the last frame
+    bool redraw;  //!< True if the next frame must be drawn in full (e.g. after a reset)
 
     unsigned int frame_counter;  //!< Used for cursor blinking, number of frames since last cursor blink
     Microbee::time_t emu_time;  //!< Current emulated time (generally valid only for Execute() and GetTime())
@@ -94,8 +96,8 @@ private:
     word vdisp;          //!< Vertical Displayed
     word scans_per_row;  //!< Scan lines per character row
 
-    Microbee::time_t frame_time;   //!< Time each frame lasts for (microseconds)
-    Microbee::time_t vblank_time;  //!< Time vblank is active for (microseconds)
+    Microbee::time_t frame_time;   //!< Time each frame lasts for (ticks)
+    Microbee::time_t vblank_time;  //!< Time vblank is active for (ticks)
 
     word cur_start;  //!< Cursor Start
     word cur_end;    //!< Cursor End
@@ -152,7 +154,6 @@ private:
 
 
     // Other
-    static const int cCharWidth = 8;
     static const int cBlinkOfs = 5;
     static const int cMAddrSize = 16384;
     enum 
@@ -163,12 +164,21 @@ private:
         cBlink32
     };
     static const unsigned long cCharClock = 1687500;  //!< Character clock frequency (Hz)
+    static const Microbee::time_t cTicksPerChar = Microbee::cTicksPerSecond / cCharClock;  //!< Length of a character clock cycle
+    static const Microbee::time_t cDefaultFrameTime = Microbee::cTicksPerSecond / 50;  //!< frame_time until the registers give one (a PAL frame)
+
+
+    //! Returns the time \p t relative to the start of the frame it falls in
+    Microbee::time_t FramePhase(Microbee::time_t t) const;
 
 
     //! Calculates helper variables for emulating the vertical blanking status
     void CalcVBlank();
 
-    //! Renders the screen according to the current state
+    /*! \brief Describes the screen according to the current state, and sends it to the VideoSink
+     *
+     *  Marks the cells that differ from the last frame, see VideoFrame.
+     */
     void Render();
 
     // Private copy constuctor and assigment operator to prevent copies
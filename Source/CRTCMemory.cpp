@@ -26,6 +26,8 @@
 #include "RAM.h"
 #include "ROM.h"
 
+#include <algorithm>
+
 
 /*! Initialises video RAM, PCG RAM.  Loads character ROM data and arranges it
     in memory suitable for OpenGL. \p config_ must contain a <connect> to the associated 
@@ -40,8 +42,12 @@ CRTCMemory::CRTCMemory(Microbee &mbee_, const TiXmlElement &config_) :
     crt_c(NULL),
     video_ram(cVideoRAMSize),
     pcg_ram(cPCGRAMSize),
-    char_rom(mbee_, cCharROMSize)
+    char_rom(mbee_, cCharROMSize),
+    video_changed(cVideoRAMSize),
+    pcg_changed(cPCGRAMSize / cBitmapSize)
 {
+    SetAllChanged();
+
     // Load the char ROM data
     const char *file;
     if ((file = config_.Attribute("charrom")) == NULL)
@@ -49,21 +55,19 @@ CRTCMemory::CRTCMemory(Microbee &mbee_, const TiXmlElement &config_) :
 
     try
     {
-        char_rom.LoadROM(file);
+        char_rom.LoadROM(file, &CRTCMemory::ReorderBitmaps);
     }
     catch (FileNotFound &)
     {
         throw ConfigError(&config_, std::string("Unable to open Character ROM file \"") + file + "\"");
     }
-
-    CRTCMemory::ReorderBitmaps(char_rom.memory);
 }
 
 /*! Reorder character bitmaps so they represent OpenGL bitmaps
  */
-void CRTCMemory::ReorderBitmaps(std::vector<byte>& memory)
+void CRTCMemory::ReorderBitmaps(byte *memory, unsigned int size)
 {
-    for (int i = 0; i < memory.size() / cBitmapSize; ++i)
+    for (unsigned int i = 0; i < size / cBitmapSize; ++i)
     {
         for (int j = 0; j < cBitmapSize / 2; ++j)
         {
@@ -101,15 +105,47 @@ void CRTCMemory::LateInit()
 
 /*! Writes a byte into graphics memory.  Bytes written to the PCG RAM are
     reordered so that OpenGL can use the bitmaps directly.  The character
-    ROM cannot be written to. */
+    ROM cannot be written to.  Writes that change what is displayed are noted
+    (see HaveChanges()). */
 void CRTCMemory::Write(word addr, byte val)
 {
     if (addr >= cVideoRAMSize)
-        pcg_ram.Write(XlatAddress(addr % cPCGRAMSize), val);
+    {
+        const word xlat = XlatAddress(addr % cPCGRAMSize);
+        if (pcg_ram.Read(xlat) != val)
+        {
+            pcg_ram.Write(xlat, val);
+            pcg_changed[(addr % cPCGRAMSize) / cBitmapSize] = 1;
+            changed = true;
+        }
+    }
     else if (latch_rom->GetLatch())
         ;  // no-op, writing to char rom
-    else
+    else if (video_ram.Read(addr % cVideoRAMSize) != val)
+    {
         video_ram.Write(addr % cVideoRAMSize, val);
+        video_changed[addr % cVideoRAMSize] = 1;
+        changed = true;
+    }
+}
+
+
+void CRTCMemory::ClearChanges()
+{
+    if (!changed)
+        return;
+
+    std::fill(video_changed.begin(), video_changed.end(), 0);
+    std::fill(pcg_changed.begin(), pcg_changed.end(), 0);
+    changed = false;
+}
+
+
+void CRTCMemory::SetAllChanged()
+{
+    std::fill(video_changed.begin(), video_changed.end(), 1);
+    std::fill(pcg_changed.begin(), pcg_changed.end(), 1);
+    changed = true;
 }
 
 
@@ -149,19 +185,32 @@ const unsigned char *CRTCMemory::GetCharBitmap(word addr, word scans_per_row)
                                 ((getBits(b, cIndexOfs, cIndexSize) + 1) * cBitmapSize - scans_per_row)];
 }
 
+word CRTCMemory::GetGlyphIndex(word addr)
+{
+    byte b = video_ram.Read(addr % cVideoRAMSize);
+
+    if (getBit(b, cBitPCG))
+        return cFirstPCGGlyph + getBits(b, cIndexOfs, cIndexSize);
+    else
+        return getBit(addr, cBitMA13) * cVideoRAMSize / cBitmapSize + getBits(b, cIndexOfs, cIndexSize);
+}
+
 void CRTCMemory::SaveState(BinaryWriter& writer)
 {
     this->video_ram.SaveState(writer);
     
-    CRTCMemory::ReorderBitmaps(this->pcg_ram.memory);  // Make sure the PCG RAM is saved in the read order, not the munged order.
+    CRTCMemory::ReorderBitmaps(this->pcg_ram.memory, cPCGRAMSize);  // Make sure the PCG RAM is saved in the read order, not the munged order.
     this->pcg_ram.SaveState(writer);
-    CRTCMemory::ReorderBitmaps(this->pcg_ram.memory);
+    CRTCMemory::ReorderBitmaps(this->pcg_ram.memory, cPCGRAMSize);
 }
 
 void CRTCMemory::RestoreState(BinaryReader& reader)
 {
     this->video_ram.RestoreState(reader);
     this->pcg_ram.RestoreState(reader);
+    CRTCMemory::ReorderBitmaps(this->pcg_ram.memory, cPCGRAMSize);  // Saved in read order, back to the munged order
+
+    SetAllChanged();
 }
 
 word CRTCMemory::XlatAddress(word addr)
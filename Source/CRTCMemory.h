@@ -73,10 +73,31 @@ public:
     //! Returns a pointer to the character bitmap referenced by the <em>video RAM</em> byte at \p addr
     const unsigned char *GetCharBitmap(word addr, word scans_per_row);
 
+    //! Returns the <em>video RAM</em> byte at \p addr
+    byte GetCharCode(word addr) { return video_ram.Read(addr % cVideoRAMSize); }
+
+    /*! \brief Returns the index of the character bitmap referenced by the <em>video RAM</em> byte at \p addr
+     *
+     *  The char ROM bitmaps come first, low bank then high bank, followed by the PCG RAM bitmaps.
+     */
+    word GetGlyphIndex(word addr);
+
+    //! Returns true if the video RAM or PCG RAM has changed since ClearChanges()
+    bool HaveChanges() const { return changed; }
+    //! Returns true if the <em>video RAM</em> byte at \p addr has changed since ClearChanges()
+    bool CharCodeChanged(word addr) const { return video_changed[addr % cVideoRAMSize] != 0; }
+    //! Returns true if the bitmap of character \p code has changed since ClearChanges() (only PCG characters can)
+    bool BitmapChanged(byte code) const { return getBit(code, cBitPCG) && pcg_changed[getBits(code, cIndexOfs, cIndexSize)] != 0; }
+    //! Forgets the changes so far, called once they've been displayed
+    void ClearChanges();
+
     virtual void SaveState(BinaryWriter&);
     virtual void RestoreState(BinaryReader&);
 
     static const word cBitmapSize = 16;  //!< Character bitmap length in bytes
+    static const word cVideoRAMSize = 2048;  //!< Video RAM length in bytes (one per character)
+    static const word cFirstPCGGlyph = 256;  //!< Index of the first PCG RAM bitmap, after the char ROM bitmaps (see GetGlyphIndex())
+    static const word cGlyphCount = cFirstPCGGlyph + 128;  //!< Number of character bitmap indexes
 
 
 private:
@@ -90,13 +111,19 @@ private:
     RAM pcg_ram;   //!< The PCG RAM
     ROM char_rom;  //!< The character ROM
 
+    bool changed;  //!< True if anything in video_changed or pcg_changed is set
+    std::vector<byte> video_changed;  //!< Non-zero for each byte of the video RAM written with a new value
+    std::vector<byte> pcg_changed;  //!< Non-zero for each PCG character written with a new bitmap
+
+    //! Marks everything as changed, e.g. after the memory has been restored
+    void SetAllChanged();
+
     //! Converts addresses so that bitmap data is stored appropriate for OpenGL
     static word XlatAddress(word addr);
 
-    static void ReorderBitmaps(std::vector<byte>& memory);
+    static void ReorderBitmaps(byte *memory, unsigned int size);
     
     static const word cGraphicsMemSize = 4096;
-    static const word cVideoRAMSize = 2048;
     static const word cPCGRAMSize = 2048;
     static const word cCharROMSize = 4096;
     static const word cBitMA13 = 13;
@@ -67,21 +67,24 @@ public:
     virtual void Reset() {}
 
 
-    /*! \brief Runs the device for the given number of microseconds, starting at the specified emulated time
+    /*! \brief Runs the device for the given number of ticks, starting at the specified emulated time
      *
-     *  \returns The maximum number of simulated microseconds that may elapse before the device should be executed
-     *           again.  The device is guaranteed to be executed again within this period.  If the device returns
-     *           0 then it won't be considered when determining the length of the next run cycle.  If all devices
-     *           return 0 then the next run cycle will be of default length.
+     *  \returns The number of simulated ticks that may elapse before the device should be executed
+     *           again.  The device will be executed again once this period has elapsed (and not before), with
+     *           the other devices run up to that time first.  If the device returns 0 then it is executed in
+     *           every run cycle, whatever their length, and won't be considered when determining the length
+     *           of the next run cycle.  If all devices return 0 then the next run cycle will be of default
+     *           length.
      *
-     *  This function will be called regularly by the main loop of the emulator for
-     *  each Device that is on its run list.  \p micros indicates how many simulated microseconds the
-     *  device should execute for.  If the device does not need to be called regularly then it
-     *  doesn't need to reimplement this function (and should not be placed on the run list).
+     *  This function will be called by the main loop of the emulator for each Device that is on
+     *  its run list.  \p ticks indicates how many simulated ticks the device should execute
+     *  for, which covers all of the time since the device was last executed.  If the device does not
+     *  need to be called regularly then it doesn't need to reimplement this function (and should not
+     *  be placed on the run list).
      *
      *  \sa Executable()
      */
-    virtual Microbee::time_t Execute(Microbee::time_t time, Microbee::time_t micros) { UNREFERENCED_PARAMETER(time); UNREFERENCED_PARAMETER(micros); return 0; }
+    virtual Microbee::time_t Execute(Microbee::time_t time, Microbee::time_t ticks) { UNREFERENCED_PARAMETER(time); UNREFERENCED_PARAMETER(ticks); return 0; }
 
 
     /*! \brief Returns true if the device needs to be on the run list
@@ -92,7 +95,7 @@ public:
     virtual bool Executable() { return false; }
 
 
-    /*! \brief Returns the emulated time in microseconds that the Device has run been Execute()d to
+    /*! \brief Returns the emulated time in ticks that the Device has run been Execute()d to
      *
      *  If this function is called while the Device is currently Execute()ing, it must also include any
      *  time that has been emulated so far in the current call.  Devices which haven't reimplemented
@@ -20,6 +20,8 @@
 
 #include "stdafx.h"
 #include "Disk.h"
+#include "utils/BinaryWriter.h"
+#include "utils/BinaryReader.h"
 
 #include <algorithm>
 #include <iostream>
@@ -27,8 +29,11 @@
 
 
 /*! \throws DiskImageError if disk image \p name could not be opened */
-Disk::Disk(const char *name) :
-    disk(NULL)
+Disk::Disk(const char *name_) :
+    disk(NULL),
+    name(name_),
+    overlay(false),
+    write_back(false)
 {
     const char *type = "dsk";
 
@@ -40,7 +45,7 @@ Disk::Disk(const char *name) :
             type = "nanowasp";
     }
 
-    if (dsk_open(&disk, name, type, NULL) != DSK_ERR_OK)
+    if (dsk_open(&disk, name_, type, NULL) != DSK_ERR_OK)
         throw DiskImageError();
 
     memset(&geom, 0, sizeof(DSK_GEOMETRY));
@@ -55,11 +60,14 @@ Disk::Disk(const char *name) :
 
 
 /*! \throws DiskImageError if disk image \p name could not be created */
-Disk::Disk(const char *name, int heads, int cyls, int sects, int sect_size)
+Disk::Disk(const char *name_, int heads, int cyls, int sects, int sect_size) :
+    name(name_),
+    overlay(false),
+    write_back(false)
 {
     std::vector<DSK_FORMAT> fmt(sects);
 
-    if (dsk_creat(&disk, name, "dsk", NULL) != DSK_ERR_OK)
+    if (dsk_creat(&disk, name_, "dsk", NULL) != DSK_ERR_OK)
         throw DiskImageError();
 
     memset(&geom, 0, sizeof(DSK_GEOMETRY));
@@ -90,6 +98,9 @@ Disk::Disk(const char *name, int heads, int cyls, int sects, int sect_size)
 
 Disk::~Disk()
 {
+   if (write_back && overlay)
+       WriteBack();
+
    dsk_close(&disk);
 }
 
@@ -103,6 +114,16 @@ Disk::~Disk()
  */
 bool Disk::ReadSector(unsigned char *buf, byte head, byte cyl, byte sect)
 {
+    if (overlay)
+    {
+        std::map<unsigned int, std::vector<unsigned char> >::const_iterator it = written.find(OverlayKey(head, cyl, sect));
+        if (it != written.end())
+        {
+            std::copy(it->second.begin(), it->second.end(), buf);
+            return true;
+        }
+    }
+
     return dsk_pread(disk, &geom, buf, cyl, head, sect) == DSK_ERR_OK;
 }
 
@@ -116,6 +137,15 @@ bool Disk::ReadSector(unsigned char *buf, byte head, byte cyl, byte sect)
  */
 bool Disk::WriteSector(unsigned char *buf, byte head, byte cyl, byte sect)
 {
+    if (overlay)
+    {
+        if (IsProtected())
+            return false;
+
+        written[OverlayKey(head, cyl, sect)].assign(buf, buf + geom.dg_secsize);
+        return true;
+    }
+
     return dsk_pwrite(disk, &geom, buf, cyl, head, sect) == DSK_ERR_OK;
 }
 
@@ -145,10 +175,78 @@ bool Disk::ReadIDField(unsigned char *buf, byte head, byte cyl)
 bool Disk::FormatTrack(DSK_FORMAT *format, byte filler, unsigned int num_sectors, byte head, byte cyl)
 {
     geom.dg_sectors = num_sectors;  // This is probably an abuse, but so long as none of the logical libdsk commands are used it should be ok
+
+    if (overlay)
+    {
+        // The sector IDs on the image stay as they were, only the data of the formatted sectors is replaced
+        if (IsProtected())
+            return false;
+
+        for (unsigned int i = 0; i < num_sectors; i++)
+            written[OverlayKey(head, cyl, format[i].fmt_sector)].assign(format[i].fmt_secsize, filler);
+        return true;
+    }
+
     return dsk_pformat(disk, &geom, cyl, head, format, filler) == DSK_ERR_OK;
 }
 
 
+void Disk::UseOverlay(bool write_back_)
+{
+    overlay = true;
+    write_back = write_back_;
+}
+
+
+/*! Formatted sectors are written with the filler, so the sector IDs on the image stay as they
+    were (as they do while using the overlay).
+ */
+void Disk::WriteBack()
+{
+    DSK_GEOMETRY sect_geom = geom;
+
+    std::map<unsigned int, std::vector<unsigned char> >::const_iterator it;
+    for (it = written.begin(); it != written.end(); it++)
+    {
+        sect_geom.dg_secsize = it->second.size();
+        dsk_pwrite(disk, &sect_geom, &it->second[0], (it->first >> 16) & 0xFF, (it->first >> 8) & 0xFF, it->first & 0xFF);
+    }
+}
+
+
+void Disk::SaveState(BinaryWriter& writer)
+{
+    writer.WriteDWord(geom.dg_sectors);
+    writer.WriteBool(overlay);
+
+    writer.WriteDWord((unsigned int)written.size());
+    std::map<unsigned int, std::vector<unsigned char> >::const_iterator it;
+    for (it = written.begin(); it != written.end(); it++)
+    {
+        writer.WriteDWord(it->first);
+        writer.WriteDWord((unsigned int)it->second.size());
+        if (!it->second.empty())
+            writer.WriteBuffer(&it->second[0], (int)it->second.size());
+    }
+}
+
+
+void Disk::RestoreState(BinaryReader& reader)
+{
+    geom.dg_sectors = reader.ReadDWord();
+    overlay = reader.ReadBool();
+
+    written.clear();
+    for (unsigned int n = reader.ReadDWord(); n > 0; n--)
+    {
+        std::vector<unsigned char> &data = written[reader.ReadDWord()];
+        data.resize(reader.ReadDWord());
+        if (!data.empty())
+            reader.ReadBuffer(&data[0], (int)data.size());
+    }
+}
+
+
 bool Disk::IsProtected()
 {
     unsigned char status;
@@ -21,6 +21,12 @@
 #define DISK_H
 
 #include <libdsk.h>
+#include <map>
+#include <vector>
+#include <string>
+
+class BinaryWriter;
+class BinaryReader;
 
 
 /*! \brief Represents a magnetic disk
@@ -50,6 +56,23 @@ public:
     //! Returns the write-protect status of the disk
     bool IsProtected();
 
+    //! Returns the name the disk was opened or created with
+    const std::string &GetName() const { return name; }
+
+    /*! \brief Keeps all further writes in memory instead of writing them to the image
+     *
+     *  Used when several machines were forked from the one that opened the image (see
+     *  ForkPoint), so that none of them see the changes made by the others, and while the writes
+     *  may be rewound (see RewindBuffer).  If \p write_back_ is set, the writes are written to
+     *  the image when the disk is unloaded.
+     */
+    void UseOverlay(bool write_back_ = false);
+
+    //! Saves the geometry and any overlay
+    void SaveState(BinaryWriter&);
+    //! Restores what SaveState() saved, the overlay is used if one was saved
+    void RestoreState(BinaryReader&);
+
     unsigned int SectorsPerTrack() const { return geom.dg_sectors; }
 
     //! Converts a sector size to a type code
@@ -61,6 +84,16 @@ public:
 private:
 	DSK_PDRIVER disk;  //!< libdsk disk handle
 	DSK_GEOMETRY geom;  //!< libdsk disk geometry
+    std::string name;  //!< Image file name
+
+    bool overlay;  //!< True if writes are kept in written rather than going to the image
+    bool write_back;  //!< True if written is written to the image by the destructor
+    std::map<unsigned int, std::vector<unsigned char> > written;  //!< Sectors written while using the overlay, see OverlayKey()
+
+    static unsigned int OverlayKey(byte head, byte cyl, byte sect) { return cyl << 16 | head << 8 | sect; }
+
+    //! Writes the sectors in the overlay to the image
+    void WriteBack();
 
     // Private copy constuctor and assigment operator to prevent copies
     Disk(const Disk &);
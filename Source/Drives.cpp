@@ -36,7 +36,8 @@ Drives::Drives(Microbee &mbee_, const TiXmlElement &config_) :
     config(&xml_config),
     fdc(NULL),
     disks(cNumDrives),
-    cyl(cNumDrives)
+    cyl(cNumDrives),
+    write_back(false)
 {
 }
 
@@ -83,7 +84,7 @@ void Drives::LateInit()
 
         try
         {
-            LoadDisk(drv, mbee.GetConfigFileName().GetPath(wxPATH_GET_SEPARATOR) + file);
+            LoadDisk(drv, (mbee.GetConfigDir() + file).c_str());
         }
         catch (OutOfRange &)
         {
@@ -135,8 +136,9 @@ void Drives::LoadDisk(unsigned int drive, const char *name)
     if (drive >= cNumDrives)
         throw OutOfRange();
 
+    Disk *disk = new Disk(name);  // First, so the drive is left as it was if this fails
     UnloadDisk(drive);  // In case a disk is already loaded
-    disks[drive] = new Disk(name);
+    disks[drive] = disk;
 }
 
 
@@ -153,6 +155,81 @@ void Drives::UnloadDisk(unsigned int drive)
 }
 
 
+void Drives::UseOverlays(bool write_back_)
+{
+    write_back = write_back_;
+
+    for (std::vector<Disk*>::iterator it = disks.begin(); it != disks.end(); it++)
+    {
+        if (*it != NULL)
+            (*it)->UseOverlay(write_back);
+    }
+}
+
+
+/*! The name of the disk in each drive is saved rather than its contents (apart from any
+    overlay), so the image must still be there when the state is restored.
+ */
+void Drives::SaveState(BinaryWriter& writer)
+{
+    writer.WriteByte(ctrl_side);
+    writer.WriteByte(ctrl_drive);
+    writer.WriteBool(ctrl_ddense);
+
+    for (unsigned int i = 0; i < cNumDrives; i++)
+    {
+        writer.WriteByte(cyl[i]);
+        writer.WriteBool(disks[i] != NULL);
+
+        if (disks[i] != NULL)
+        {
+            const std::string &name = disks[i]->GetName();
+            writer.WriteDWord((unsigned int)name.length());
+            writer.WriteBuffer((const unsigned char *)name.data(), (int)name.length());
+            disks[i]->SaveState(writer);
+        }
+    }
+}
+
+
+/*! Older saves have no Drives state, in which case the disks named in the configuration are
+    left in the drives.
+
+    \throws DiskImageError if a saved disk could not be loaded
+ */
+void Drives::RestoreState(BinaryReader& reader)
+{
+    if (reader.AtEnd())
+        return;
+
+    ctrl_side = reader.ReadByte();
+    ctrl_drive = reader.ReadByte();
+    ctrl_ddense = reader.ReadBool();
+
+    for (unsigned int i = 0; i < cNumDrives; i++)
+    {
+        cyl[i] = reader.ReadByte();
+
+        if (reader.ReadBool())
+        {
+            std::string name(reader.ReadDWord(), '\0');
+            if (!name.empty())
+                reader.ReadBuffer((unsigned char *)&name[0], (int)name.length());
+
+            if (disks[i] == NULL || disks[i]->GetName() != name)
+            {
+                LoadDisk(i, name.c_str());
+                if (write_back)
+                    disks[i]->UseOverlay(true);  // The saved state says whether to use it
+            }
+            disks[i]->RestoreState(reader);
+        }
+        else
+            UnloadDisk(i);
+    }
+}
+
+
 void Drives::SetCylinder(unsigned int cyl_)
 {
     if (cyl_ > cMaxCylinder)
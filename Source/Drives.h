@@ -58,6 +58,12 @@ public:
     //! Removes the dsik from \p drive
     void UnloadDisk(unsigned int drive);
 
+    //! Keeps all further writes to the loaded disks in memory, see Disk::UseOverlay() for \p write_back_
+    void UseOverlays(bool write_back_ = false);
+
+    virtual void SaveState(BinaryWriter&);
+    virtual void RestoreState(BinaryReader&);
+
     //! Returns true if the current drive is empty, or if the loaded disk is write-protected
     bool DiskProtected() const;
     //! Returns true if the current drive is over cylinder zero
@@ -101,6 +107,7 @@ private:
 
     std::vector<Disk*> disks;  //!< Disks for each drive
     std::vector<unsigned int> cyl;   //!< Current cylinder position for each drive
+    bool write_back;  //!< True if disks using overlays write them back to the images when unloaded
 
 
     const static unsigned int cNumDrives = 4;  //!< Total drives supported
@@ -28,7 +28,7 @@
 #include "Disk.h"
 
 
-const Microbee::time_t FDC::cStepDelays[] = {3000, 6000, 10000, 15000};  // In microseconds
+const Microbee::time_t FDC::cStepDelays[] = {3000 * Microbee::cTicksPerMicro, 6000 * Microbee::cTicksPerMicro, 10000 * Microbee::cTicksPerMicro, 15000 * Microbee::cTicksPerMicro};  // 3, 6, 10 and 15 ms
 
 
 /*! \p config_ must contain a <connect> to the associated Drives device. */
@@ -79,6 +79,86 @@ void FDC::Reset()
 }
 
 
+/*! Everything is saved, including a command in progress, so a restored FDC carries on exactly
+    where it left off.
+ */
+void FDC::SaveState(BinaryWriter& writer)
+{
+    writer.WriteByte(this->rcmd);
+    writer.WriteByte(this->rdata);
+    writer.WriteByte(this->rtrack);
+    writer.WriteByte(this->rsect);
+    writer.WriteByte(this->rstatus);
+
+    writer.WriteBool(this->intrq);
+    writer.WriteBool(this->drq);
+    writer.WriteBool(this->head_loaded);
+    writer.WriteBool(this->type1status);
+    writer.WriteBool(this->stepdir == cIn);
+
+    writer.WriteDWord((unsigned int)this->buf.size());
+    if (!this->buf.empty())
+        writer.WriteBuffer(&this->buf[0], (int)this->buf.size());
+    writer.WriteDWord((unsigned int)(this->buf.empty() ? 0 : this->buf_index - this->buf.begin()));
+    writer.WriteDWord(this->bytes_left);
+
+    writer.WriteByte(this->wt_filler);
+    writer.WriteDWord((unsigned int)this->wt_format.size());
+    for (std::vector<DSK_FORMAT>::const_iterator it = this->wt_format.begin(); it != this->wt_format.end(); it++)
+    {
+        writer.WriteDWord(it->fmt_cylinder);
+        writer.WriteDWord(it->fmt_head);
+        writer.WriteDWord(it->fmt_sector);
+        writer.WriteDWord((unsigned int)it->fmt_secsize);
+    }
+    writer.WriteByte(this->wt_state);
+    writer.WriteDWord(this->wt_secpertrack);
+
+    writer.WriteQWord(this->emu_time);
+    writer.WriteByte(this->state);
+}
+
+/*! Older saves have no FDC state, in which case it is left as it was reset. */
+void FDC::RestoreState(BinaryReader& reader)
+{
+    if (reader.AtEnd())
+        return;
+
+    this->rcmd = reader.ReadByte();
+    this->rdata = reader.ReadByte();
+    this->rtrack = reader.ReadByte();
+    this->rsect = reader.ReadByte();
+    this->rstatus = reader.ReadByte();
+
+    this->intrq = reader.ReadBool();
+    this->drq = reader.ReadBool();
+    this->head_loaded = reader.ReadBool();
+    this->type1status = reader.ReadBool();
+    this->stepdir = reader.ReadBool() ? cIn : cOut;
+
+    this->buf.resize(reader.ReadDWord());
+    if (!this->buf.empty())
+        reader.ReadBuffer(&this->buf[0], (int)this->buf.size());
+    this->buf_index = this->buf.begin() + reader.ReadDWord();
+    this->bytes_left = reader.ReadDWord();
+
+    this->wt_filler = reader.ReadByte();
+    this->wt_format.resize(reader.ReadDWord());
+    for (std::vector<DSK_FORMAT>::iterator it = this->wt_format.begin(); it != this->wt_format.end(); it++)
+    {
+        it->fmt_cylinder = reader.ReadDWord();
+        it->fmt_head = reader.ReadDWord();
+        it->fmt_sector = reader.ReadDWord();
+        it->fmt_secsize = reader.ReadDWord();
+    }
+    this->wt_state = (WTState)reader.ReadByte();
+    this->wt_secpertrack = (int)reader.ReadDWord();
+
+    this->emu_time = reader.ReadQWord();
+    this->state = (State)reader.ReadByte();
+}
+
+
 void FDC::PortWrite(word addr, byte val)
 {
     Update();
@@ -235,7 +315,7 @@ bool FDC::GetDRQ()
 
 void FDC::Update()
 {
-    // microseconds to run for.  Should run for as close to this time as possible, without
+    // Ticks to run for.  Should run for as close to this time as possible, without
     // exceeding it (if it does exceed it then, e.g., the CPU may lose data even
     // though it really would have read it in time).
     Microbee::time_t now = mbee.GetTime();
@@ -50,6 +50,9 @@ public:
     virtual void PortWrite(word addr, byte val);
     virtual byte PortRead(word addr);
 
+    virtual void SaveState(BinaryWriter& writer);
+    virtual void RestoreState(BinaryReader& reader);
+
     //! Returns the current IntRQ signal
     bool GetIntRQ();
     //! Returns the current DRQ signal
@@ -87,7 +90,7 @@ private:
 
     byte wt_filler;  //!< Write Track data area filler byte
     std::vector<DSK_FORMAT> wt_format; //!< Write Track formatting data
-    enum
+    enum WTState
     {
         sWTGap,
         sWTMark,
@@ -106,7 +109,7 @@ private:
     void LogCommand();
     void LogStatus();
 
-    enum
+    enum State
     {
         sIdle,
 
@@ -135,11 +138,11 @@ private:
     } state;  //!< Current state of FDC
 
 
-    static const Microbee::time_t cByteTime = 160;  //!< Time to read/write a single byte in microseconds
+    static const Microbee::time_t cByteTime = 160 * Microbee::cTicksPerMicro;  //!< Time to read/write a single byte (160 microseconds)
 
     static const unsigned int cBytesPerTrack = 10000; //!< Number of raw bytes on a disk track
 
-    /*! microseconds expended if the record doesn't exist
+    /*! Time expended if the record doesn't exist
      *
      *  This should really be variable if the emulation was accurate, but so
      *  long as it's not too small things will work OK.  Key test - when the Microbee
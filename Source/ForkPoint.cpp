@@ -0,0 +1,97 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "stdafx.h"
+#include "ForkPoint.h"
+
+#include <sstream>
+#include <cstring>
+
+#include "utils/BinaryWriter.h"
+#include "utils/SharedMemory.h"
+
+#include "Microbee.h"
+#include "Device.h"
+#include "RAM.h"
+#include "Drives.h"
+
+
+ForkPoint::ForkPoint(Microbee &mbee) :
+    config_dir(mbee.GetConfigDir()),
+    image(NULL)
+{
+    configuration.InsertEndChild(mbee.GetConfig());
+    TiXmlElement *mbee_tag = configuration.FirstChildElement("microbee");
+
+    // A saved state in the configuration is replaced by the one saved here
+    while (TiXmlElement *old_schedule = mbee_tag->FirstChildElement("Schedule"))
+        mbee_tag->RemoveChild(old_schedule);
+
+    for (TiXmlElement *el = mbee_tag->FirstChildElement("device"); el != NULL; el = el->NextSiblingElement("device"))
+    {
+        while (TiXmlElement *old_state = el->FirstChildElement("State"))
+            el->RemoveChild(old_state);
+
+        // Before the state is saved, so the clones start out with overlays too
+        Drives *drives = dynamic_cast<Drives*>(mbee.GetDevice<Device>(el->Attribute("id")));
+        if (drives != NULL)
+            drives->UseOverlays();
+    }
+
+
+    // Save the devices, laying out the RAM devices in the image on page boundaries
+    size_t image_size = 0;
+    for (TiXmlElement *el = mbee_tag->FirstChildElement("device"); el != NULL; el = el->NextSiblingElement("device"))
+    {
+        const char *id = el->Attribute("id");
+        Device *device = mbee.GetDevice<Device>(id);
+
+        if (dynamic_cast<RAM*>(device) != NULL)
+        {
+            ram_images[id] = image_size;
+            image_size += SharedMemory::RoundUp(dynamic_cast<RAM*>(device)->GetSize());
+        }
+        else
+        {
+            std::ostringstream stream(std::ostringstream::out | std::ostringstream::binary);
+            BinaryWriter writer(stream);
+            device->SaveState(writer);
+            states[id] = stream.str();
+        }
+    }
+
+    image = new SharedMemory(image_size);
+    for (std::map<std::string, size_t>::iterator it = ram_images.begin(); it != ram_images.end(); it++)
+    {
+        RAM *ram = mbee.GetDevice<RAM>(it->first);
+        memcpy(image->Data() + it->second, ram->memory, ram->GetSize());
+    }
+
+    std::ostringstream stream(std::ostringstream::out | std::ostringstream::binary);
+    BinaryWriter writer(stream);
+    mbee.SaveSchedule(writer);
+    schedule = stream.str();
+}
+
+
+ForkPoint::~ForkPoint()
+{
+    delete image;
+}
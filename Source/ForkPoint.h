@@ -0,0 +1,73 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FORKPOINT_H
+#define FORKPOINT_H
+
+#include <map>
+#include <string>
+#include "tinyxml/tinyxml.h"
+
+class Microbee;
+class SharedMemory;
+
+
+/*! \brief A saved Microbee that can be cloned any number of times
+ *
+ *  Booting a machine is the slow part of running it for a short time, so a test harness boots
+ *  one, takes a ForkPoint of it once it is ready, and then builds as many clones from that as
+ *  it needs (see Microbee::Microbee(VideoSink&, InputSource&, const ForkPoint&)).
+ *
+ *  The devices' state is kept as saved by Device::SaveState(), except for RAM devices which are
+ *  copied into one SharedMemory block.  Each clone maps its RAM from that block copy-on-write, so
+ *  a clone is built without copying the RAM and only the pages it writes to become its own.
+ *
+ *  Disks are shared by name, so once the ForkPoint is made the machine and its clones keep their
+ *  writes to the disks in memory (see Disk::UseOverlay()) and the images are left as they were.
+ */
+class ForkPoint
+{
+public:
+    /*! \brief Saves \p mbee as it is now
+     *
+     *  \p mbee must not be running (see Microbee::SaveSchedule()).  It can carry on afterwards,
+     *  independently of the clones.
+     */
+    explicit ForkPoint(Microbee &mbee);
+    ~ForkPoint();
+
+private:
+    friend class Microbee;
+
+    TiXmlDocument configuration;  //!< Configuration of the system, without any saved state
+    std::string config_dir;  //!< See Microbee::GetConfigDir()
+
+    std::string schedule;  //!< Saved by Microbee::SaveSchedule()
+    std::map<std::string, std::string> states;  //!< Saved state of each device other than the RAM, by id
+
+    SharedMemory *image;  //!< Contents of the RAM devices
+    std::map<std::string, size_t> ram_images;  //!< Offset of each RAM device's contents in image, by id
+
+    // Private copy constuctor and assigment operator to prevent copies
+    ForkPoint(const ForkPoint &);
+    ForkPoint& operator= (const ForkPoint &);
+};
+
+
+#endif // FORKPOINT_H
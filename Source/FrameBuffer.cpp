@@ -0,0 +1,173 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include "stdafx.h"
+#include "FrameBuffer.h"
+
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRAMEBUFFER_SSE2
+#include <emmintrin.h>
+#endif
+
+
+namespace
+{
+    //! Eight pixels for each byte of bits
+    struct ExpandTable
+    {
+        byte pixels[256][8];
+
+        ExpandTable()
+        {
+            for (int i = 0; i < 256; i++)
+                for (int b = 0; b < 8; b++)
+                    pixels[i][b] = (i & (0x80 >> b)) ? FrameBuffer::cOn : FrameBuffer::cOff;
+        }
+    };
+
+    const ExpandTable expand_table;
+}
+
+
+FrameBuffer::FrameBuffer(Format format_) :
+    format(format_),
+    width(0),
+    height(0)
+{
+}
+
+
+void FrameBuffer::Render(const VideoFrame &frame, bool all)
+{
+    const word spr = frame.scans_per_row;
+    const int new_width = frame.cols * VideoFrame::cCharWidth;
+    const int new_height = frame.rows * spr;
+
+    if (new_width != width || new_height != height)
+        all = true;
+    if (!all && !frame.changed)
+        return;
+
+    width = new_width;
+    height = new_height;
+
+    const int pitch = Pitch();
+    const int cell_bytes = format == cBitPerPixel ? 1 : VideoFrame::cCharWidth;
+
+    pixels.resize((size_t)pitch * height);
+    line.resize(frame.cols);
+
+    for (word row = 0; row < frame.rows; row++)
+    {
+        const unsigned int first = row * frame.cols;
+        const int cursor = frame.cursor - first;  // Column of the cursor, if it's in this row
+
+        for (word col = 0; col < frame.cols; )
+        {
+            if (!all && !frame.dirty[first + col])
+            {
+                col++;
+                continue;
+            }
+
+            // Render the run of dirty cells from here
+            word end = col + 1;
+            while (end < frame.cols && (all || frame.dirty[first + end]))
+                end++;
+
+            const unsigned char * const *glyphs = &frame.glyphs[first];
+            byte *out = &pixels[(size_t)row * spr * pitch + col * cell_bytes];
+
+            for (word scan = 0; scan < spr; scan++)
+            {
+                const word k = spr - scan - 1;  // Bitmaps are bottom scan line first
+                for (word c = col; c < end; c++)
+                    line[c] = glyphs[c][k];
+
+                if (cursor >= col && cursor < end && scan >= frame.cursor_start && scan <= frame.cursor_end)
+                    line[cursor] ^= 0xFF;
+
+                if (format == cBitPerPixel)
+                    memcpy(out, &line[col], end - col);
+                else
+                    Expand(&line[col], end - col, out);
+                out += pitch;
+            }
+
+            col = end;
+        }
+    }
+}
+
+
+/*! With SSE2, each group of 16 bytes is spread so that every byte fills 8 lanes, then each lane
+    is compared against the bit for its pixel.  AVX2 does 4 bytes at a time the same way, using
+    a shuffle to spread them.  Bytes left over are expanded from a table.
+ */
+void FrameBuffer::Expand(const byte *bits, unsigned int count, byte *out)
+{
+    unsigned int i = 0;
+
+#if defined(__AVX2__)
+    const __m256i spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                            2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i mask = _mm256_setr_epi8((char)0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1, (char)0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1,
+                                          (char)0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1, (char)0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1);
+    for (; i + 4 <= count; i += 4)
+    {
+        int b;
+        memcpy(&b, bits + i, sizeof(b));
+        __m256i v = _mm256_shuffle_epi8(_mm256_set1_epi32(b), spread);
+        v = _mm256_cmpeq_epi8(_mm256_and_si256(v, mask), mask);
+        _mm256_storeu_si256((__m256i *)(out + i * 8), v);
+    }
+#elif defined(FRAMEBUFFER_SSE2)
+    const __m128i mask = _mm_setr_epi8((char)0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1, (char)0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1);
+    for (; i + 16 <= count; i += 16)
+    {
+        const __m128i v = _mm_loadu_si128((const __m128i *)(bits + i));
+        const __m128i b8[2] = { _mm_unpacklo_epi8(v, v), _mm_unpackhi_epi8(v, v) };
+
+        for (int h = 0; h < 2; h++)
+        {
+            const __m128i b16[2] = { _mm_unpacklo_epi16(b8[h], b8[h]), _mm_unpackhi_epi16(b8[h], b8[h]) };
+
+            for (int q = 0; q < 2; q++)
+            {
+                const __m128i lo = _mm_unpacklo_epi32(b16[q], b16[q]);  // Two bytes, 8 lanes each
+                const __m128i hi = _mm_unpackhi_epi32(b16[q], b16[q]);
+                byte *o = out + (i + h * 8 + q * 4) * 8;
+
+                _mm_storeu_si128((__m128i *)o, _mm_cmpeq_epi8(_mm_and_si128(lo, mask), mask));
+                _mm_storeu_si128((__m128i *)(o + 16), _mm_cmpeq_epi8(_mm_and_si128(hi, mask), mask));
+            }
+        }
+    }
+#endif
+
+    for (; i < count; i++)
+        memcpy(out + i * 8, expand_table.pixels[bits[i]], 8);
+}
@@ -0,0 +1,84 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <vector>
+#include "VideoSink.h"
+
+
+/*! \brief A VideoFrame rendered into host memory, one byte per pixel
+ *
+ *  Pixels are cOff or cOn, row by row from the top, Pitch() bytes per row.  The whole frame is
+ *  rendered each time in the same number of steps whatever it shows, so it can be presented with
+ *  a single copy (e.g. glDrawPixels()) or written out when there's no display.
+ *
+ *  Each scan line of a run of dirty cells is gathered into one byte per cell (applying the
+ *  cursor) and then expanded to pixels by Expand(), which uses SSE2 or AVX2 when built for them.
+ *  With cBitPerPixel the gathered bytes are stored as they are.
+ */
+class FrameBuffer
+{
+public:
+    //! Ways of storing the pixels
+    enum Format
+    {
+        cBytePerPixel,  //!< Each pixel is a byte, cOff or cOn
+        cBitPerPixel  //!< Eight pixels to a byte, the leftmost in the most significant bit
+    };
+
+    explicit FrameBuffer(Format format_ = cBytePerPixel);
+
+    /*! \brief Renders \p frame, resizing the buffer to fit it
+     *
+     *  Only the dirty cells are rendered (see VideoFrame), unless \p all is set or the buffer
+     *  has changed size.  So \p all must be set if the last frame rendered wasn't the one
+     *  before \p frame.
+     */
+    void Render(const VideoFrame &frame, bool all = false);
+
+    int Width() const { return width; }
+    int Height() const { return height; }
+
+    //! Returns the length of each row of pixels in bytes
+    int Pitch() const { return format == cBitPerPixel ? width / 8 : width; }
+
+    //! Returns the pixels, NULL if nothing has been rendered
+    const byte *Pixels() const { return pixels.empty() ? NULL : &pixels[0]; }
+
+    /*! \brief Expands \p count bytes of 1 bit per pixel at \p bits into \p count * 8 pixels at \p out
+     *
+     *  The most significant bit of each byte is the leftmost pixel.
+     */
+    static void Expand(const byte *bits, unsigned int count, byte *out);
+
+    static const byte cOff = 0x00;  //!< Value of a pixel that is off
+    static const byte cOn = 0xFF;  //!< Value of a pixel that is on
+
+private:
+    Format format;
+    int width, height;
+    std::vector<byte> pixels;
+    std::vector<byte> line;  //!< One scan line of bits, see Render()
+};
+
+
+#endif // FRAMEBUFFER_H
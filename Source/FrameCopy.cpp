@@ -0,0 +1,39 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "stdafx.h"
+#include "FrameCopy.h"
+
+#include <cstring>
+
+
+void FrameCopy::Assign(const VideoFrame &frame_)
+{
+    const unsigned int cells = (unsigned int)frame_.cols * frame_.rows;
+    const word spr = frame_.scans_per_row;
+
+    frame = frame_;
+    bitmaps.resize((size_t)cells * spr);
+    for (unsigned int i = 0; i < cells; i++)
+    {
+        memcpy(&bitmaps[i * spr], frame_.glyphs[i], spr);
+        frame.glyphs[i] = &bitmaps[i * spr];
+    }
+}
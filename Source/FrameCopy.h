@@ -0,0 +1,48 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FRAMECOPY_H
+#define FRAMECOPY_H
+
+#include <vector>
+#include "VideoSink.h"
+
+
+/*! \brief A copy of a VideoFrame that owns its bitmaps
+ *
+ *  A VideoFrame's bitmaps point into the graphics memory, so they change as the emulation carries
+ *  on.  A FrameCopy holds its own copy of each cell's bitmap, so it still describes the frame
+ *  when it's used later or on another thread.
+ */
+class FrameCopy
+{
+public:
+    //! Copies \p frame_, including its bitmaps
+    void Assign(const VideoFrame &frame_);
+
+    //! Returns the copy, whose glyphs point into the FrameCopy
+    const VideoFrame &Frame() const { return frame; }
+
+private:
+    VideoFrame frame;
+    std::vector<unsigned char> bitmaps;  //!< scans_per_row bytes for each cell, row by row
+};
+
+
+#endif // FRAMECOPY_H
@@ -0,0 +1,95 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "stdafx.h"
+#include "FrameRecorder.h"
+
+#include "utils/Hash.h"
+
+
+FrameRecorder::FrameRecorder(std::ostream *frames_, int bpp_, std::ostream *hashes_) :
+    frames(frames_),
+    bpp(bpp_),
+    hashes(hashes_),
+    buffer(FrameBuffer::cBitPerPixel),
+    frames_seen(0),
+    hash(0)
+{
+}
+
+
+/*! An unchanged frame (see VideoFrame) is the same as the last without looking at it.  Otherwise
+    only its dirty cells are rendered, but all of it is hashed, since cells can change back to
+    what they were.
+ */
+void FrameRecorder::Record(const VideoFrame &frame, long long millis)
+{
+    const unsigned long n = frames_seen++;
+    if (n > 0 && !frame.changed)
+        return;
+
+    buffer.Render(frame);
+
+    Hash64 h;
+    h.AddNumber(buffer.Width());
+    h.AddNumber(buffer.Height());
+    if (buffer.Pixels() != NULL)
+        h.Add(buffer.Pixels(), (size_t)buffer.Pitch() * buffer.Height());
+
+    if (n > 0 && h.Value() == hash)
+        return;
+    hash = h.Value();
+
+    if (hashes != NULL)
+    {
+        char hex[17];
+        sprintf(hex, "%016llx", hash);
+        *hashes << n << ' ' << millis << ' ' << buffer.Width() << ' ' << buffer.Height() << ' ' << hex << std::endl;
+    }
+
+    if (frames != NULL)
+    {
+        WritePixels();
+        frames->flush();
+    }
+}
+
+
+void FrameRecorder::WritePixels()
+{
+    const byte *pixels = buffer.Pixels();
+    if (pixels == NULL)
+        return;
+
+    const int pitch = buffer.Pitch();
+
+    if (bpp == 1)
+    {
+        frames->write((const char *)pixels, (std::streamsize)pitch * buffer.Height());
+        return;
+    }
+
+    row.resize(buffer.Width());
+    for (int y = 0; y < buffer.Height(); y++)
+    {
+        FrameBuffer::Expand(pixels + (size_t)y * pitch, pitch, &row[0]);
+        frames->write((const char *)&row[0], (std::streamsize)row.size());
+    }
+}
@@ -0,0 +1,77 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FRAMERECORDER_H
+#define FRAMERECORDER_H
+
+#include <ostream>
+#include <vector>
+#include "VideoSink.h"
+#include "FrameBuffer.h"
+
+
+/*! \brief Records the frames the CRTC generates, for checking a run without a display
+ *
+ *  Each frame is rendered from its glyph bitmaps into a FrameBuffer of one bit per pixel, and
+ *  identified by a 64-bit hash of its size and pixels.  Runs of identical frames are collapsed,
+ *  so only a frame that differs from the one before is recorded, as:
+ *    - a line of text on the hashes stream: the frame number (counting from 0), the emulated
+ *      time in milliseconds, the width and height in pixels, and the hash in hexadecimal
+ *    - the raw pixels on the frames stream, row by row from the top, either 1 bit per pixel (the
+ *      leftmost in the most significant bit, Width() / 8 bytes per row) or 8 bits per pixel
+ *      (FrameBuffer::cOff or FrameBuffer::cOn, Width() bytes per row)
+ *
+ *  Both streams are flushed after each frame, so a script reading them through a pipe can wait
+ *  for a frame.  Hashes don't depend on the bits per pixel written.
+ */
+class FrameRecorder
+{
+public:
+    /*! \brief Records to \p frames_ and \p hashes_, either of which can be NULL
+     *
+     *  \p bpp_ is the bits per pixel written to \p frames_, 1 or 8.
+     */
+    FrameRecorder(std::ostream *frames_, int bpp_, std::ostream *hashes_);
+
+    //! Records \p frame, which was generated at \p millis of emulated time, if it differs from the last one
+    void Record(const VideoFrame &frame, long long millis);
+
+    //! Returns the number of frames recorded so far, including those collapsed
+    unsigned long Frames() const { return frames_seen; }
+
+    //! Returns the hash of the last frame recorded (only valid if Frames() is not 0)
+    unsigned long long LastHash() const { return hash; }
+
+
+private:
+    std::ostream *frames;
+    int bpp;
+    std::ostream *hashes;
+
+    FrameBuffer buffer;  //!< The last frame, one bit per pixel
+    std::vector<byte> row;  //!< One row of the frame expanded to 8 bits per pixel
+    unsigned long frames_seen;
+    unsigned long long hash;
+
+    //! Writes the pixels in buffer to frames
+    void WritePixels();
+};
+
+
+#endif // FRAMERECORDER_H
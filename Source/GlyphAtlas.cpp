@@ -0,0 +1,180 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "stdafx.h"
+#include "GlyphAtlas.h"
+
+#include <algorithm>
+
+#include "CRTCMemory.h"
+#include "FrameBuffer.h"
+
+
+GlyphAtlas::GlyphAtlas() :
+    texture(0),
+    cols(0),
+    rows(0),
+    scans_per_row(0),
+    loaded(CRTCMemory::cGlyphCount)
+{
+}
+
+
+/*! The texture holds each bitmap only as far down as the scan lines per row, so everything is
+    reloaded when the layout changes.
+ */
+void GlyphAtlas::Draw(const VideoFrame &frame, bool all)
+{
+    if (texture == 0)
+    {
+        const std::vector<byte> blank(cSize * cSize, FrameBuffer::cOff);
+
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, cSize, cSize, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, &blank[0]);
+    }
+    else
+        glBindTexture(GL_TEXTURE_2D, texture);
+
+    const unsigned int cells = (unsigned int)frame.cols * frame.rows;
+    if (cells == 0)
+        return;
+
+    if (frame.cols != cols || frame.rows != rows || frame.scans_per_row != scans_per_row)
+    {
+        SetLayout(frame);
+        all = true;
+    }
+
+    if (all)
+        std::fill(loaded.begin(), loaded.end(), 0);
+    else if (frame.changed)
+    {
+        for (unsigned int i = 0; i < loaded.size(); i++)
+            if (frame.glyph_changed[i])
+                loaded[i] = 0;
+    }
+
+    if (all || frame.changed)
+    {
+        for (unsigned int i = 0; i < cells; i++)
+        {
+            if (!all && !frame.dirty[i])
+                continue;
+
+            const word glyph = frame.glyph_ids[i];
+            if (!loaded[glyph])
+            {
+                Load(glyph, frame.glyphs[i], scans_per_row);
+                loaded[glyph] = 1;
+            }
+
+            SetCell(i, glyph);
+        }
+    }
+
+    glEnable(GL_TEXTURE_2D);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glVertexPointer(2, GL_FLOAT, 0, &vertices[0]);
+    glTexCoordPointer(2, GL_FLOAT, 0, &tex_coords[0]);
+
+    glDrawArrays(GL_QUADS, 0, cells * 4);
+
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisable(GL_TEXTURE_2D);
+
+    // The cursor inverts its scan lines of the cell
+    if (frame.cursor >= 0 && frame.cursor_start <= frame.cursor_end && frame.cursor_start < scans_per_row)
+    {
+        const GLfloat x = (frame.cursor % cols) * VideoFrame::cCharWidth - 0.5f;
+        const GLfloat y = (frame.cursor / cols) * scans_per_row - 0.5f;
+        const word end = std::min<word>(frame.cursor_end + 1, scans_per_row);
+
+        glEnable(GL_COLOR_LOGIC_OP);
+        glLogicOp(GL_XOR);
+        glRectf(x, y + frame.cursor_start, x + VideoFrame::cCharWidth, y + end);
+        glDisable(GL_COLOR_LOGIC_OP);
+    }
+}
+
+
+/*! Pixel centres are at whole coordinates, so the corners are offset by half a pixel to cover
+    each pixel exactly.
+ */
+void GlyphAtlas::SetLayout(const VideoFrame &frame)
+{
+    cols = frame.cols;
+    rows = frame.rows;
+    scans_per_row = std::min<word>(frame.scans_per_row, cGlyphHeight);
+
+    vertices.resize((size_t)cols * rows * 8);
+    tex_coords.resize(vertices.size());
+
+    GLfloat *v = &vertices[0];
+    for (word i = 0; i < rows; i++)
+    {
+        const GLfloat top = i * scans_per_row - 0.5f;
+        const GLfloat bottom = top + scans_per_row;
+
+        for (word j = 0; j < cols; j++)
+        {
+            const GLfloat left = j * VideoFrame::cCharWidth - 0.5f;
+            const GLfloat right = left + VideoFrame::cCharWidth;
+
+            *v++ = left;  *v++ = top;
+            *v++ = right; *v++ = top;
+            *v++ = right; *v++ = bottom;
+            *v++ = left;  *v++ = bottom;
+        }
+    }
+}
+
+
+void GlyphAtlas::Load(word glyph, const unsigned char *bitmap, word scans)
+{
+    byte texels[cGlyphHeight * VideoFrame::cCharWidth];
+
+    for (word k = 0; k < scans; k++)
+        FrameBuffer::Expand(&bitmap[scans - k - 1], 1, &texels[k * VideoFrame::cCharWidth]);
+
+    glTexSubImage2D(GL_TEXTURE_2D, 0, (glyph % cGlyphsPerRow) * VideoFrame::cCharWidth, (glyph / cGlyphsPerRow) * cGlyphHeight,
+                    VideoFrame::cCharWidth, scans, GL_LUMINANCE, GL_UNSIGNED_BYTE, texels);
+}
+
+
+void GlyphAtlas::SetCell(unsigned int cell, word glyph)
+{
+    const GLfloat left = (GLfloat)(glyph % cGlyphsPerRow) * VideoFrame::cCharWidth / cSize;
+    const GLfloat right = left + (GLfloat)VideoFrame::cCharWidth / cSize;
+    const GLfloat top = (GLfloat)(glyph / cGlyphsPerRow) * cGlyphHeight / cSize;
+    const GLfloat bottom = top + (GLfloat)scans_per_row / cSize;
+
+    GLfloat *t = &tex_coords[cell * 8];
+    *t++ = left;  *t++ = top;
+    *t++ = right; *t++ = top;
+    *t++ = right; *t++ = bottom;
+    *t++ = left;  *t++ = bottom;
+}
@@ -0,0 +1,77 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GLYPHATLAS_H
+#define GLYPHATLAS_H
+
+#include <wx/glcanvas.h>
+#include <vector>
+#include "VideoSink.h"
+
+
+/*! \brief Draws VideoFrames from a texture holding every character bitmap
+ *
+ *  Both banks of the char ROM and the PCG RAM bitmaps share one texture, laid out by their index
+ *  (see CRTCMemory::GetGlyphIndex()).  A frame is drawn as a vertex array of textured quads, one
+ *  per cell, with a single glDrawArrays(), plus a rectangle for the cursor.
+ *
+ *  A bitmap is copied into the texture when a cell first shows it, and again after it changes,
+ *  so writes to the PCG RAM only cost uploading the characters written.  Only the texture
+ *  coordinates of dirty cells are updated.
+ *
+ *  Only OpenGL 1.1 is used (no shaders, and a power of two texture), so it works with Mesa's
+ *  software rasterisers.
+ *
+ *  \note All calls must be made from the thread the OpenGL context is current in.
+ */
+class GlyphAtlas
+{
+public:
+    GlyphAtlas();
+
+    /*! \brief Draws \p frame with the top left corner of its first cell at the origin, one unit per pixel
+     *
+     *  The y axis must point down the screen, and the current colour is used for pixels that are
+     *  on.  \p all must be set if \p frame doesn't follow the last frame drawn (see
+     *  FrameBuffer::Render()).
+     */
+    void Draw(const VideoFrame &frame, bool all);
+
+private:
+    GLuint texture;  //!< Texture holding the bitmaps, 0 until it has been created
+    word cols, rows, scans_per_row;  //!< Layout the vertices were set up for
+
+    std::vector<byte> loaded;  //!< Non-zero for each bitmap, by index, that is current in the texture
+    std::vector<GLfloat> vertices;  //!< Corners of each cell, row by row
+    std::vector<GLfloat> tex_coords;  //!< Texture coordinates of the corners of each cell
+
+    //! Sets up the vertices for the layout of \p frame
+    void SetLayout(const VideoFrame &frame);
+    //! Copies \p bitmap, \p scans bytes from the bottom scan line up, into the texture for bitmap \p glyph
+    void Load(word glyph, const unsigned char *bitmap, word scans);
+    //! Points the texture coordinates of \p cell at bitmap \p glyph
+    void SetCell(unsigned int cell, word glyph);
+
+    static const int cSize = 256;  //!< Width and height of the texture in texels
+    static const int cGlyphsPerRow = cSize / VideoFrame::cCharWidth;  //!< Bitmaps across the texture
+    static const int cGlyphHeight = 16;  //!< Texels down the texture for each bitmap (CRTCMemory::cBitmapSize)
+};
+
+
+#endif // GLYPHATLAS_H
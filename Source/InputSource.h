@@ -0,0 +1,39 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INPUTSOURCE_H
+#define INPUTSOURCE_H
+
+
+/*! \brief Provides the state of the emulated keyboard's keys
+ *
+ *  Implemented by the host to map real keys (or a script) on to the Microbee's keys.  Keys are
+ *  numbered as the Keyboard device scans them (see Keyboard::Key).
+ */
+class InputSource
+{
+public:
+    virtual ~InputSource() {}
+
+    //! Returns true if the Microbee key \p key (0 - 63) is currently pressed
+    virtual bool IsPressed(int key) = 0;
+};
+
+
+#endif // INPUTSOURCE_H
@@ -23,7 +23,7 @@
 
 #include "Microbee.h"
 #include "CRTC.h"
-#include "Terminal.h"
+#include "InputSource.h"
 #include "LatchROM.h"
 
 
@@ -32,7 +32,7 @@ Keyboard::Keyboard(Microbee &mbee_, const TiXmlElement &config_) :
     mbee(mbee_),
     xml_config(config_),  // Create a local copy of the config
     config(&xml_config),
-    term(mbee.GetTerminal()),
+    input(mbee.GetInputSource()),
     crtc(NULL),
     latch_rom(NULL)
 {
@@ -68,7 +68,7 @@ void Keyboard::LateInit()
     status on the assumption that RA4 is currently raised). */
 void Keyboard::Check(word maddr)
 {
-   if (term.IsPressed(keymap[getBits(maddr, cKeyOfs, cKeyBits)]))
+   if (input.IsPressed(getBits(maddr, cKeyOfs, cKeyBits)))
       crtc->TriggerLPen(maddr);
 }
 
@@ -81,7 +81,7 @@ void Keyboard::CheckAll()
    {
       for (int i = cNumKeys - 1; i >= 0; --i)
       {
-         if (term.IsPressed(keymap[i]))
+         if (input.IsPressed(i))
          {
             crtc->TriggerLPen(i << cKeyOfs);
             break;
@@ -89,72 +89,3 @@ void Keyboard::CheckAll()
       }
    }
 }
-
-
-const int Keyboard::keymap[] =
-{
-    '\'',
-    'A',
-    'B',
-    'C',
-    'D',
-    'E',
-    'F',
-    'G',
-    'H',
-    'I',
-    'J',
-    'K',
-    'L',
-    'M',
-    'N',
-    'O',
-    'P',
-    'Q',
-    'R',
-    'S',
-    'T',
-    'U',
-    'V',
-    'W',
-    'X',
-    'Y',
-    'Z',
-    '[',
-    '\\',
-    ']',
-    '~',
-    WXK_DELETE,
-    '0',
-    '1',
-    '2',
-    '3',
-    '4',
-    '5',
-    '6',
-    '7',
-    '8',
-    '9',
-    ';',
-    '+',
-    ',',
-    '-',
-    '.',
-    '/',
-    WXK_ESCAPE,
-    WXK_BACK,
-    WXK_TAB,
-    WXK_NUMPAD_ENTER,     /* LF */
-    WXK_RETURN,
-    WXK_CAPITAL,
-    WXK_NUMPAD_ADD,       /* break */
-    WXK_SPACE,
-    WXK_F1,               /* 61 */
-    WXK_CONTROL,
-    WXK_F2,               /* 62 */
-    WXK_F5,               /* 65 */
-    WXK_F4,               /* 64 */
-    WXK_F3,               /* 63 */
-    WXK_F6,               /* 66 */
-    WXK_SHIFT
-};
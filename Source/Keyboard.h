@@ -22,7 +22,7 @@
 
 #include "Device.h"
 
-class Terminal;
+class InputSource;
 class CRTC;
 class LatchROM;
 class Microbee;
@@ -41,8 +41,8 @@ class Microbee;
  *  presumably raises the RA4 line.  This provides the software with a way to instantly check a given key's state
  *  (used to check the shift key after another key press has been detected, for example).
  *
- *
- *  \todo User-configurable key map
+ *  The state of the keys comes from the InputSource given to Microbee, which maps them from
+ *  the host.
  */
 class Keyboard : public Device
 {
@@ -58,18 +58,49 @@ public:
     //! Checks the status of all keys, triggers the light pen for the first key found to be pressed
     void CheckAll();
 
+    /*! \brief Numbers of the Microbee's keys, in the order they are scanned
+     *
+     *  The letters and digits are consecutive from cKeyA and cKey0.
+     */
+    enum Key
+    {
+        cKeyAt = 0,
+        cKeyA,
+        cKeyLeftBracket = 27,
+        cKeyBackslash,
+        cKeyRightBracket,
+        cKeyCaret,
+        cKeyDelete,
+        cKey0,
+        cKeyColon = 42,
+        cKeySemicolon,
+        cKeyComma,
+        cKeyMinus,
+        cKeyPeriod,
+        cKeySlash,
+        cKeyEscape,
+        cKeyBackspace,
+        cKeyTab,
+        cKeyLineFeed,
+        cKeyReturn,
+        cKeyLock,
+        cKeyBreak,
+        cKeySpace,
+        cKeyControl = 57,
+        cKeyShift = 63
+    };
+
+    static const byte cNumKeys = 64;
+
 
 private:
     Microbee &mbee;  //!< Owning Microbee
     TiXmlElement xml_config;  //!< Configuration
     TiXmlHandle config;  //!< Handle to xml_config
-    Terminal &term;  //!< Connection to terminal frame, used to get status of real keys
+    InputSource &input;  //!< Provides the status of the keys
     CRTC *crtc;  //!< Connection to CRTC, for light pen signal
     LatchROM *latch_rom;  //!< Connection to LatchROM, used to disable normal keyboard scanning
 
-    static const int keymap[];  //!< Mapping between real and emulated keys
-
-    static const byte cNumKeys = 64;
     static const byte cKeyBits = 6;
     static const byte cKeyOfs = 4;
 };
@@ -39,6 +39,7 @@ public:
 
     virtual void PortWrite(word addr, byte val);
     virtual byte PortRead(word addr);
+    virtual Microbee::time_t PortStableUntil(word addr) { UNREFERENCED_PARAMETER(addr); return cStable; }
 
     virtual void SaveState(BinaryWriter&);
     virtual void RestoreState(BinaryReader&);
@@ -24,7 +24,7 @@
 
 #include "Forms.h"
 
-#include "Microbee.h"
+#include "MicrobeeThread.h"
 #include "Terminal.h"
 #include "Disk.h"
 
@@ -40,6 +40,8 @@ BEGIN_EVENT_TABLE(MainWindow, wxFrame)
   EVT_MENU(ID_Pause, MainWindow::OnPause)
   EVT_MENU(ID_Resume, MainWindow::OnResume)
   EVT_MENU(ID_Reset, MainWindow::OnReset)
+  EVT_MENU(ID_Rewind, MainWindow::OnRewind)
+  EVT_MENU_RANGE(ID_Speed1, ID_SpeedUnlimited, MainWindow::OnSpeed)
 
   EVT_MENU(ID_CreateDisk, MainWindow::CreateDisk)
 
@@ -79,7 +81,16 @@ MainWindow::MainWindow() :
     menu->AppendSeparator();
     menu->Append(ID_Pause, _T("&Pause"), "Pauses the emulation");
     menu->Append(ID_Resume, _T("&Resume"), "Resumes the emulation");
+
+    wxMenu* speed_menu = new wxMenu();
+    speed_menu->AppendRadioItem(ID_Speed1, _T("&Normal"), "Runs at the speed of a real Microbee");
+    speed_menu->AppendRadioItem(ID_Speed2, _T("&2x"), "Runs at twice normal speed");
+    speed_menu->AppendRadioItem(ID_Speed4, _T("&4x"), "Runs at four times normal speed");
+    speed_menu->AppendRadioItem(ID_Speed8, _T("&8x"), "Runs at eight times normal speed");
+    speed_menu->AppendRadioItem(ID_SpeedUnlimited, _T("&Unlimited"), "Runs as fast as possible");
+    menu->AppendSubMenu(speed_menu, _T("S&peed"));
     menu->AppendSeparator();
+    menu->Append(ID_Rewind, _T("Re&wind"), "Rewinds the emulation 5 seconds");
     menu->Append(ID_Reset, _T("Reset"), "Resets the emulation");
     menubar->Append(menu, _T("&Microbee"));
 
@@ -120,9 +131,28 @@ MainWindow::MainWindow() :
         wxString xmlFile("Microbee.xml");
 #endif
         
-        mbee = new Microbee(*term, xmlFile.c_str());
+        mbee = new MicrobeeThread(*term, xmlFile.c_str());
         mbee->Create();
         mbee->Run();
+
+        switch (mbee->GetSpeed())  // Reflect the configured speed, if it's one on the menu
+        {
+        case 1:
+            menubar->Check(ID_Speed1, true);
+            break;
+        case 2:
+            menubar->Check(ID_Speed2, true);
+            break;
+        case 4:
+            menubar->Check(ID_Speed4, true);
+            break;
+        case 8:
+            menubar->Check(ID_Speed8, true);
+            break;
+        case MicrobeeThread::cUnlimitedSpeed:
+            menubar->Check(ID_SpeedUnlimited, true);
+            break;
+        }
     }
     catch (ConfigError &cfg_error)
     {
@@ -230,6 +260,36 @@ void MainWindow::OnReset(wxCommandEvent& WXUNUSED(evt))
 }
 
 
+void MainWindow::OnRewind(wxCommandEvent& WXUNUSED(evt))
+{
+    if (!mbee->Rewind(cRewindMillis))
+        wxMessageBox("Nothing to rewind to.  Add a <rewind> element to the configuration to keep checkpoints.", app_name, wxOK | wxICON_INFORMATION);
+}
+
+
+void MainWindow::OnSpeed(wxCommandEvent& evt)
+{
+    switch (evt.GetId())
+    {
+    case ID_Speed1:
+        mbee->SetSpeed(1);
+        break;
+    case ID_Speed2:
+        mbee->SetSpeed(2);
+        break;
+    case ID_Speed4:
+        mbee->SetSpeed(4);
+        break;
+    case ID_Speed8:
+        mbee->SetSpeed(8);
+        break;
+    case ID_SpeedUnlimited:
+        mbee->SetSpeed(MicrobeeThread::cUnlimitedSpeed);
+        break;
+    }
+}
+
+
 void MainWindow::CreateDisk(wxCommandEvent& WXUNUSED(evt))
 {
     wxFileDialog file_dlg(this, "New Disk", wxGetCwd(), "", "DSK Files (*.dsk)|*.dsk", wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
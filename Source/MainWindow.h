@@ -20,7 +20,7 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
-class Microbee;
+class MicrobeeThread;
 class Terminal;
 
 
@@ -55,16 +55,21 @@ public:
     void OnResume(wxCommandEvent& evt);
     //! Resets the emulator
     void OnReset(wxCommandEvent& evt);
+    //! Rewinds the emulation a few seconds
+    void OnRewind(wxCommandEvent& evt);
+    //! Changes the emulation speed
+    void OnSpeed(wxCommandEvent& evt);
 
     //! Creates a blank floppy image
     void CreateDisk(wxCommandEvent& evt);
 
 
 private:
-    Microbee *mbee;  //!< The emulated machine
+    MicrobeeThread *mbee;  //!< The emulated machine
     Terminal *term;  //!< The terminal
 
     static const wxString app_name;
+    static const int cRewindMillis = 5000;  //!< How far Rewind goes back
 
     DECLARE_EVENT_TABLE()
 };
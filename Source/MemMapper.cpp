@@ -97,6 +97,12 @@ void MemMapper::LateInit()
         throw ConfigError(&xml_config, "MemMapper missing ROM3 connection");
     if (crtcmem == NULL)
         throw ConfigError(&xml_config, "MemMapper missing CRTCMemory connection");
+
+    for (unsigned int i = 0; i < cNumMaps; i++)
+    {
+        MapMemory(i);
+        z80->SaveMemoryMap(maps[i]);
+    }
 }
 
 
@@ -111,7 +117,12 @@ void MemMapper::PortWrite(word addr, byte val)
     UNREFERENCED_PARAMETER(addr);
 
     this->lastValue = val;
-    
+    z80->SelectMemoryMap(maps[val & (cNumMaps - 1)]);
+}
+
+
+void MemMapper::MapMemory(byte val)
+{
     // Lower 32k
     switch (val & cBank)
     {
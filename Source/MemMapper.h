@@ -21,9 +21,9 @@
 #define MEMMAPPER_H
 
 #include "PortDevice.h"
+#include "Z80/Z80CPU.h"
 
 class Microbee;
-class Z80CPU;
 class RAM;
 class ROM;
 class CRTCMemory;
@@ -39,6 +39,9 @@ class CRTCMemory;
  *  the graphics memory can be enabled, and appears in the upper block at either
  *  0x8000 or 0xF000.  If the graphics memory is enabled then it is accessed
  *  in preference to whatever else may be mapped in the same space.
+ *
+ *  The memory map for every value of the mapper port is worked out by LateInit(), so a
+ *  port write only has to select the corresponding Z80CPU::MemoryMap.
  */
 class MemMapper : public PortDevice
 {
@@ -55,6 +58,7 @@ public:
 
     virtual void PortWrite(word addr, byte val);
     virtual byte PortRead(word addr);
+    virtual Microbee::time_t PortStableUntil(word addr) { UNREFERENCED_PARAMETER(addr); return cStable; }
 
 
 private:
@@ -74,6 +78,12 @@ private:
 
     byte lastValue;  //!< Holds the last value written to the mem mapper so that we can save/restore state.
 
+    static const unsigned int cNumMaps = 0x40;  //!< Number of distinct port values (the bits below are all that matter)
+    Z80CPU::MemoryMap maps[cNumMaps];  //!< Memory map for each port value
+
+    //! Registers the memory devices for port value \p val with the Z80
+    void MapMemory(byte val);
+
     static const byte cBank = 0x07;
     static const byte cROMDisable = 0x04;
     static const byte cVideoRAMDisable = 0x08;
@@ -49,6 +49,23 @@ public:
      */
     virtual byte Read(word addr) = 0;
 
+    /*! \brief Returns the host storage backing the page starting at \p addr, for direct reads
+     *
+     *  Devices whose reads are plain array lookups can return a pointer to the first byte
+     *  of the page so that the CPU can bypass Read() entirely.  The default returns NULL,
+     *  meaning every read must go through Read().
+     *
+     *  \note \p addr is relative to the start of the device in the address space.
+     */
+    virtual byte *GetReadPage(word addr) { UNREFERENCED_PARAMETER(addr); return NULL; }
+    /*! \brief Returns the host storage backing the page starting at \p addr, for direct writes
+     *
+     *  \sa GetReadPage()
+     */
+    virtual byte *GetWritePage(word addr) { UNREFERENCED_PARAMETER(addr); return NULL; }
+    //! Returns true if writes to the device have no effect, so the CPU may discard them without calling Write()
+    virtual bool IgnoresWrites() { return false; }
+
 
 protected:
     unsigned int size;  //!< Number of bytes that the devices occupies in the address space
@@ -24,47 +24,213 @@
 #include <sstream>
 #include <limits>
 
-#ifdef __WXOSX__
-#include <OpenGL/glu.h>
-#else
-#include <GL/glu.h>
-#endif
-
 #include "base64/base64.h"
 #include "utils/BinaryWriter.h"
 #include "utils/BinaryReader.h"
 
-#include "Terminal.h"
 #include "Device.h"
 #include "DeviceFactory.h"
+#include "ForkPoint.h"
+#include "RAM.h"
+#include "RewindBuffer.h"
+#include "Snapshot.h"
+#include "WarmStart.h"
 #include "Z80/Z80CPU.h"
 
 #include "Drives.h" // TODO: Remove (remove LoadDisk() func from this class)
 
 
-Microbee::Microbee(Terminal &scr_, const char *config_file) :
-    paused(false),
-    pause_cond(pause_mutex),
-    scr(scr_),
+Microbee::Microbee(VideoSink &video_, InputSource &input_, const char *config_file) :
+    video(video_),
+    input(input_),
+    z80(NULL),
     current_dev(NULL),
+    slice_length(cDefaultSliceMillis * 1000 * cTicksPerMicro),
     emu_time(0),
-    configFileName(config_file),
+    warm_start(NULL),
+    rewind(NULL),
     configuration(config_file)
 {
-    pause_mutex.Lock();
-    
-    configFileName.MakeAbsolute();
+    // Files named in the configuration are relative to it
+    const std::string config_path(config_file);
+    const std::string::size_type sep = config_path.find_last_of("/\\");
+    if (sep != std::string::npos)
+        config_dir = config_path.substr(0, sep + 1);
 
     if (!configuration.LoadFile())
         throw ConfigError(NULL, std::string("Unable to load configuration file ") + config_file);
 
+    CreateDevices();
+    InitDevices();
+
+    Reset();
+    
+    // Restore any state that's present in the config
+    const TiXmlElement *mbee_tag = configuration.FirstChildElement("microbee");
+    try
+    {
+        RestoreState(*mbee_tag);
+    }
+    catch (std::exception &)
+    {
+        // Whatever could be restored is kept
+    }
+
+    z80->FlushCodeCache();  // Memory contents were replaced behind the CPU's back
+
+    // Skip booting if it has been done before
+    const TiXmlElement *warm_start_el = mbee_tag->FirstChildElement("warmstart");
+    if (warm_start_el != NULL)
+    {
+        warm_start = new WarmStart(*this, *warm_start_el);
+        if (warm_start->Restore())
+        {
+            delete warm_start;
+            warm_start = NULL;
+        }
+    }
+
+    const TiXmlElement *rewind_el = mbee_tag->FirstChildElement("rewind");
+    if (rewind_el != NULL)
+        rewind = new RewindBuffer(*this, *rewind_el);
+}
+
+
+void Microbee::LoadState(const char *filename)
+{
+    const bool snapshot = Snapshot::IsSnapshot(filename);
+
+    TiXmlDocument stateXml(filename);
+    if (!snapshot && (!stateXml.LoadFile() || stateXml.FirstChildElement("microbee") == NULL))
+        throw std::runtime_error("Failed to load state");
+
+    Reset();
+
+    try
+    {
+        if (snapshot)
+            Snapshot::Restore(*this, filename);
+        else
+            RestoreState(*stateXml.FirstChildElement("microbee"));
+    }
+    catch (...)
+    {
+        z80->FlushCodeCache();
+        throw;
+    }
+
+    z80->FlushCodeCache();
+}
+
+
+/*! Devices without a <State> element are left as they are, as is the schedule if there's no
+    <Schedule> element (i.e. for saves made before there was one).
+ */
+void Microbee::RestoreState(const TiXmlElement &mbee_tag)
+{
+    for (const TiXmlElement *el = mbee_tag.FirstChildElement("device"); el != NULL; el = el->NextSiblingElement("device"))
+    {
+        const TiXmlElement *state_el = el->FirstChildElement("State");
+        if (state_el == NULL)
+        {
+            continue;
+        }
+        
+        const char* encoded_state = state_el->GetText();
+        if (encoded_state == NULL)
+        {
+            continue;
+        }
+        
+        std::string state = ::base64_decode(encoded_state);
+        std::istringstream stream(state, std::istringstream::in | std::istringstream::binary);
+        BinaryReader reader(stream);
+        
+        const char *id = el->Attribute("id");
+        Device* device = this->GetDevice<Device>(id);
+        
+        device->RestoreState(reader);
+    }
+
+    const TiXmlElement *schedule_el = mbee_tag.FirstChildElement("Schedule");
+    if (schedule_el != NULL && schedule_el->GetText() != NULL)
+    {
+        std::string schedule = ::base64_decode(schedule_el->GetText());
+        std::istringstream stream(schedule, std::istringstream::in | std::istringstream::binary);
+        BinaryReader reader(stream);
+        RestoreSchedule(reader);
+    }
+}
+
+
+/*! The devices are created from the fork point's copy of the configuration, then put into the
+    state saved by the fork point instead of being reset.  RAM starts out sharing the fork point's
+    image (see RAM::UseImage()), so a clone costs little more than the pages it writes to.
+ */
+Microbee::Microbee(VideoSink &video_, InputSource &input_, const ForkPoint &fork) :
+    video(video_),
+    input(input_),
+    z80(NULL),
+    current_dev(NULL),
+    slice_length(cDefaultSliceMillis * 1000 * cTicksPerMicro),
+    emu_time(0),
+    warm_start(NULL),
+    rewind(NULL),
+    config_dir(fork.config_dir),
+    configuration(fork.configuration)
+{
+    CreateDevices();
+
+    // Memory must be in place before the devices connect to each other
+    std::map<std::string, size_t>::const_iterator ram;
+    for (ram = fork.ram_images.begin(); ram != fork.ram_images.end(); ram++)
+        GetDevice<RAM>(ram->first)->UseImage(*fork.image, ram->second);
+
+    InitDevices();
+
+    std::map<std::string, Device*>::iterator it;
+    for (it = devices.begin(); it != devices.end(); it++)
+    {
+        if (fork.ram_images.find(it->first) == fork.ram_images.end())
+            it->second->Reset();
+    }
+
+    std::map<std::string, std::string>::const_iterator state;
+    for (state = fork.states.begin(); state != fork.states.end(); state++)
+    {
+        std::istringstream stream(state->second, std::istringstream::in | std::istringstream::binary);
+        BinaryReader reader(stream);
+        GetDevice<Device>(state->first)->RestoreState(reader);
+    }
+
+    std::istringstream stream(fork.schedule, std::istringstream::in | std::istringstream::binary);
+    BinaryReader reader(stream);
+    RestoreSchedule(reader);
+
+    z80->FlushCodeCache();
+}
+
+
+/*! Creates the devices listed in the configuration and registers their ports with the CPU. */
+void Microbee::CreateDevices()
+{
     TiXmlElement *mbee_tag = configuration.FirstChildElement("microbee");
     if (mbee_tag == NULL)
         throw ConfigError(&configuration, "Config is missing <microbee> element");
 
 
+    // Length of the slices (see RunSlice())
+    int slice_millis;
+    if (mbee_tag->Attribute("slice", &slice_millis) != NULL)
+    {
+        if (slice_millis <= 0 || slice_millis > cMaxSliceMillis)
+            throw ConfigError(mbee_tag, "<microbee> slice attribute must be between 1 and 200 (milliseconds)");
+        slice_length = slice_millis * 1000 * cTicksPerMicro;
+    }
+
+
+
     DeviceFactory dev_factory;
-    Z80CPU *z80 = NULL;
 
     // Create devices
     for (const TiXmlElement *el = mbee_tag->FirstChildElement("device"); el != NULL; el = el->NextSiblingElement("device"))
@@ -125,8 +291,14 @@ Microbee::Microbee(Terminal &scr_, const char *config_file) :
             }
         }
     }
+}
 
 
+/*! Calls LateInit() on every device, so that they connect to each other. */
+void Microbee::InitDevices()
+{
+    TiXmlElement *mbee_tag = configuration.FirstChildElement("microbee");
+
     // Final initialisation
     std::map<std::string, Device*>::iterator it = devices.begin();
     for (; it != devices.end(); it++)
@@ -144,144 +316,87 @@ Microbee::Microbee(Terminal &scr_, const char *config_file) :
             throw ConfigError(mbee_tag, std::string("<connect> specifies device of incorrect class ") + d.what());  // TODO: Improve detail of error message
         }
     }
-
-
-    Reset();
-    
-    // Restore any state that's present in the config
-    try
-    {
-        for (const TiXmlElement *el = mbee_tag->FirstChildElement("device"); el != NULL; el = el->NextSiblingElement("device"))
-        {
-            const TiXmlElement *state_el = el->FirstChildElement("State");
-            if (state_el == NULL)
-            {
-                continue;
-            }
-            
-            const char* encoded_state = state_el->GetText();
-            if (encoded_state == NULL)
-            {
-                continue;
-            }
-            
-            std::string state = ::base64_decode(encoded_state);
-            std::istringstream stream(state, std::istringstream::in | std::istringstream::binary);
-            BinaryReader reader(stream);
-            
-            const char *id = el->Attribute("id");
-            Device* device = this->GetDevice<Device>(id);
-            
-            device->RestoreState(reader);
-        }
-    }
-    catch (std::exception& e)
-    {
-        return;
-    }
 }
 
 
 Microbee::~Microbee()
 {
+    delete warm_start;
+    delete rewind;
+
     std::map<std::string, Device*>::iterator it = devices.begin();
     for (; it != devices.end(); it++)
         delete it->second;
 }
 
 
-Microbee::ExitCode Microbee::Entry()
+/*! The slice runs up to the earliest deadline (but no more than slice_length).  The
+ *  continuous devices are run first, followed by the devices whose deadline has been reached.
+ *  Devices move between the two according to what their Execute() returns.
+ */
+Microbee::time_t Microbee::RunSlice()
 {
+    time_t end = emu_time + slice_length;
+    if (!events.empty() && events.top().time < end)
+        end = events.top().time;
+
+    std::vector<Device*> still_continuous;
     std::vector<Device*>::iterator it;
-    wxStopWatch sw;
-    time_t elapsed;
-    time_t micros_to_run = cMaxMicrosToRun;
-    time_t next_micros, tmp;
+    time_t next;
 
-    while (!TestDestroy())
+    for (it = continuous.begin(); it != continuous.end(); it++)
     {
-        if (paused)
-        {
-            {
-                wxMutexLocker lock(pause_mutex);
-                pause_cond.Signal();
-            }
+        current_dev = *it;
+        next = current_dev->Execute(emu_time, end - emu_time);
 
-            // Copy the front buffer into the back buffer so we can just flip continuously to repaint
-            glReadBuffer(GL_FRONT);
-            glRasterPos2i(0, 0);
-            glCopyPixels(0, 0, Terminal::width, Terminal::height, GL_COLOR);
-            glFlush();
-
-            while (paused)
-            {
-                Sleep(100);
-                scr.SwapBuffers();
-                if (TestDestroy())
-                    return 0;
-            }
+        if (next > 0)
+        {
+            Event e = { end + next, end, current_dev };
+            events.push(e);
         }
+        else
+            still_continuous.push_back(current_dev);
+    }
 
+    while (!events.empty() && events.top().time <= end)
+    {
+        Event e = events.top();
+        events.pop();
 
-        sw.Start();
-
-        next_micros = cMaxMicrosToRun;
+        current_dev = e.dev;
+        next = current_dev->Execute(e.since, end - e.since);
 
-        for (it = run_list.begin(); it != run_list.end(); it++)
+        if (next > 0)
         {
-            current_dev = *it;
-            tmp = current_dev->Execute(emu_time, micros_to_run);
-            if (tmp != 0 && tmp < next_micros)
-                next_micros = tmp;
+            e.time = end + next;
+            e.since = end;
+            events.push(e);
         }
-
-        emu_time += micros_to_run;
-
-        elapsed = sw.Time() * 1000;
-        if (elapsed < micros_to_run)
-            Sleep((micros_to_run - elapsed) / 1000);  // TODO: Using a running average to smooth out the speed?
-
-        micros_to_run = next_micros;
+        else
+            still_continuous.push_back(current_dev);
     }
 
-    return 0;
-}
+    continuous.swap(still_continuous);
 
+    const time_t ticks = end - emu_time;
+    emu_time = end;
 
-
-/*! \note While paused, the thread will still refresh the the display using OpenGL calls */
-// MUST BE THREAD SAFE
-void Microbee::DoReset()
-{
-    PauseEmulation();
-    Reset();
-    ResumeEmulation();
-}
-
-
-// MUST BE THREAD SAFE
-void Microbee::PauseEmulation()
-{
-    if (!paused)
+    if (warm_start != NULL && warm_start->Check())
     {
-        paused = true;
-        pause_cond.Wait();
+        delete warm_start;
+        warm_start = NULL;
     }
-}
 
+    if (rewind != NULL)
+        rewind->Update();
 
-// MUST BE THREAD SAFE
-void Microbee::ResumeEmulation()
-{
-    paused = false;
+    return ticks;
 }
 
 
-// MUST BE THREAD SAFE
+
 void Microbee::SaveState(const char *filename)
 {
-    this->PauseEmulation(); // Emulation will stay paused if an exception occurs.
-
     TiXmlDocument stateXml(this->configuration);
     
     TiXmlElement *mbee_tag = stateXml.FirstChildElement("microbee");
@@ -307,22 +422,111 @@ void Microbee::SaveState(const char *filename)
         stateElement.InsertEndChild(TiXmlText(encoded));
         el->InsertEndChild(stateElement);
     }
+
+    std::ostringstream stream(std::ostringstream::out | std::ostringstream::binary);
+    BinaryWriter writer(stream);
+    SaveSchedule(writer);
+    std::string schedule = stream.str();
+
+    while (TiXmlElement *old_schedule = mbee_tag->FirstChildElement("Schedule"))
+    {
+        mbee_tag->RemoveChild(old_schedule);
+    }
+
+    TiXmlElement scheduleElement("Schedule");
+    scheduleElement.InsertEndChild(TiXmlText(::base64_encode((unsigned char *)schedule.data(), schedule.length())));
+    mbee_tag->InsertEndChild(scheduleElement);
     
     if (!stateXml.SaveFile(filename))
     {
         throw std::runtime_error("Failed to save state");
     }
-    
-    this->ResumeEmulation(); 
 }
 
-// MUST BE THREAD SAFE
+void Microbee::SaveSnapshot(const char *filename, bool compress)
+{
+    Snapshot::Save(*this, filename, compress);
+}
+
+
+/*! Devices are identified by their position in the devices map, which is the same for any
+    Microbee built from the same configuration.
+ */
+void Microbee::SaveSchedule(BinaryWriter &writer) const
+{
+    std::map<const Device*, unsigned int> index;
+    unsigned int i = 0;
+    std::map<std::string, Device*>::const_iterator it;
+    for (it = devices.begin(); it != devices.end(); it++)
+        index[it->second] = i++;
+
+    writer.WriteQWord(emu_time);
+
+    writer.WriteDWord((unsigned int)continuous.size());
+    for (std::vector<Device*>::const_iterator dev = continuous.begin(); dev != continuous.end(); dev++)
+        writer.WriteDWord(index[*dev]);
+
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event> > pending(events);
+    writer.WriteDWord((unsigned int)pending.size());
+    for (; !pending.empty(); pending.pop())
+    {
+        writer.WriteQWord(pending.top().time);
+        writer.WriteQWord(pending.top().since);
+        writer.WriteDWord(index[pending.top().dev]);
+    }
+}
+
+
+/*! \throws OutOfRange if a device index isn't valid for this Microbee
+ */
+void Microbee::RestoreSchedule(BinaryReader &reader)
+{
+    std::vector<Device*> index;
+    std::map<std::string, Device*>::const_iterator it;
+    for (it = devices.begin(); it != devices.end(); it++)
+        index.push_back(it->second);
+
+    emu_time = reader.ReadQWord();
+    current_dev = NULL;
+
+    continuous.clear();
+    for (unsigned int n = reader.ReadDWord(); n > 0; n--)
+    {
+        const unsigned int i = reader.ReadDWord();
+        if (i >= index.size())
+            throw OutOfRange();
+        continuous.push_back(index[i]);
+    }
+
+    events = std::priority_queue<Event, std::vector<Event>, std::greater<Event> >();
+    for (unsigned int n = reader.ReadDWord(); n > 0; n--)
+    {
+        Event e;
+        e.time = reader.ReadQWord();
+        e.since = reader.ReadQWord();
+        const unsigned int i = reader.ReadDWord();
+        if (i >= index.size())
+            throw OutOfRange();
+        e.dev = index[i];
+        events.push(e);
+    }
+}
+
+
+bool Microbee::Rewind(Microbee::time_t ticks)
+{
+    if (rewind == NULL || !rewind->Rewind(ticks))
+        return false;
+
+    z80->FlushCodeCache();
+    return true;
+}
+
+
 // TODO: Generalise as a Device member function which registers its own menu / panel
 void Microbee::LoadDisk(unsigned int drive, const char *name)
 {
-    PauseEmulation();
     GetDevice<Drives>("drives")->LoadDisk(drive, name);
-    ResumeEmulation();
 }
 
 
@@ -333,8 +537,17 @@ void Microbee::Reset()
     emu_time = 0;
     current_dev = NULL;
 
+    // Everything runs in the first slice, after which the devices say when they next need to
+    events = std::priority_queue<Event, std::vector<Event>, std::greater<Event> >();
+    continuous = run_list;
+
     for (it = devices.begin(); it != devices.end(); it++)
         it->second->Reset();
+
+    if (rewind != NULL)
+        rewind->Clear();  // Checkpoints from before the reset are on a different timeline
+
+    z80->FlushCodeCache();  // RAM may have been reset after the CPU
 }
 
 
@@ -22,55 +22,116 @@
 
 #include <map>
 #include <vector>
-#include <wx/filename.h>
+#include <queue>
+#include <functional>
+#include <string>
 #include "tinyxml/tinyxml.h"
 
 class Device;
-class Terminal;
+class VideoSink;
+class InputSource;
+class Z80CPU;
+class ForkPoint;
+class WarmStart;
+class RewindBuffer;
+class BinaryWriter;
+class BinaryReader;
 
 
 /*! \brief Represents the emulated system
  *
- *  This class manages a thread which is responsible for emulating the system.  Based on the
- *  configuration specified, each Device require is instantiated, connections between them are
- *  established, and the list of devices requiring execution is created (most devices simply respond
- *  to port read/write requests, notable exceptions are the CRTC which must render the screen
- *  periodically, and the Z80 which must execute instructions).  The main loop of the thread simply
- *  calls the devices in the run list.
+ *  Based on the configuration specified, each Device required is instantiated, connections
+ *  between them are established, and the list of devices requiring execution is created (most
+ *  devices simply respond to port read/write requests, notable exceptions are the CRTC which must
+ *  render the screen periodically, and the Z80 which must execute instructions).  RunSlice()
+ *  schedules the devices in the run list: those which run continuously (the Z80) are run up to the
+ *  next device's deadline, then that device is run.
+ *
+ *  This class has no dependencies on the host beyond the VideoSink and InputSource it is given,
+ *  and doesn't pace itself against real time.  MicrobeeThread runs it in real time for the GUI,
+ *  while the headless runner runs any number of instances as fast as possible on a
+ *  MicrobeePool.  A ForkPoint taken of a running system can be cloned any number of times, so a
+ *  machine only needs to be booted once.
  */
-class Microbee : public wxThread
+class Microbee
 {
 public:
     /*! \brief Time type
      *
-     *  All times are expressed in microseconds.  Using long long should allow the 
-     *  emulation to run for around 300,000 years before it overflows.
+     *  All times are expressed in ticks of the master clock (see cTicksPerSecond), so that
+     *  each device advances a whole number of ticks per cycle of its own clock and no device
+     *  needs to divide to find the current time.  Using long long should allow the emulation
+     *  to run for around 2,700 years before it overflows.
      */
     typedef long long time_t;
 
-    /*! \brief Construct the system based on XML file \p config_file, using \p scr_ for VDU 
-     *         and keyboard support functions.
+    /*! \brief Master clock rate, in ticks per second
+     *
+     *  A common multiple of the 3.375 MHz CPU and 1.6875 MHz character clocks of the Microbee
+     *  (and of the 2 MHz CPU of the earlier models).  Times are converted to and from real
+     *  time only at the edges, when pacing the emulation against the host clock.
+     */
+    static const time_t cTicksPerSecond = 108000000;
+    static const time_t cTicksPerMicro = cTicksPerSecond / 1000000;  //!< Ticks per microsecond
+
+    /*! \brief Construct the system based on XML file \p config_file, using \p video_ for display
+     *         output and \p input_ for the keyboard.
      *
      *  \throws ConfigError if a problem was found with the configuration
      */
-    Microbee(Terminal &scr_, const char *config_file);
-    ~Microbee();
+    Microbee(VideoSink &video_, InputSource &input_, const char *config_file);
 
-    //! Main thread function, repeatedly executes the devices on the run list
-    virtual ExitCode Entry();
+    /*! \brief Construct a clone of the system saved in \p fork, using \p video_ for display
+     *         output and \p input_ for the keyboard.
+     *
+     *  The clone carries on from exactly where the system was when \p fork was made, independently
+     *  of the system and of any other clones.
+     *
+     *  \throws ConfigError if a problem was found with the configuration
+     */
+    Microbee(VideoSink &video_, InputSource &input_, const ForkPoint &fork);
 
+    ~Microbee();
 
-    //! Resets the emulated system (only returns once the reset has completed).  Thread safe.
-    void DoReset();
 
-    //! Pauses the emulation (only returns once the emulation is paused).  Thread safe.
-    void PauseEmulation();
+    //! Resets the emulated system
+    void Reset();
 
-    //! Resumes the emulation (returns immediately).  Thread safe.
-    void ResumeEmulation();
+    //! Runs the devices for the next slice of emulated time, returns the length of the slice
+    Microbee::time_t RunSlice();
 
-    //! Seralizes the current emulation state into the specfied file.  Thread safe.
+    //! Seralizes the current emulation state into the specfied file
     void SaveState(const char *filename);
+
+    /*! \brief Saves the current emulation state into the specified file as a binary snapshot
+     *
+     *  Much smaller and quicker to save and load than SaveState(), but without the configuration
+     *  (see Snapshot.h).  The sections of the file are compressed if \p compress is set.
+     */
+    void SaveSnapshot(const char *filename, bool compress = false);
+
+    /*! \brief Restores the emulation state saved by SaveState() or SaveSnapshot() in the specified file
+     *
+     *  The file must have been saved by a Microbee with the same configuration.
+     *
+     *  \throws std::runtime_error if the file can't be loaded or a device's state can't be restored
+     */
+    void LoadState(const char *filename);
+
+    /*! \brief Saves when each device is next due to run (the devices save their own state)
+     *
+     *  Must not be called while RunSlice() is running.
+     */
+    void SaveSchedule(BinaryWriter &writer) const;
+    //! Restores a schedule saved by SaveSchedule() on a Microbee with the same configuration
+    void RestoreSchedule(BinaryReader &reader);
+
+    /*! \brief Rewinds the system by at least \p ticks, as far back as the rewind buffer goes
+     *
+     *  Returns false if the configuration has no <rewind> element (see RewindBuffer) or nothing
+     *  has been kept yet.  Must not be called while RunSlice() is running.
+     */
+    bool Rewind(Microbee::time_t ticks);
     
     //! Loads a disk in the specified drive.  TODO: Remove this and generalise Device specific functions
     void LoadDisk(unsigned int drive, const char *name);
@@ -95,27 +156,26 @@ public:
         return t;
     }
 
-    //! Returns a reference to the Terminal associated with this Microbee
-    Terminal &GetTerminal() { return scr; }
+    //! Returns the VideoSink that the display is output to
+    VideoSink &GetVideoSink() { return video; }
 
+    //! Returns the InputSource that provides the keyboard
+    InputSource &GetInputSource() { return input; }
 
-    //! Returns the current emulation time in microseconds
+    //! Returns the <microbee> element of the configuration, for settings that apply to the host
+    const TiXmlElement &GetConfig() const { return *configuration.FirstChildElement("microbee"); }
+
+
+    //! Returns the current emulation time in ticks
     Microbee::time_t GetTime() const;
     
-    //! Returns the absolute filename of the current configuration file
-    const wxFileName& GetConfigFileName() const { return configFileName; }
+    //! Returns the directory of the configuration file (with a trailing separator), which files it names are relative to
+    const std::string &GetConfigDir() const { return config_dir; }
 
 
 private:
-    //! Resets the emulated system
-    void Reset();
-
-    volatile bool paused;  //!< True if the emulation is currently paused.  Microbee thread does not write to this.  Only written by PauseEmulation() and ResumeEmulation().
-    wxMutex pause_mutex;  //!< Mutex associated with pause_cond, must be constructed first
-    wxCondition pause_cond;  //!< Used by the Microbee thread to signal to the main thread that emulation has paused
-
-
-    Terminal &scr;  //!< For VDU and keyboard support functions
+    VideoSink &video;  //!< For display output
+    InputSource &input;  //!< For keyboard input
 
     /*! \brief Container for emulated devices
      *
@@ -123,17 +183,45 @@ private:
      */
     std::map<std::string, Device*> devices;
 
+    Z80CPU *z80;  //!< The system CPU
+
     std::vector<Device*> run_list;  //!< List of devices to that require Device::Execute() to be called
     Device *current_dev;  //!< Currently executing device
 
-    static const Microbee::time_t cMaxMicrosToRun = 200000;  //!< Maximum number of microseconds to run in an iteration of the main loop
+    //! A device from the run list which is waiting until its deadline to be run again
+    struct Event
+    {
+        Microbee::time_t time;  //!< Deadline, at which the device is run
+        Microbee::time_t since;  //!< Time the device has been run up to
+        Device *dev;
+
+        bool operator> (const Event &e) const { return time > e.time; }
+    };
+
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event> > events;  //!< Devices waiting for their deadline, earliest first
+    std::vector<Device*> continuous;  //!< Devices from the run list which are run in every slice (see Device::Execute())
+
+    static const int cDefaultSliceMillis = 20;  //!< Default for slice_length, one PAL frame
+    static const int cMaxSliceMillis = 200;  //!< Longest slice that may be configured
+
+    Microbee::time_t slice_length;  //!< Maximum number of ticks to run in a slice
 
     Microbee::time_t emu_time;  //!< Current emulation time (= 0 at reset)
 
-    wxFileName configFileName;  //!< The absolute filename of the configuration file
+    WarmStart *warm_start;  //!< Saves the state once booted, NULL if not configured or done
+    RewindBuffer *rewind;  //!< Checkpoints of the recent past, NULL if not configured
+
+    std::string config_dir;  //!< Directory of the configuration file
     
     TiXmlDocument configuration;  //!< The XML configuration of the system
 
+    //! Creates the devices from the configuration, see the constructors
+    void CreateDevices();
+    //! Connects the devices to each other, see the constructors
+    void InitDevices();
+    //! Restores the <State> and <Schedule> elements saved in \p mbee_tag by SaveState()
+    void RestoreState(const TiXmlElement &mbee_tag);
+
     // Private copy constuctor and assigment operator to prevent copies
     Microbee(const Microbee &);
     Microbee& operator= (const Microbee &);
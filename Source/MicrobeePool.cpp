@@ -0,0 +1,175 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "stdafx.h"
+#include "MicrobeePool.h"
+
+#include <stdexcept>
+
+
+MicrobeePool::MicrobeePool(unsigned int threads) :
+    num_threads(threads != 0 ? threads : Thread::HardwareThreads()),
+    remaining(0)
+{
+    for (unsigned int i = 0; i < num_threads; i++)
+        queues.push_back(new Queue);
+}
+
+
+MicrobeePool::~MicrobeePool()
+{
+    for (unsigned int i = 0; i < num_threads; i++)
+        delete queues[i];
+}
+
+
+void MicrobeePool::Add(Microbee &mbee, Microbee::time_t until)
+{
+    Job job;
+    job.mbee = &mbee;
+    job.until = until;
+    jobs.push_back(job);
+}
+
+
+/*! The jobs are dealt out to the threads' queues in turn, and the calling thread works as one
+ *  of the threads.
+ */
+void MicrobeePool::Run()
+{
+    for (unsigned int i = 0; i < jobs.size(); i++)
+    {
+        jobs[i].error.clear();
+        queues[i % num_threads]->jobs.push_back(&jobs[i]);
+    }
+    remaining = jobs.size();
+
+    std::vector<Worker*> workers;
+    for (unsigned int i = 1; i < num_threads && i < jobs.size(); i++)
+    {
+        Worker *w = new Worker(*this, i);
+        if (!w->Start())
+        {
+            delete w;
+            break;  // The threads already running (and this one) will take the work
+        }
+        workers.push_back(w);
+    }
+
+    Work(0);
+
+    for (std::vector<Worker*>::iterator it = workers.begin(); it != workers.end(); it++)
+    {
+        (*it)->Join();
+        delete *it;
+    }
+}
+
+
+const char *MicrobeePool::GetError(const Microbee &mbee) const
+{
+    for (std::vector<Job>::const_iterator it = jobs.begin(); it != jobs.end(); it++)
+    {
+        if (it->mbee == &mbee)
+            return it->error.empty() ? NULL : it->error.c_str();
+    }
+
+    return NULL;
+}
+
+
+void MicrobeePool::Work(unsigned int index)
+{
+    for (;;)
+    {
+        Job *job = Take(index);
+
+        if (job == NULL)
+        {
+            {
+                MutexLocker lock(remaining_mutex);
+                if (remaining == 0)
+                    return;
+            }
+
+            Thread::YieldCPU();  // The last jobs are running on other threads
+            continue;
+        }
+
+        bool done;
+        try
+        {
+            job->mbee->RunSlice();
+            done = job->mbee->GetTime() >= job->until;
+        }
+        catch (std::exception &e)
+        {
+            job->error = e.what();
+            if (job->error.empty())
+                job->error = "Unknown error";
+            done = true;
+        }
+
+        if (done)
+        {
+            MutexLocker lock(remaining_mutex);
+            remaining--;
+        }
+        else
+        {
+            MutexLocker lock(queues[index]->mutex);
+            queues[index]->jobs.push_back(job);
+        }
+    }
+}
+
+
+/*! The thread's own queue is used as a stack, and other threads' as queues: the thread carries
+ *  on with the instance it has just run, and steals the instance its owner ran longest ago.
+ */
+MicrobeePool::Job *MicrobeePool::Take(unsigned int index)
+{
+    {
+        MutexLocker lock(queues[index]->mutex);
+        std::deque<Job*> &own = queues[index]->jobs;
+
+        if (!own.empty())
+        {
+            Job *job = own.back();
+            own.pop_back();
+            return job;
+        }
+    }
+
+    for (unsigned int i = 1; i < num_threads; i++)
+    {
+        Queue &victim = *queues[(index + i) % num_threads];
+        MutexLocker lock(victim.mutex);
+
+        if (!victim.jobs.empty())
+        {
+            Job *job = victim.jobs.front();
+            victim.jobs.pop_front();
+            return job;
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,113 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MICROBEEPOOL_H
+#define MICROBEEPOOL_H
+
+#include <vector>
+#include <deque>
+#include <string>
+#include "Microbee.h"
+#include "utils/Thread.h"
+
+
+/*! \brief Runs many Microbee instances on a fixed pool of threads
+ *
+ *  The unit of work is one slice of one instance (Microbee::RunSlice()).  Each thread has its
+ *  own queue of instances, and keeps running the instance at the back of its queue until that
+ *  instance is done, so an instance normally stays in one core's cache.  A thread whose queue
+ *  runs dry steals from the front of another thread's queue, so the instances spread over the
+ *  threads however long each one takes.
+ *
+ *  The instances must not share anything but what the core shares safely (ROM images, and the
+ *  RAM of clones made from the same ForkPoint), and their VideoSink and InputSource are called
+ *  from the pool's threads.
+ */
+class MicrobeePool
+{
+public:
+    //! Creates a pool of \p threads threads (including the one calling Run()), or one per host CPU if 0
+    explicit MicrobeePool(unsigned int threads = 0);
+    ~MicrobeePool();
+
+    //! Adds \p mbee, to be run by Run() until its emulation time reaches \p until (in ticks)
+    void Add(Microbee &mbee, Microbee::time_t until);
+
+    /*! \brief Runs all the instances added until they're done
+     *
+     *  An instance which throws an exception is stopped, see GetError().
+     */
+    void Run();
+
+    //! Removes all the instances added
+    void Clear() { jobs.clear(); }
+
+    //! Returns the error that stopped \p mbee during the last Run(), or NULL if it ran to its time
+    const char *GetError(const Microbee &mbee) const;
+
+private:
+    //! An instance to be run
+    struct Job
+    {
+        Microbee *mbee;
+        Microbee::time_t until;  //!< Emulation time to run to
+        std::string error;  //!< What stopped the instance, if it threw an exception
+    };
+
+    //! A thread's queue of jobs
+    struct Queue
+    {
+        Mutex mutex;
+        std::deque<Job*> jobs;
+    };
+
+    //! A thread running Work()
+    class Worker : public Thread
+    {
+    public:
+        Worker(MicrobeePool &pool_, unsigned int index_) : pool(pool_), index(index_) {}
+
+    protected:
+        virtual void Run() { pool.Work(index); }
+
+    private:
+        MicrobeePool &pool;
+        unsigned int index;  //!< Worker's queue
+    };
+
+    unsigned int num_threads;
+    std::vector<Job> jobs;  //!< Instances added, in order
+    std::vector<Queue*> queues;  //!< One for each thread
+
+    Mutex remaining_mutex;
+    unsigned int remaining;  //!< Jobs not yet done
+
+    //! Runs jobs (from queue \p index first) until they're all done
+    void Work(unsigned int index);
+
+    //! Takes the next job for thread \p index, or returns NULL if there are none waiting
+    Job *Take(unsigned int index);
+
+    // Private copy constuctor and assigment operator to prevent copies
+    MicrobeePool(const MicrobeePool &);
+    MicrobeePool& operator= (const MicrobeePool &);
+};
+
+
+#endif // MICROBEEPOOL_H
@@ -0,0 +1,231 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "stdafx.h"
+#include "MicrobeeThread.h"
+
+#include "utils/Pacer.h"
+
+#include "Terminal.h"
+
+
+MicrobeeThread::MicrobeeThread(Terminal &term_, const char *config_file) :
+    paused(false),
+    pause_cond(pause_mutex),
+    term(term_),
+    renderer(term_),
+    mbee(*this, term_, config_file),
+    priority(-1),
+    host_cpu(-1),
+    speed(1),
+    last_publish(0),
+    missed_change(false)
+{
+    pause_mutex.Lock();
+
+    const TiXmlElement &config = mbee.GetConfig();
+
+    if (config.Attribute("priority", &priority) != NULL && (priority < 0 || priority > 100))
+        throw ConfigError(&config, "<microbee> priority attribute must be between 0 and 100");
+
+    if (config.Attribute("cpu", &host_cpu) != NULL && host_cpu < 0)
+        throw ConfigError(&config, "<microbee> cpu attribute must not be negative");
+
+    const char *speed_attr = config.Attribute("speed");
+    if (speed_attr != NULL)
+    {
+        int s;
+        if (std::string(speed_attr) == "unlimited")
+            s = cUnlimitedSpeed;
+        else if (config.QueryIntAttribute("speed", &s) != TIXML_SUCCESS || s < 1)
+            throw ConfigError(&config, "<microbee> speed attribute must be a positive multiplier or \"unlimited\"");
+
+        speed = s;
+    }
+
+    const char *renderer = config.Attribute("renderer");
+    if (renderer != NULL)
+    {
+        if (std::string(renderer) == "framebuffer")
+            term.SetRenderer(Terminal::cFrameBufferRenderer);
+        else if (std::string(renderer) == "atlas")
+            term.SetRenderer(Terminal::cAtlasRenderer);
+        else if (std::string(renderer) == "bitmap")
+            term.SetRenderer(Terminal::cBitmapRenderer);
+        else
+            throw ConfigError(&config, "<microbee> renderer attribute must be \"framebuffer\", \"atlas\" or \"bitmap\"");
+    }
+}
+
+
+/*! The priority can only be set between creating and running a thread, hence this function. */
+wxThreadError MicrobeeThread::Create(unsigned int stackSize)
+{
+    wxThreadError err = wxThread::Create(stackSize);
+
+    if (err == wxTHREAD_NO_ERROR && priority >= 0)
+        SetPriority(priority);
+
+    if (err == wxTHREAD_NO_ERROR)
+        err = renderer.Create();
+    if (err == wxTHREAD_NO_ERROR)
+        err = renderer.Run();
+
+    return err;
+}
+
+
+/*! Each slice is paced to take as long in real time as it emulates, divided by the speed.  At
+ *  unlimited speed the slices run back to back.  The length of the slices (the slice attribute
+ *  on <microbee>, in milliseconds) trades latency against overhead: the screen and keyboard are
+ *  only brought up to date between slices.
+ *
+ *  The RenderThread is stopped before returning, so it's finished once the thread is.
+ */
+MicrobeeThread::ExitCode MicrobeeThread::Entry()
+{
+    Pacer pacer;
+
+    if (host_cpu >= 0)
+        Pacer::SetAffinity(host_cpu);  // Best effort, not all hosts support this
+
+    pacer.Start();
+
+    while (!TestDestroy())
+    {
+        if (paused)
+        {
+            {
+                wxMutexLocker lock(pause_mutex);
+                pause_cond.Signal();
+            }
+
+            while (paused)
+            {
+                Sleep(100);  // The RenderThread keeps the display refreshed
+                if (TestDestroy())
+                    break;
+            }
+
+            if (TestDestroy())
+                break;
+
+            pacer.Start();  // Don't try to make up the time spent paused
+        }
+
+
+        const Microbee::time_t ticks = mbee.RunSlice();
+        const int s = speed;
+
+        if (s == cUnlimitedSpeed)
+            pacer.Start();  // Nothing to wait for, but keep the pacer current for when the speed is reduced
+        else
+            pacer.Wait(ticks * 1000 / Microbee::cTicksPerMicro / s);
+    }
+
+    renderer.Stop();
+    return 0;
+}
+
+
+// MUST BE THREAD SAFE
+void MicrobeeThread::DoReset()
+{
+    PauseEmulation();
+    mbee.Reset();
+    ResumeEmulation();
+}
+
+
+// MUST BE THREAD SAFE
+void MicrobeeThread::PauseEmulation()
+{
+    if (!paused)
+    {
+        paused = true;
+        pause_cond.Wait();
+    }
+}
+
+
+// MUST BE THREAD SAFE
+void MicrobeeThread::ResumeEmulation()
+{
+    paused = false;
+}
+
+
+// MUST BE THREAD SAFE
+void MicrobeeThread::SaveState(const char *filename)
+{
+    PauseEmulation(); // Emulation will stay paused if an exception occurs.
+    mbee.SaveState(filename);
+    ResumeEmulation(); 
+}
+
+
+// MUST BE THREAD SAFE
+bool MicrobeeThread::Rewind(int millis)
+{
+    PauseEmulation();
+    const bool rewound = mbee.Rewind(millis * (Microbee::cTicksPerSecond / 1000));
+    ResumeEmulation();
+    return rewound;
+}
+
+
+// MUST BE THREAD SAFE
+void MicrobeeThread::LoadDisk(unsigned int drive, const char *name)
+{
+    PauseEmulation();
+    mbee.LoadDisk(drive, name);
+    ResumeEmulation();
+}
+
+
+// MUST BE THREAD SAFE
+void MicrobeeThread::SetSpeed(int multiplier)
+{
+    speed = multiplier;  // Picked up from the next slice
+}
+
+
+/*! Frames that haven't changed aren't published, as the RenderThread still has the last one.
+ *  Above normal speed, frames are completed faster than the host can usefully show them, so they
+ *  are published no closer together than cRenderInterval in host time, saving the copies.  The
+ *  frame after one that changed but was dropped is published to be drawn in full.
+ */
+void MicrobeeThread::ShowFrame(const VideoFrame &frame)
+{
+    if (!frame.changed && !missed_change)
+        return;
+
+    const long long now = Pacer::Now();
+
+    if (speed != 1 && now - last_publish < cRenderInterval)
+    {
+        missed_change = true;
+        return;
+    }
+
+    renderer.Publish(frame, missed_change);
+    last_publish = now;
+    missed_change = false;
+}
@@ -0,0 +1,111 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MICROBEETHREAD_H
+#define MICROBEETHREAD_H
+
+#include "Microbee.h"
+#include "VideoSink.h"
+#include "RenderThread.h"
+
+class Terminal;
+
+
+/*! \brief Runs a Microbee in real time on its own thread, displaying it on a Terminal
+ *
+ *  The thread runs the Microbee a slice at a time, pacing each slice against the host clock.
+ *  Frames are handed to a RenderThread, so the emulation doesn't wait for them to be drawn.
+ *  The optional attributes speed, priority and cpu on <microbee> set the starting speed (see
+ *  SetSpeed()), the priority of the thread (0 - 100, where 50 is normal) and the host CPU it is
+ *  restricted to.  The renderer attribute selects how the Terminal draws frames, "framebuffer"
+ *  (the default), "atlas" or "bitmap" (see Terminal::Renderer).
+ */
+class MicrobeeThread : public wxThread, public VideoSink
+{
+public:
+    /*! \brief Constructs the Microbee from XML file \p config_file, using \p term_ for display
+     *         and keyboard.
+     *
+     *  \throws ConfigError if a problem was found with the configuration
+     */
+    MicrobeeThread(Terminal &term_, const char *config_file);
+
+    //! Creates the thread, then applies the thread priority from the configuration (if any), and starts the RenderThread
+    wxThreadError Create(unsigned int stackSize = 0);
+
+    //! Main thread function, repeatedly runs the Microbee
+    virtual ExitCode Entry();
+
+
+    //! Resets the emulated system (only returns once the reset has completed).  Thread safe.
+    void DoReset();
+
+    //! Pauses the emulation (only returns once the emulation is paused).  Thread safe.
+    void PauseEmulation();
+
+    //! Resumes the emulation (returns immediately).  Thread safe.
+    void ResumeEmulation();
+
+    //! Seralizes the current emulation state into the specfied file.  Thread safe.
+    void SaveState(const char *filename);
+
+    //! Rewinds the emulation by at least \p millis (see Microbee::Rewind()).  Thread safe.
+    bool Rewind(int millis);
+    
+    //! Loads a disk in the specified drive.  Thread safe.
+    void LoadDisk(unsigned int drive, const char *name);
+
+    static const int cUnlimitedSpeed = 0;  //!< For SetSpeed(), run as fast as the host allows
+
+    //! Sets the speed as a multiple of real time, or cUnlimitedSpeed.  Thread safe.
+    void SetSpeed(int multiplier);
+
+    //! Returns the current speed (see SetSpeed())
+    int GetSpeed() const { return speed; }
+
+
+    //! Publishes the frame to the RenderThread, unless it hasn't changed or frames are being dropped to keep up
+    virtual void ShowFrame(const VideoFrame &frame);
+
+
+private:
+    volatile bool paused;  //!< True if the emulation is currently paused.  Microbee thread does not write to this.  Only written by PauseEmulation() and ResumeEmulation().
+    wxMutex pause_mutex;  //!< Mutex associated with pause_cond, must be constructed first
+    wxCondition pause_cond;  //!< Used by the Microbee thread to signal to the main thread that emulation has paused
+
+    Terminal &term;  //!< For display and keyboard
+    RenderThread renderer;  //!< Draws the frames on term
+    Microbee mbee;  //!< The emulated system
+
+    int priority;  //!< Priority of the thread (0 - 100), or -1 to leave it at the default
+    int host_cpu;  //!< Host CPU the thread is restricted to, or -1 for any
+
+    volatile int speed;  //!< Speed as a multiple of real time, or cUnlimitedSpeed.  Only written by SetSpeed().
+    long long last_publish;  //!< Host time that the last frame was published (see ShowFrame())
+    bool missed_change;  //!< True if a changed frame was dropped since the last frame published
+
+    static const long long cRenderInterval = 1000000000LL / 60;  //!< Shortest host time between published frames above normal speed (ns)
+
+    // Private copy constuctor and assigment operator to prevent copies
+    MicrobeeThread(const MicrobeeThread &);
+    MicrobeeThread& operator= (const MicrobeeThread &);
+};
+
+
+#endif // MICROBEETHREAD_H
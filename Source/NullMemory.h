@@ -31,6 +31,8 @@ public:
 
     virtual void Write(word addr, byte val) { UNREFERENCED_PARAMETER(addr);  UNREFERENCED_PARAMETER(val); };
     virtual byte Read(word addr) { UNREFERENCED_PARAMETER(addr);  return 0; };
+
+    virtual bool IgnoresWrites() { return true; }
 };
 
 
@@ -31,6 +31,7 @@ public:
 
     virtual void PortWrite(word addr, byte val) { UNREFERENCED_PARAMETER(addr);  UNREFERENCED_PARAMETER(val); };
     virtual byte PortRead(word addr) { UNREFERENCED_PARAMETER(addr);  return 0; };
+    virtual Microbee::time_t PortStableUntil(word addr) { UNREFERENCED_PARAMETER(addr);  return cStable; };
 };
 
 
@@ -44,6 +44,17 @@ public:
      */
     virtual byte PortRead(word addr) = 0;
 
+    /*! \brief Returns the emulated time until which reading port \p addr will keep returning the same value
+     *
+     *  Apart from the passage of time, only port writes (to any device) may change the value.
+     *  This allows the Z80CPU to skip over loops which do nothing but poll ports.  The default
+     *  of 0 means the value may change at any time, or that reading it has side effects.  Devices
+     *  whose value only changes when written should return cStable.
+     */
+    virtual Microbee::time_t PortStableUntil(word addr) { UNREFERENCED_PARAMETER(addr); return 0; }
+
+    static const Microbee::time_t cStable = 0x7FFFFFFFFFFFFFFFLL;  //!< For PortStableUntil(), the value never changes by itself
+
 
 protected:
     unsigned int size;  //!< Number of bytes that the devices occupies in the address space
@@ -20,8 +20,10 @@
 
 #include "stdafx.h"
 #include "RAM.h"
-#include <wx/file.h>
+#include "utils/SharedMemory.h"
+#include <fstream>
 #include <cstring>
+#include <algorithm>
 
 
 /*! \p config_ must specify the size attribute on the <device>, and can
@@ -29,7 +31,8 @@
  *     the initial data.
  */
 RAM::RAM(Microbee &, const TiXmlElement &config_) :
-    config(config_)
+    config(config_),
+    view(NULL)
 {
     int s;
 
@@ -40,21 +43,49 @@ RAM::RAM(Microbee &, const TiXmlElement &config_) :
 
     size = s;
 
-    memory.resize(size);
+    storage.resize(size);
+    memory = &storage[0];
 }
 
 
 RAM::RAM(unsigned int size_) : 
     MemoryDevice(size_),
-    memory(size),
-    config("device")
+    config("device"),
+    storage(size),
+    view(NULL)
 {
+    memory = &storage[0];
+}
+
+
+RAM::~RAM()
+{
+    if (view != NULL)
+        SharedMemory::Unmap(view, size);
+}
+
+
+void RAM::UseImage(const SharedMemory &image, size_t offset)
+{
+    byte *v = image.MapCopy(offset, size);
+    if (v == NULL)
+    {
+        memcpy(memory, image.Data() + offset, size);
+        return;
+    }
+
+    if (view != NULL)
+        SharedMemory::Unmap(view, size);
+
+    view = v;
+    memory = view;
+    std::vector<byte>().swap(storage);  // No longer needed
 }
 
 
 void RAM::Reset()
 {
-    memory.assign(size, 0);
+    std::fill(memory, memory + size, 0);
 
     const char *file;
     if ((file = config.Attribute("filename")) != NULL)
@@ -78,16 +109,19 @@ void RAM::LoadRAM(const char *filename)
     if (*filename == '\0')  // If no filename is passed, ROM should still be created but is to be empty
         return;
 
-    wxFile ram_file(filename);
+    std::ifstream ram_file(filename, std::ios::in | std::ios::binary);
 
-    if (!ram_file.IsOpened())
+    if (!ram_file.is_open())
         throw FileNotFound(filename);
 
-    wxFileOffset len = ram_file.Length();
+    ram_file.seekg(0, std::ios::end);
+    std::streamoff len = ram_file.tellg();
+    ram_file.seekg(0, std::ios::beg);
+
     if (size < len)
-        ram_file.Read(&memory[0], size);
+        ram_file.read((char *)&memory[0], size);
     else
-        ram_file.Read(&memory[0], len);
+        ram_file.read((char *)&memory[0], len);
 }
 
 void RAM::SaveState(BinaryWriter& writer)
@@ -23,6 +23,8 @@
 #include <vector>
 #include "MemoryDevice.h"
 
+class SharedMemory;
+
 
 /*! \brief Emulates a %RAM chip */
 class RAM : public MemoryDevice
@@ -34,20 +36,40 @@ public:
     //! Creates a new RAM device of \p size_ bytes, initialised to 0
     RAM(unsigned int size_);
 
+    ~RAM();
+
+    /*! \brief Starts the RAM out as a copy of part of \p image
+     *
+     *  The RAM maps a copy-on-write view of \p size bytes of \p image from \p offset, so only
+     *  the pages the emulated machine writes to are actually copied.  If the view can't be mapped
+     *  the contents are copied instead.  Reset() isn't needed (and would clear the copy).
+     */
+    void UseImage(const SharedMemory &image, size_t offset);
+
 
     virtual void Reset();
 
     virtual void Write(word addr, byte val) { memory[addr] = val; };
     virtual byte Read(word addr) { return memory[addr]; };
 
-    std::vector<byte> memory;  //!< The contents of the RAM, plain array for speed
+    virtual byte *GetReadPage(word addr) { return &memory[addr]; }
+    virtual byte *GetWritePage(word addr) { return &memory[addr]; }
+
+    byte *memory;  //!< The contents of the RAM, plain array for speed
 
     virtual void SaveState(BinaryWriter&);
     virtual void RestoreState(BinaryReader&);
 
 private:
     TiXmlElement config;
+    std::vector<byte> storage;  //!< Backs memory unless it is a view of an image
+    byte *view;                 //!< View mapped by UseImage(), NULL if none
+
     void LoadRAM(const char *filename);
+
+    // Private copy constuctor and assigment operator to prevent copies
+    RAM(const RAM &);
+    RAM& operator= (const RAM &);
 };
 
 
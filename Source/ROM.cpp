@@ -20,13 +20,21 @@
 
 #include "stdafx.h"
 #include "ROM.h"
-#include <wx/file.h>
+#include <fstream>
+#include <algorithm>
 #include "Exceptions.h"
+#include "utils/Thread.h"
+
+
+std::vector<ROM::Image*> ROM::images;
+Mutex ROM::images_mutex;
 
 
 /*! \p config_ must specify size and filename attributes on the <device> */
 ROM::ROM(Microbee &mbee_, const TiXmlElement &config_) :
-    mbee(mbee_)
+    memory(NULL),
+    mbee(mbee_),
+    image(NULL)
 {
     int s;
 
@@ -40,8 +48,6 @@ ROM::ROM(Microbee &mbee_, const TiXmlElement &config_) :
     if ((file = config_.Attribute("filename")) == NULL)
         throw ConfigError(&config_, "ROM missing filename attribute");
 
-    memory.resize(size, 0);
-
     try
     {
         LoadROM(file);
@@ -55,9 +61,18 @@ ROM::ROM(Microbee &mbee_, const TiXmlElement &config_) :
 
 ROM::ROM(Microbee &mbee_, unsigned int size_) :
     MemoryDevice(size_),
-    memory(size_, 0),
-    mbee(mbee_)
+    memory(NULL),
+    mbee(mbee_),
+    image(NULL)
+{
+    LoadROM(NULL);
+}
+
+
+ROM::~ROM()
 {
+    MutexLocker lock(images_mutex);
+    ReleaseImage();
 }
 
 
@@ -66,31 +81,85 @@ ROM::ROM(Microbee &mbee_, unsigned int size_) :
     x will return the byte in the image at x % filesize.  If \p filename is NULL
     or points to an empty string then the ROM contents will be cleared to zero.
 
+    The file is only read if no other ROM of the same size has it loaded (with the same
+    \p transform), otherwise the image is shared.  So a file changed on disk isn't seen
+    until all the ROMs using it have been destroyed.
+
     \throws FileNotFound if the file cannot be opened for reading
  */
-void ROM::LoadROM(const char *filename)
+void ROM::LoadROM(const char *filename, Transform transform)
 {
-    if (filename == NULL || *filename == '\0')  // If no filename is passed then clear out the ROM
+    std::string path;
+    if (filename != NULL && *filename != '\0')  // If no filename is passed then clear out the ROM
+        path = mbee.GetConfigDir() + filename;
+
+    MutexLocker lock(images_mutex);
+
+    Image *img = NULL;
+    for (std::vector<Image*>::iterator it = images.begin(); it != images.end() && img == NULL; it++)
     {
-        memory.clear();
-        memory.resize(size, 0);
-        return;
+        if ((*it)->path == path && (*it)->size == size && (*it)->transform == transform)
+            img = *it;
     }
-    
-    wxFile rom_file(mbee.GetConfigFileName().GetPath(wxPATH_GET_SEPARATOR) + filename);
 
-    if (!rom_file.IsOpened())
-        throw FileNotFound(filename);
-
-    wxFileOffset len = rom_file.Length();
-    if (size < len)
+    if (img == NULL)
     {
-        rom_file.Read(&memory[0], size);
+        std::vector<byte> data(size, 0);
+
+        if (!path.empty())
+        {
+            std::ifstream rom_file(path.c_str(), std::ios::in | std::ios::binary);
+
+            if (!rom_file.is_open())
+                throw FileNotFound(filename);
+
+            rom_file.seekg(0, std::ios::end);
+            std::streamoff len = rom_file.tellg();
+            rom_file.seekg(0, std::ios::beg);
+
+            if (size < len)
+            {
+                rom_file.read((char *)&data[0], size);
+            }
+            else if (len > 0)
+            {
+                rom_file.read((char *)&data[0], len);
+                for (unsigned int i = len; i < size; i++)  // Alias ROM to memory addresses in the ROM space
+                    data[i] = data[i % len];
+            }
+        }
+
+        if (transform != NULL)
+            transform(&data[0], size);
+
+        img = new Image;
+        img->path = path;
+        img->size = size;
+        img->transform = transform;
+        img->data.swap(data);
+        img->refs = 0;
+        images.push_back(img);
     }
-    else
+
+    img->refs++;
+    ReleaseImage();
+
+    image = img;
+    memory = &img->data[0];
+}
+
+
+void ROM::ReleaseImage()
+{
+    if (image == NULL)
+        return;
+
+    if (--image->refs == 0)
     {
-        rom_file.Read(&memory[0], len);
-        for (unsigned int i = len; i < size; i++)  // Alias ROM to memory addresses in the ROM space
-            memory[i] = memory[i % len];
+        images.erase(std::find(images.begin(), images.end(), image));
+        delete image;
     }
+
+    image = NULL;
+    memory = NULL;
 }
@@ -21,10 +21,17 @@
 #define ROM_H
 
 #include <vector>
+#include <string>
 #include "MemoryDevice.h"
 
+class Mutex;
 
-/*! \brief Emulates a %ROM chip */
+
+/*! \brief Emulates a %ROM chip
+ *
+ *  The contents are never written, so ROMs loaded from the same file (e.g. by several Microbee
+ *  instances in one process) share a single copy of the image.
+ */
 class ROM : public MemoryDevice
 {
 public:
@@ -35,17 +42,47 @@ public:
      *         using LoadROM() */
     ROM(Microbee &, unsigned int size_);
 
-    //! Loads the ROM with the contents of \p filename
-    void LoadROM(const char *filename);
+    ~ROM();
+
+    //! Rearranges an image once it's loaded, for the device using the ROM
+    typedef void (*Transform)(byte *image, unsigned int size);
+
+    //! Loads the ROM with the contents of \p filename, rearranged by \p transform if not NULL
+    void LoadROM(const char *filename, Transform transform = NULL);
 
 
     virtual void Write(word addr, byte val) { UNREFERENCED_PARAMETER(addr); UNREFERENCED_PARAMETER(val); } // No action when writing to ROM
     virtual byte Read(word addr) { return memory[addr]; };
 
-    std::vector<byte> memory;  //!< The contents of the ROM
+    virtual byte *GetReadPage(word addr) { return const_cast<byte *>(&memory[addr]); }  // Never written through, see IgnoresWrites()
+    virtual bool IgnoresWrites() { return true; }
+
+    const byte *memory;  //!< The contents of the ROM (shared, so read only)
     
 private:
     Microbee& mbee;
+
+    //! The contents of a ROM file, shared by all the ROMs loaded from it
+    struct Image
+    {
+        std::string path;  //!< Full path of the file, empty if the ROM is cleared
+        unsigned int size;
+        Transform transform;
+        std::vector<byte> data;
+        int refs;  //!< Number of ROMs using the image
+    };
+
+    Image *image;  //!< Image holding memory
+
+    //! Releases image, images_mutex must be held
+    void ReleaseImage();
+
+    static std::vector<Image*> images;  //!< Images currently in use
+    static Mutex images_mutex;  //!< Protects images (and the reference counts), as instances may be created on any thread
+
+    // Private copy constuctor and assigment operator to prevent copies
+    ROM(const ROM &);
+    ROM& operator= (const ROM &);
 };
 
 
@@ -0,0 +1,86 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "stdafx.h"
+#include "RenderThread.h"
+
+#include "Terminal.h"
+
+
+RenderThread::RenderThread(Terminal &term_) :
+    wxThread(wxTHREAD_JOINABLE),
+    term(term_),
+    published(0),
+    wake(0, 1),
+    stopping(false)
+{
+}
+
+
+/*! The frame is copied into the TripleBuffer's back value, which the render thread never uses,
+ *  so the only waiting is for the copy.  The semaphore holds at most one post, so posting never
+ *  blocks on the render thread either.
+ */
+void RenderThread::Publish(const VideoFrame &frame, bool all)
+{
+    Published &p = frames.Back();
+    p.copy.Assign(frame);
+    p.sequence = ++published;
+    p.all = all;
+
+    frames.Publish();
+    wake.Post();
+}
+
+
+void RenderThread::Stop()
+{
+    stopping = true;
+    wake.Post();
+    Wait();
+}
+
+
+/*! Each frame's dirty cells are relative to the frame published before it, so after a frame has
+ *  been skipped (because a later one was published before it was taken) the next is drawn in
+ *  full.
+ */
+RenderThread::ExitCode RenderThread::Entry()
+{
+    unsigned long rendered = 0;  // Sequence of the last frame rendered, 0 if none has been
+
+    while (!stopping)
+    {
+        const bool woken = wake.WaitTimeout(cRefreshInterval) == wxSEMA_NO_ERROR;
+        if (stopping)
+            break;
+
+        if (frames.Update())
+        {
+            const Published &p = frames.Front();
+            term.Render(p.copy.Frame(), p.all || p.sequence != rendered + 1);
+            rendered = p.sequence;
+        }
+        else if (!woken && rendered != 0)
+            term.Render(frames.Front().copy.Frame(), true);
+    }
+
+    return 0;
+}
@@ -0,0 +1,84 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RENDERTHREAD_H
+#define RENDERTHREAD_H
+
+#include "FrameCopy.h"
+#include "utils/TripleBuffer.h"
+
+class Terminal;
+
+
+/*! \brief Renders and presents frames on the Terminal from its own thread
+ *
+ *  Frames are published from the emulation thread as FrameCopies through a TripleBuffer, so the
+ *  emulation never waits for OpenGL (e.g. for SwapBuffers() to reach the vertical sync).  The
+ *  render thread draws the latest frame published, and in full if it skipped any before it.
+ *  When no frames arrive (e.g. while paused) it redraws the last one every cRefreshInterval, in
+ *  case the window needs repainting.
+ *
+ *  The render thread owns the Terminal's OpenGL context.  The thread is joinable, and is
+ *  finished with Stop().
+ */
+class RenderThread : public wxThread
+{
+public:
+    RenderThread(Terminal &term_);
+
+    /*! \brief Publishes a copy of \p frame to be rendered, without waiting for anything
+     *
+     *  Set \p all if frames have been left out since the last one published.  Must always be
+     *  called from the same thread.
+     */
+    void Publish(const VideoFrame &frame, bool all);
+
+    //! Finishes the thread, returning once it has exited
+    void Stop();
+
+    //! Main thread function, renders frames as they're published
+    virtual ExitCode Entry();
+
+
+private:
+    //! A frame in the TripleBuffer
+    struct Published
+    {
+        FrameCopy copy;
+        unsigned long sequence;  //!< Number of frames published before and including this one
+        bool all;  //!< True if frames were left out before this one (see Publish())
+
+        Published() : sequence(0), all(true) {}
+    };
+
+    Terminal &term;  //!< Where the frames are presented
+    TripleBuffer<Published> frames;  //!< From the emulation thread to the render thread
+    unsigned long published;  //!< Number of frames published
+    wxSemaphore wake;  //!< Posted when a frame is published, or to stop
+    volatile bool stopping;  //!< Set by Stop()
+
+    static const int cRefreshInterval = 100;  //!< Longest time between presenting frames, even if there's nothing new (ms)
+
+    // Private copy constuctor and assigment operator to prevent copies
+    RenderThread(const RenderThread &);
+    RenderThread& operator= (const RenderThread &);
+};
+
+
+#endif // RENDERTHREAD_H
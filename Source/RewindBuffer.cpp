@@ -0,0 +1,244 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include "stdafx.h"
+#include "RewindBuffer.h"
+
+#include <sstream>
+#include <cstring>
+#include <algorithm>
+
+#include "utils/BinaryWriter.h"
+#include "utils/BinaryReader.h"
+
+#include "Device.h"
+#include "RAM.h"
+#include "Drives.h"
+
+
+RewindBuffer::RewindBuffer(Microbee &mbee_, const TiXmlElement &config_) :
+    mbee(mbee_),
+    interval(cDefaultIntervalMillis * (Microbee::cTicksPerSecond / 1000)),
+    have_latest(false),
+    latest_time(0),
+    next_time(0)
+{
+    int millis;
+    if (config_.Attribute("interval", &millis) != NULL)
+    {
+        if (millis <= 0)
+            throw ConfigError(&config_, "<rewind> interval attribute must be positive");
+        interval = millis * (Microbee::cTicksPerSecond / 1000);
+    }
+
+    int length = cDefaultLengthMillis;
+    if (config_.Attribute("length", &length) != NULL && length <= 0)
+        throw ConfigError(&config_, "<rewind> length attribute must be positive");
+
+    max_checkpoints = (size_t)(length * (Microbee::cTicksPerSecond / 1000) / interval);
+    if (max_checkpoints == 0)
+        max_checkpoints = 1;
+
+
+    const TiXmlElement &mbee_tag = mbee.GetConfig();
+    for (const TiXmlElement *el = mbee_tag.FirstChildElement("device"); el != NULL; el = el->NextSiblingElement("device"))
+    {
+        Item item;
+        item.device = mbee.GetDevice<Device>(el->Attribute("id"));
+        item.ram = dynamic_cast<RAM*>(item.device);
+        items.push_back(item);
+
+        Drives *drives = dynamic_cast<Drives*>(item.device);
+        if (drives != NULL)
+            drives->UseOverlays(true);  // Written to the images when the system is destroyed
+    }
+
+    Item schedule = { NULL, NULL };
+    items.push_back(schedule);
+
+    latest.resize(items.size());
+}
+
+
+/*! The state is compared with the newest checkpoint, the pages that differ are kept in the
+    history, and the newest checkpoint is brought up to date.
+ */
+void RewindBuffer::Update()
+{
+    const Microbee::time_t now = mbee.GetTime();
+
+    if (have_latest && now < next_time)
+        return;
+
+    Checkpoint checkpoint;
+    checkpoint.time = latest_time;
+    checkpoint.deltas.resize(items.size());
+
+    std::vector<unsigned char> state;
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        if (items[i].ram != NULL)
+            Diff(latest[i], items[i].ram->memory, items[i].ram->GetSize(), checkpoint.deltas[i]);
+        else
+        {
+            Save(items[i], state);
+            Diff(latest[i], state.empty() ? NULL : &state[0], state.size(), checkpoint.deltas[i]);
+        }
+    }
+
+    if (have_latest)
+    {
+        history.push_back(checkpoint);
+        if (history.size() > max_checkpoints)
+            history.pop_front();
+    }
+
+    have_latest = true;
+    latest_time = now;
+    next_time = (now / interval + 1) * interval;
+}
+
+
+/*! Must not be called while the Microbee is running (see Microbee::Rewind()).
+ */
+bool RewindBuffer::Rewind(Microbee::time_t ticks)
+{
+    if (!have_latest)
+        return false;
+
+    const Microbee::time_t target = mbee.GetTime() - ticks;
+
+    while (latest_time > target && !history.empty())
+    {
+        const Checkpoint &checkpoint = history.back();
+        for (size_t i = 0; i < items.size(); i++)
+            Apply(latest[i], checkpoint.deltas[i]);
+        latest_time = checkpoint.time;
+        history.pop_back();
+    }
+
+    next_time = (latest_time / interval + 1) * interval;
+
+    for (size_t i = 0; i < items.size(); i++)
+        Restore(items[i], latest[i]);
+
+    return true;
+}
+
+
+void RewindBuffer::Clear()
+{
+    history.clear();
+    have_latest = false;
+    latest_time = 0;
+    next_time = 0;
+
+    for (size_t i = 0; i < latest.size(); i++)
+        std::vector<unsigned char>().swap(latest[i]);
+}
+
+
+void RewindBuffer::Save(const Item &item, std::vector<unsigned char> &state)
+{
+    std::ostringstream stream(std::ostringstream::out | std::ostringstream::binary);
+    BinaryWriter writer(stream);
+
+    if (item.device != NULL)
+        item.device->SaveState(writer);
+    else
+        mbee.SaveSchedule(writer);
+
+    const std::string s = stream.str();
+    state.assign(s.begin(), s.end());
+}
+
+
+void RewindBuffer::Restore(const Item &item, const std::vector<unsigned char> &state)
+{
+    if (item.ram != NULL)
+    {
+        if (state.size() == item.ram->GetSize())
+            memcpy(item.ram->memory, &state[0], state.size());
+        return;
+    }
+
+    MemoryStreamBuf buf(state.empty() ? NULL : &state[0], state.size());
+    std::istream stream(&buf);
+    BinaryReader reader(stream);
+
+    if (item.device != NULL)
+    {
+        if (!state.empty())
+            item.device->RestoreState(reader);
+    }
+    else
+        mbee.RestoreSchedule(reader);
+}
+
+
+size_t RewindBuffer::PageLength(size_t size, unsigned int page)
+{
+    const size_t ofs = (size_t)page * cPageSize;
+    return ofs < size ? std::min((size_t)cPageSize, size - ofs) : 0;
+}
+
+
+void RewindBuffer::Diff(std::vector<unsigned char> &old, const unsigned char *cur, size_t len, Delta &delta)
+{
+    delta.size = old.size();
+
+    const unsigned int pages = (unsigned int)((std::max(old.size(), len) + cPageSize - 1) / cPageSize);
+    old.resize(std::max(old.size(), len));
+
+    for (unsigned int page = 0; page < pages; page++)
+    {
+        const size_t ofs = (size_t)page * cPageSize;
+        const size_t old_len = PageLength(delta.size, page);
+        const size_t cur_len = PageLength(len, page);
+
+        if (old_len == cur_len && memcmp(&old[ofs], cur + ofs, cur_len) == 0)
+            continue;
+
+        delta.pages.push_back(page);
+        delta.data.insert(delta.data.end(), old.begin() + ofs, old.begin() + ofs + old_len);
+        if (cur_len > 0)
+            memcpy(&old[ofs], cur + ofs, cur_len);
+    }
+
+    old.resize(len);
+}
+
+
+void RewindBuffer::Apply(std::vector<unsigned char> &state, const Delta &delta)
+{
+    state.resize(std::max(state.size(), delta.size));
+
+    size_t pos = 0;
+    for (std::vector<unsigned int>::const_iterator page = delta.pages.begin(); page != delta.pages.end(); page++)
+    {
+        const size_t len = PageLength(delta.size, *page);
+        if (len > 0)
+            memcpy(&state[(size_t)*page * cPageSize], &delta.data[pos], len);
+        pos += len;
+    }
+
+    state.resize(delta.size);
+}
@@ -0,0 +1,131 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef REWINDBUFFER_H
+#define REWINDBUFFER_H
+
+#include <deque>
+#include <string>
+#include <vector>
+#include "Microbee.h"
+
+class Device;
+class RAM;
+
+
+/*! \brief Keeps checkpoints of the recent past, so the system can be rewound
+ *
+ *  Configured with a <rewind> element in the <microbee> element of the configuration:
+ *
+ *  \code
+ *  <rewind interval="250" length="10000" />
+ *  \endcode
+ *
+ *  A checkpoint is taken at the end of the first slice to reach each multiple of interval
+ *  milliseconds of emulated time (default 250), and those from the last length milliseconds
+ *  (default 10000) are kept.
+ *
+ *  Only the newest checkpoint is kept whole.  Each of the others holds just the pages (of
+ *  cPageSize bytes) of the state that differ from the checkpoint after it, so most hold only the
+ *  device registers and the few pages of RAM written in the interval.  The RAM devices are
+ *  compared directly, while every other device (e.g. the video and PCG RAM, and the disks) is
+ *  compared as saved by Device::SaveState().  Comparing finds the dirty pages without the CPU
+ *  having to track its writes, and costs only a pass over the memory at each checkpoint.
+ *
+ *  Disk writes are kept in memory as part of the state from when the buffer is created (see
+ *  Disk::UseOverlay()), so they can be rewound too.  They are written to the disk images when
+ *  the disks are unloaded, which includes when the system is destroyed.
+ */
+class RewindBuffer
+{
+public:
+    RewindBuffer(Microbee &mbee_, const TiXmlElement &config_);
+
+    //! Called at the end of each slice, takes a checkpoint if one is due
+    void Update();
+
+    /*! \brief Restores the newest checkpoint at least \p ticks ago, or the oldest one kept
+     *
+     *  The checkpoints after it are discarded.  Returns false if there are no checkpoints yet.
+     */
+    bool Rewind(Microbee::time_t ticks);
+
+    //! Discards all the checkpoints, e.g. after a reset
+    void Clear();
+
+    static const unsigned int cPageSize = 256;  //!< Size of the pages that the state is compared in
+
+private:
+    //! A piece of the state
+    struct Item
+    {
+        Device *device;  //!< Device it is saved from, NULL for the schedule
+        RAM *ram;  //!< The device if it's a RAM (compared directly), otherwise NULL
+    };
+
+    //! The pages of an Item that changed between a checkpoint and the next
+    struct Delta
+    {
+        size_t size;  //!< Size of the Item at the checkpoint
+        std::vector<unsigned int> pages;  //!< Pages that changed, in order
+        std::vector<unsigned char> data;  //!< Contents of those pages at the checkpoint
+    };
+
+    struct Checkpoint
+    {
+        Microbee::time_t time;
+        std::vector<Delta> deltas;  //!< One per Item, to get from the next checkpoint back to this one
+    };
+
+    Microbee &mbee;
+    std::vector<Item> items;
+
+    Microbee::time_t interval;  //!< Ticks between checkpoints
+    size_t max_checkpoints;  //!< Number of checkpoints kept (besides the newest)
+
+    bool have_latest;  //!< False until the first checkpoint
+    Microbee::time_t latest_time;  //!< Time of the newest checkpoint
+    Microbee::time_t next_time;  //!< Time the next checkpoint is due
+    std::vector<std::vector<unsigned char> > latest;  //!< The newest checkpoint, one per Item
+    std::deque<Checkpoint> history;  //!< Earlier checkpoints, oldest first
+
+    static const int cDefaultIntervalMillis = 250;
+    static const int cDefaultLengthMillis = 10000;
+
+    //! Saves the current state of \p item into \p state (unless it's a RAM)
+    void Save(const Item &item, std::vector<unsigned char> &state);
+    //! Restores \p item from \p state
+    void Restore(const Item &item, const std::vector<unsigned char> &state);
+
+    //! Puts the pages of \p old that differ from \p len bytes at \p cur into \p delta, then makes \p old a copy of \p cur
+    static void Diff(std::vector<unsigned char> &old, const unsigned char *cur, size_t len, Delta &delta);
+    //! Reverses a Diff() which put \p delta together
+    static void Apply(std::vector<unsigned char> &state, const Delta &delta);
+
+    //! Returns the length of page \p page of something \p size bytes long
+    static size_t PageLength(size_t size, unsigned int page);
+
+    // Private copy constuctor and assigment operator to prevent copies
+    RewindBuffer(const RewindBuffer &);
+    RewindBuffer& operator= (const RewindBuffer &);
+};
+
+
+#endif // REWINDBUFFER_H
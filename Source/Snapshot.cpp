@@ -0,0 +1,355 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include "stdafx.h"
+#include "Snapshot.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <algorithm>
+
+#include "utils/BinaryWriter.h"
+#include "utils/BinaryReader.h"
+#include "utils/MappedFile.h"
+#include "utils/PackBits.h"
+
+#include "Microbee.h"
+#include "Device.h"
+#include "RAM.h"
+
+
+namespace
+{
+    const char cMagic[8] = { 'N', 'W', 'S', 'N', 'A', 'P', '\r', '\n' };
+    const unsigned int cVersion = 1;
+    const unsigned int cPageSize = 4096;
+
+    enum Kind { cKindState, cKindRAM, cKindSchedule };
+    const unsigned char cFlagPacked = 0x01;
+
+    //! A section of the file
+    struct Section
+    {
+        unsigned char kind;
+        unsigned char flags;
+        std::string id;  //!< Device, empty for the schedule
+        unsigned long long offset;
+        unsigned long long length;  //!< Length of the data in the file
+        unsigned int size;  //!< Size of the state or RAM
+        std::vector<unsigned char> page_map;  //!< Bit set for each RAM page stored
+        std::vector<unsigned char> data;  //!< Only used when saving
+    };
+
+
+    unsigned long long RoundUp(unsigned long long n)
+    {
+        return (n + cPageSize - 1) / cPageSize * cPageSize;
+    }
+
+    void Pack(Section &section, bool compress)
+    {
+        if (!compress || section.data.empty())
+            return;
+
+        std::vector<unsigned char> packed;
+        PackBits::Pack(&section.data[0], section.data.size(), packed);
+        if (packed.size() < section.data.size())
+        {
+            section.data.swap(packed);
+            section.flags |= cFlagPacked;
+        }
+    }
+
+    //! Returns the device \p id of \p mbee, which GetDevice() would add to its devices if it didn't exist
+    Device *FindDevice(Microbee &mbee, const std::string &id)
+    {
+        const TiXmlElement &mbee_tag = mbee.GetConfig();
+        for (const TiXmlElement *el = mbee_tag.FirstChildElement("device"); el != NULL; el = el->NextSiblingElement("device"))
+        {
+            if (el->Attribute("id") != NULL && id == el->Attribute("id"))
+                return mbee.GetDevice<Device>(id);
+        }
+
+        throw std::runtime_error("Snapshot has state for unknown device " + id);
+    }
+}
+
+
+void Snapshot::Save(Microbee &mbee, const char *filename, bool compress)
+{
+    std::vector<Section> sections;
+
+    const TiXmlElement &mbee_tag = mbee.GetConfig();
+    for (const TiXmlElement *el = mbee_tag.FirstChildElement("device"); el != NULL; el = el->NextSiblingElement("device"))
+    {
+        const char *id = el->Attribute("id");
+        Device *device = mbee.GetDevice<Device>(id);
+
+        Section section;
+        section.id = id;
+        section.flags = 0;
+
+        RAM *ram = dynamic_cast<RAM*>(device);
+        if (ram != NULL)
+        {
+            // Only the pages that aren't all zero are kept
+            section.kind = cKindRAM;
+            section.size = ram->GetSize();
+            section.page_map.resize((section.size + cPageSize * 8 - 1) / (cPageSize * 8));
+
+            static const unsigned char zeros[cPageSize] = { 0 };
+            for (unsigned int ofs = 0, page = 0; ofs < section.size; ofs += cPageSize, page++)
+            {
+                const unsigned int len = std::min(cPageSize, section.size - ofs);
+                if (memcmp(ram->memory + ofs, zeros, len) == 0)
+                    continue;
+
+                section.page_map[page / 8] |= 1 << (page % 8);
+                section.data.insert(section.data.end(), ram->memory + ofs, ram->memory + ofs + len);
+            }
+        }
+        else
+        {
+            std::ostringstream stream(std::ostringstream::out | std::ostringstream::binary);
+            BinaryWriter writer(stream);
+            device->SaveState(writer);
+            const std::string state = stream.str();
+            if (state.empty())
+                continue;  // Nothing to restore
+
+            section.kind = cKindState;
+            section.size = (unsigned int)state.length();
+            section.data.assign(state.begin(), state.end());
+        }
+
+        Pack(section, compress);
+        sections.push_back(section);
+    }
+
+    // Last, as restoring it sets the time (as for the XML state)
+    std::ostringstream stream(std::ostringstream::out | std::ostringstream::binary);
+    BinaryWriter schedule_writer(stream);
+    mbee.SaveSchedule(schedule_writer);
+    const std::string schedule = stream.str();
+
+    Section section;
+    section.kind = cKindSchedule;
+    section.flags = 0;
+    section.size = (unsigned int)schedule.length();
+    section.data.assign(schedule.begin(), schedule.end());
+    Pack(section, compress);
+    sections.push_back(section);
+
+
+    // Lay out the data after the table
+    unsigned long long offset = sizeof(cMagic) + 4 * 4;
+    std::vector<Section>::iterator it;
+    for (it = sections.begin(); it != sections.end(); it++)
+        offset += 1 + 1 + 2 + it->id.length() + 8 + 8 + 4 + 4 + it->page_map.size();
+
+    for (it = sections.begin(); it != sections.end(); it++)
+    {
+        if (it->kind == cKindRAM && !(it->flags & cFlagPacked))
+            offset = RoundUp(offset);
+        it->offset = offset;
+        it->length = it->data.size();
+        offset += it->length;
+    }
+
+
+    std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+        throw std::runtime_error("Failed to save state");
+
+    BinaryWriter writer(file);
+    writer.WriteBuffer((const unsigned char *)cMagic, sizeof(cMagic));
+    writer.WriteDWord(cVersion);
+    writer.WriteDWord(cPageSize);
+    writer.WriteDWord((unsigned int)sections.size());
+    writer.WriteDWord(0);
+
+    for (it = sections.begin(); it != sections.end(); it++)
+    {
+        writer.WriteByte(it->kind);
+        writer.WriteByte(it->flags);
+        writer.WriteWord((unsigned short)it->id.length());
+        writer.WriteBuffer((const unsigned char *)it->id.data(), (int)it->id.length());
+        writer.WriteQWord(it->offset);
+        writer.WriteQWord(it->length);
+        writer.WriteDWord(it->size);
+        writer.WriteDWord((unsigned int)it->page_map.size());
+        if (!it->page_map.empty())
+            writer.WriteBuffer(&it->page_map[0], (int)it->page_map.size());
+    }
+
+    for (it = sections.begin(); it != sections.end(); it++)
+    {
+        static const unsigned char padding[cPageSize] = { 0 };
+        const std::streamoff pos = file.tellp();
+        if (pos >= 0 && (unsigned long long)pos < it->offset)
+            writer.WriteBuffer(padding, (int)(it->offset - pos));
+
+        if (!it->data.empty())
+            writer.WriteBuffer(&it->data[0], (int)it->data.size());
+    }
+
+    file.close();
+    if (file.fail())
+        throw std::runtime_error("Failed to save state");
+}
+
+
+bool Snapshot::IsSnapshot(const char *filename)
+{
+    std::ifstream file(filename, std::ios::in | std::ios::binary);
+    char magic[sizeof(cMagic)];
+    return file.read(magic, sizeof(magic)) && memcmp(magic, cMagic, sizeof(cMagic)) == 0;
+}
+
+
+/*! The file is mapped rather than read, so only the parts of it that are used are read in, and
+    the device state is read straight from the mapping.
+ */
+void Snapshot::Restore(Microbee &mbee, const char *filename)
+{
+    MappedFile file(filename);
+    if (!file.IsOpen())
+        throw std::runtime_error("Failed to load state");
+
+    const unsigned char *base = file.Data();
+    const unsigned long long file_size = file.Size();
+
+    MemoryStreamBuf header_buf(base, file.Size());
+    std::istream header(&header_buf);
+    BinaryReader reader(header);
+
+    unsigned char magic[sizeof(cMagic)];
+    reader.ReadBuffer(magic, sizeof(magic));
+    if (!header || memcmp(magic, cMagic, sizeof(cMagic)) != 0)
+        throw std::runtime_error("Not a snapshot");
+
+    const unsigned int version = reader.ReadDWord();
+    const unsigned int page_size = reader.ReadDWord();
+    const unsigned int count = reader.ReadDWord();
+    reader.ReadDWord();  // Flags, none yet
+    if (!header || version != cVersion || page_size != cPageSize)
+        throw std::runtime_error("Unsupported snapshot version");
+
+
+    std::vector<Section> sections;
+    for (unsigned int i = 0; i < count && header; i++)
+    {
+        Section section;
+        section.kind = reader.ReadByte();
+        section.flags = reader.ReadByte();
+
+        std::vector<unsigned char> id(reader.ReadWord());
+        if (!id.empty())
+            reader.ReadBuffer(&id[0], (int)id.size());
+        section.id.assign(id.begin(), id.end());
+
+        section.offset = reader.ReadQWord();
+        section.length = reader.ReadQWord();
+        section.size = reader.ReadDWord();
+
+        const unsigned int map_len = reader.ReadDWord();
+        if (map_len > file_size)
+            break;
+        section.page_map.resize(map_len);
+        if (map_len > 0)
+            reader.ReadBuffer(&section.page_map[0], (int)map_len);
+
+        if (section.offset > file_size || section.length > file_size - section.offset)
+            throw std::runtime_error("Snapshot is truncated");
+
+        sections.push_back(section);
+    }
+
+    if (!header || sections.size() != count)
+        throw std::runtime_error("Snapshot is truncated");
+
+
+    std::vector<Section>::const_iterator it;
+    for (it = sections.begin(); it != sections.end(); it++)
+    {
+        // A RAM section holds only the pages in its page map
+        unsigned long long data_len = it->size;
+        if (it->kind == cKindRAM)
+        {
+            if (it->page_map.size() != (it->size + cPageSize * 8 - 1) / (cPageSize * 8))
+                throw std::runtime_error("Snapshot page map is the wrong size for " + it->id);
+
+            data_len = 0;
+            for (unsigned int ofs = 0, page = 0; ofs < it->size; ofs += cPageSize, page++)
+            {
+                if ((it->page_map[page / 8] >> (page % 8)) & 1)
+                    data_len += std::min(cPageSize, it->size - ofs);
+            }
+        }
+
+        const unsigned char *data = base + it->offset;
+        std::vector<unsigned char> unpacked;
+        if (it->flags & cFlagPacked)
+        {
+            unpacked.resize((size_t)data_len);
+            if (!PackBits::Unpack(data, (size_t)it->length, unpacked.empty() ? NULL : &unpacked[0], unpacked.size()))
+                throw std::runtime_error("Snapshot is damaged");
+            data = unpacked.empty() ? NULL : &unpacked[0];
+        }
+        else if (it->length != data_len)
+            throw std::runtime_error("Snapshot is damaged");
+
+
+        if (it->kind == cKindRAM)
+        {
+            RAM *ram = dynamic_cast<RAM*>(FindDevice(mbee, it->id));
+            if (ram == NULL || ram->GetSize() != it->size)
+                throw std::runtime_error("Snapshot RAM doesn't match the configuration for " + it->id);
+
+            for (unsigned int ofs = 0, page = 0; ofs < it->size; ofs += cPageSize, page++)
+            {
+                const unsigned int len = std::min(cPageSize, it->size - ofs);
+                if ((it->page_map[page / 8] >> (page % 8)) & 1)
+                {
+                    memcpy(ram->memory + ofs, data, len);
+                    data += len;
+                }
+                else
+                    memset(ram->memory + ofs, 0, len);
+            }
+        }
+        else
+        {
+            MemoryStreamBuf buf(data, (size_t)data_len);
+            std::istream stream(&buf);
+            BinaryReader state_reader(stream);
+
+            if (it->kind == cKindState)
+                FindDevice(mbee, it->id)->RestoreState(state_reader);
+            else if (it->kind == cKindSchedule)
+                mbee.RestoreSchedule(state_reader);
+        }
+    }
+}
@@ -0,0 +1,69 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+class Microbee;
+
+
+/*! \brief Saves and restores a Microbee in a compact binary file
+ *
+ *  A snapshot holds the same state as Microbee::SaveState() but without the configuration, so it
+ *  can only be restored into a Microbee built from the same configuration.  It is much smaller
+ *  and faster to save and load than the XML, which is kept for interchange.
+ *
+ *  The file starts with a header and a table of sections, one for the state of each device, one
+ *  for each RAM device and one for the schedule, giving the offset and length of each section's
+ *  data.  All values are little-endian:
+ *
+ *    - Header: magic (8 bytes), version, page size, number of sections, flags (one DWord each)
+ *    - Section: kind (byte), flags (byte), id length (word), id, offset (QWord), stored length
+ *      (QWord), size (DWord), page map length (DWord) and page map
+ *
+ *  A RAM section only stores the pages that aren't all zero, with a bit in its page map for each
+ *  page that is stored.  Uncompressed RAM sections start on a page boundary of the file, so they
+ *  are copied in straight from the mapped file.  Devices that have no state (the ROMs) are left
+ *  out.  Sections may be compressed with PackBits, only when that makes them smaller.
+ */
+namespace Snapshot
+{
+    /*! \brief Saves \p mbee to \p filename, compressing the sections if \p compress is set
+     *
+     *  \p mbee must not be running (see Microbee::SaveSchedule()).
+     *
+     *  \throws std::runtime_error if the file can't be written
+     */
+    void Save(Microbee &mbee, const char *filename, bool compress);
+
+    //! Returns true if \p filename is a snapshot (as opposed to an XML state)
+    bool IsSnapshot(const char *filename);
+
+    /*! \brief Restores \p mbee from the snapshot in \p filename
+     *
+     *  Devices not in the snapshot are left as they are, so \p mbee should be reset first.
+     *
+     *  \throws std::runtime_error if the file isn't a snapshot of this configuration, or is damaged
+     */
+    void Restore(Microbee &mbee, const char *filename);
+}
+
+
+#endif // SNAPSHOT_H
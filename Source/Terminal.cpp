@@ -21,6 +21,14 @@
 #include "stdafx.h"
 #include "Terminal.h"
 
+#ifdef __WXOSX__
+#include <OpenGL/glu.h>
+#else
+#include <GL/glu.h>
+#endif
+
+#include "CRTCMemory.h"
+
 
 BEGIN_EVENT_TABLE(Terminal, wxWindow)
     EVT_KEY_DOWN(Terminal::OnKeyDown)
@@ -29,7 +37,9 @@ END_EVENT_TABLE()
 
 
 Terminal::Terminal(wxWindow *parent) : 
-    wxGLCanvas(parent, wxID_ANY, NULL, wxDefaultPosition, wxSize(width, height))
+    wxGLCanvas(parent, wxID_ANY, NULL, wxDefaultPosition, wxSize(width, height)),
+    gl_ctx(NULL),
+    renderer(cFrameBufferRenderer)
 {
     memset(keys, 0, cMaxKeyCode + 1);
 }
@@ -37,6 +47,7 @@ Terminal::Terminal(wxWindow *parent) :
 
 Terminal::~Terminal()
 {
+    delete gl_ctx;
 }
 
 
@@ -50,3 +61,163 @@ void Terminal::OnKeyUp(wxKeyEvent &evt)
 {
     keys[evt.GetKeyCode()] = false;
 }
+
+
+void Terminal::Render(const VideoFrame &frame, bool all)
+{
+    if (gl_ctx == NULL)
+    {
+        gl_ctx = new wxGLContext(this);  // Here because it's guaranteed to be in the context of the rendering thread
+        gl_ctx->SetCurrent(*this);
+        glMatrixMode(GL_PROJECTION);
+        glLoadIdentity();
+        gluOrtho2D(-0.5, width - 0.5, height - 0.5, -0.5);
+        glMatrixMode(GL_MODELVIEW);
+        glViewport(0, 0, width, height);
+        glColor3d(0.0, 1.0, 0.0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    }
+
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    switch (renderer)
+    {
+    case cFrameBufferRenderer:
+        DrawFrameBuffer(frame, all);
+        break;
+    case cAtlasRenderer:
+        glyph_atlas.Draw(frame, all);
+        break;
+    default:
+        DrawBitmaps(frame);
+        break;
+    }
+
+    glFlush();
+    SwapBuffers();
+}
+
+
+/*! Only the dirty cells are rendered into the frame buffer, but the whole of it is drawn.  It is
+    top row first, so it's drawn downwards from the top left corner.  Its pixels are greyscale, so
+    red and blue are scaled out to match the green of glBitmap().
+ */
+void Terminal::DrawFrameBuffer(const VideoFrame &frame, bool all)
+{
+    frame_buffer.Render(frame, all);
+    if (frame_buffer.Pixels() == NULL)
+        return;
+
+    glPixelTransferf(GL_RED_SCALE, 0.0f);
+    glPixelTransferf(GL_BLUE_SCALE, 0.0f);
+    glPixelZoom(1.0f, -1.0f);
+    glRasterPos2i(0, 0);
+
+    glDrawPixels(frame_buffer.Width(), frame_buffer.Height(), GL_LUMINANCE, GL_UNSIGNED_BYTE, frame_buffer.Pixels());
+
+    glPixelZoom(1.0f, 1.0f);
+    glPixelTransferf(GL_RED_SCALE, 1.0f);
+    glPixelTransferf(GL_BLUE_SCALE, 1.0f);
+}
+
+
+void Terminal::DrawBitmaps(const VideoFrame &frame)
+{
+    const word scans_per_row = frame.scans_per_row;
+    int cell = 0;
+
+    for (word i = 0; i < frame.rows; i++)
+    {
+        glRasterPos2i(0, (i+1) * scans_per_row - 1);
+        for (word j = 0; j < frame.cols; j++, cell++)
+        {
+            const unsigned char *bmp = frame.glyphs[cell];
+
+            if (cell == frame.cursor)
+            {
+                unsigned char cursor_bmp[CRTCMemory::cBitmapSize];
+
+                for (word k = 0; k < scans_per_row; k++)
+                {
+                    if ((scans_per_row - k - 1) >= frame.cursor_start && (scans_per_row - k - 1) <= frame.cursor_end)
+                        cursor_bmp[k] = bmp[k] ^ 0xFF;
+                    else
+                        cursor_bmp[k] = bmp[k];
+                }
+
+                bmp = cursor_bmp;
+            }
+
+            glBitmap(VideoFrame::cCharWidth, scans_per_row, 0.0, 0.0, VideoFrame::cCharWidth, 0.0, bmp);
+        }
+    }
+}
+
+
+const int Terminal::keymap[] =
+{
+    '\'',
+    'A',
+    'B',
+    'C',
+    'D',
+    'E',
+    'F',
+    'G',
+    'H',
+    'I',
+    'J',
+    'K',
+    'L',
+    'M',
+    'N',
+    'O',
+    'P',
+    'Q',
+    'R',
+    'S',
+    'T',
+    'U',
+    'V',
+    'W',
+    'X',
+    'Y',
+    'Z',
+    '[',
+    '\\',
+    ']',
+    '~',
+    WXK_DELETE,
+    '0',
+    '1',
+    '2',
+    '3',
+    '4',
+    '5',
+    '6',
+    '7',
+    '8',
+    '9',
+    ';',
+    '+',
+    ',',
+    '-',
+    '.',
+    '/',
+    WXK_ESCAPE,
+    WXK_BACK,
+    WXK_TAB,
+    WXK_NUMPAD_ENTER,     /* LF */
+    WXK_RETURN,
+    WXK_CAPITAL,
+    WXK_NUMPAD_ADD,       /* break */
+    WXK_SPACE,
+    WXK_F1,               /* 61 */
+    WXK_CONTROL,
+    WXK_F2,               /* 62 */
+    WXK_F5,               /* 65 */
+    WXK_F4,               /* 64 */
+    WXK_F3,               /* 63 */
+    WXK_F6,               /* 66 */
+    WXK_SHIFT
+};
\ No newline at end of file
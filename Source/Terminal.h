@@ -23,9 +23,14 @@
 #include <wx/glcanvas.h>
 #include <vector>
 
+#include "InputSource.h"
+#include "VideoSink.h"
+#include "FrameBuffer.h"
+#include "GlyphAtlas.h"
+
 
 /*! \brief Provides a frame for display of OpenGL graphics and captures key events for the emulator */
-class Terminal : public wxGLCanvas
+class Terminal : public wxGLCanvas, public InputSource
 {
 public:
     const static int width = 640;
@@ -37,11 +42,45 @@ public:
     void OnKeyDown(wxKeyEvent &evt);
     void OnKeyUp(wxKeyEvent &evt);
 
-    //! Returns true if the key \p keycode (wxWidgets specific) is currently pressed
-    bool IsPressed(const int keycode) const { return keys[keycode]; }
+    //! Returns true if the real key mapped to the Microbee key \p key is currently pressed
+    virtual bool IsPressed(int key) { return keys[keymap[key]]; }
+
+    //! Ways of drawing a frame
+    enum Renderer
+    {
+        cFrameBufferRenderer,  //!< Render into a FrameBuffer and draw it with one glDrawPixels()
+        cAtlasRenderer,  //!< Draw the cells from a GlyphAtlas texture with one glDrawArrays()
+        cBitmapRenderer  //!< Draw each character cell with glBitmap()
+    };
+
+    //! Selects how frames are drawn (cFrameBufferRenderer by default)
+    void SetRenderer(Renderer renderer_) { renderer = renderer_; }
+
+    /*! \brief Renders \p frame and presents it
+     *
+     *  \p all must be set if \p frame doesn't follow the last frame rendered (see
+     *  FrameBuffer::Render()).
+     *
+     *  \note The OpenGL context is created by the first call, and belongs to the calling thread.
+     *        All calls must be made from that thread.
+     */
+    void Render(const VideoFrame &frame, bool all);
 
 
 private:
+    wxGLContext *gl_ctx;  //!< OpenGL rendering context
+
+    Renderer renderer;
+    FrameBuffer frame_buffer;  //!< For cFrameBufferRenderer
+    GlyphAtlas glyph_atlas;  //!< For cAtlasRenderer
+
+    //! Draws \p frame for cFrameBufferRenderer
+    void DrawFrameBuffer(const VideoFrame &frame, bool all);
+    //! Draws \p frame for cBitmapRenderer
+    void DrawBitmaps(const VideoFrame &frame);
+
+    static const int keymap[];  //!< Mapping from emulated keys (see Keyboard::Key) to real keys
+
     static const unsigned int cMaxKeyCode = WXK_COMMAND;  // TODO: This is OK using wxWidgets v2.8.4...
     bool keys[cMaxKeyCode + 1];  //!< Current status of keys, using a plain old array for speed
 
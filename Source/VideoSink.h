@@ -0,0 +1,83 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VIDEOSINK_H
+#define VIDEOSINK_H
+
+#include <vector>
+
+
+/*! \brief Description of a frame of the display, as generated by the CRTC
+ *
+ *  The display is a grid of character cells.  Each cell has a bitmap of scans_per_row bytes
+ *  (at most CRTCMemory::cBitmapSize), one per scan line with the leftmost pixel in the most
+ *  significant bit.  The bitmaps are in the order that OpenGL uses them, i.e. the first byte
+ *  is the <em>bottom</em> scan line of the character.
+ *
+ *  The bitmaps point into the graphics memory, so they are only valid until the emulation
+ *  carries on.
+ *
+ *  Most frames are the same as the one before, so the CRTC marks which cells differ from the
+ *  last frame it generated.  A sink that keeps what it drew can redraw only the dirty cells, and
+ *  skip a frame that hasn't changed at all.  A sink that drops frames must redraw in full after
+ *  dropping one that had changed.
+ *
+ *  Each cell also has the index of its bitmap among all those the graphics memory holds (see
+ *  CRTCMemory::GetGlyphIndex()), so a sink can keep a copy of each bitmap rather than of each
+ *  cell.  The bitmaps that have been rewritten since the last frame are marked, whether they are
+ *  on screen or not.
+ */
+struct VideoFrame
+{
+    word cols;  //!< Characters per row
+    word rows;  //!< Character rows
+    word scans_per_row;  //!< Scan lines per character row
+
+    std::vector<byte> codes;  //!< Video RAM byte for each cell, row by row (bit 7 selects PCG RAM)
+    std::vector<const unsigned char *> glyphs;  //!< Bitmap for each cell, row by row
+    std::vector<word> glyph_ids;  //!< Index of the bitmap for each cell, row by row
+
+    int cursor;  //!< Index of the cell showing the cursor, or -1 if it isn't shown
+    word cursor_start;  //!< First scan line of the cursor (counting from the top)
+    word cursor_end;  //!< Last scan line of the cursor (counting from the top)
+
+    bool changed;  //!< False if the frame is the same as the last one (no cell is dirty and no bitmap has changed)
+    std::vector<byte> dirty;  //!< Non-zero for each cell that differs from the last frame, row by row
+    std::vector<byte> glyph_changed;  //!< Non-zero for each bitmap, by index, that has changed since the last frame
+
+    static const int cCharWidth = 8;  //!< Width of a character cell in pixels
+};
+
+
+/*! \brief Receives the display output of the emulated system
+ *
+ *  Implemented by the host to show frames on the screen, or record them when running without
+ *  a display.
+ */
+class VideoSink
+{
+public:
+    virtual ~VideoSink() {}
+
+    //! Called at the end of each frame the CRTC generates
+    virtual void ShowFrame(const VideoFrame &frame) = 0;
+};
+
+
+#endif // VIDEOSINK_H
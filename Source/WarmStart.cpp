@@ -0,0 +1,218 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "stdafx.h"
+#include "WarmStart.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include "utils/Hash.h"
+#include "Z80/Z80CPU.h"
+#include "CRTCMemory.h"
+
+
+WarmStart::WarmStart(Microbee &mbee_, const TiXmlElement &config_) :
+    mbee(mbee_),
+    z80(NULL),
+    check_pc(false),
+    pc(0),
+    crtc_mem(NULL),
+    timeout(cDefaultTimeoutMillis * (Microbee::cTicksPerSecond / 1000))
+{
+    const char *cache = config_.Attribute("cache");
+    if (cache == NULL)
+        throw ConfigError(&config_, "<warmstart> missing cache attribute");
+
+    const char *pc_attr = config_.Attribute("pc");
+    if (pc_attr != NULL)
+    {
+        std::istringstream pc_ss(pc_attr);
+        unsigned int p;
+        if (!(pc_ss >> std::hex >> p) || p > 0xFFFF)
+            throw ConfigError(&config_, "<warmstart> pc attribute must be an address in hex");
+        check_pc = true;
+        pc = p;
+    }
+
+    const char *text_attr = config_.Attribute("text");
+    if (text_attr != NULL)
+        text = text_attr;
+
+    if (!check_pc && text.empty())
+        throw ConfigError(&config_, "<warmstart> needs a pc or text attribute");
+
+    int millis;
+    if (config_.Attribute("timeout", &millis) != NULL)
+    {
+        if (millis <= 0)
+            throw ConfigError(&config_, "<warmstart> timeout attribute must be positive");
+        timeout = millis * (Microbee::cTicksPerSecond / 1000);
+    }
+
+
+    // Find the devices the milestone is checked on
+    const TiXmlElement &mbee_tag = mbee.GetConfig();
+    for (const TiXmlElement *el = mbee_tag.FirstChildElement("device"); el != NULL; el = el->NextSiblingElement("device"))
+    {
+        const std::string cls(el->Attribute("class"));
+        if (cls == "Z80CPU")
+            z80 = mbee.GetDevice<Z80CPU>(el->Attribute("id"));
+        else if (cls == "CRTCMemory" && crtc_mem == NULL)
+            crtc_mem = mbee.GetDevice<CRTCMemory>(el->Attribute("id"));
+    }
+
+    if (!text.empty() && crtc_mem == NULL)
+        throw ConfigError(&config_, "<warmstart> text attribute needs a CRTCMemory device");
+
+    if (check_pc)
+        z80->SetBreakpoint(pc);
+
+
+    Hash64 hash;
+    hash.AddNumber(cVersion);
+
+    TiXmlPrinter printer;
+    mbee_tag.Accept(&printer);
+    hash.Add(printer.Str());
+
+    HashFiles(mbee_tag, hash);
+
+    char name[32];
+    sprintf(name, "%016llx.nws", hash.Value());
+
+    path = mbee.GetConfigDir() + cache;
+    if (!path.empty() && path[path.length() - 1] != '/' && path[path.length() - 1] != '\\')
+        path += '/';
+    path += name;
+}
+
+
+WarmStart::~WarmStart()
+{
+    if (check_pc)
+        z80->ClearBreakpoint();
+}
+
+
+/*! The files are those named by filename and charrom attributes.
+ */
+void WarmStart::HashFiles(const TiXmlElement &el, Hash64 &hash)
+{
+    for (const TiXmlAttribute *attr = el.FirstAttribute(); attr != NULL; attr = attr->Next())
+    {
+        if (strcmp(attr->Name(), "filename") != 0 && strcmp(attr->Name(), "charrom") != 0)
+            continue;
+        if (*attr->Value() == '\0')
+            continue;
+
+        std::ifstream file((mbee.GetConfigDir() + attr->Value()).c_str(), std::ios::in | std::ios::binary);
+        if (!file.is_open())
+        {
+            hash.AddNumber(0);  // Missing, the system will fail to boot anyway
+            continue;
+        }
+
+        std::vector<char> buf(65536);
+        while (file.read(&buf[0], buf.size()) || file.gcount() > 0)
+            hash.Add(&buf[0], (size_t)file.gcount());
+    }
+
+    for (const TiXmlElement *child = el.FirstChildElement(); child != NULL; child = child->NextSiblingElement())
+        HashFiles(*child, hash);
+}
+
+
+/*! If the saved state can't be restored (e.g. a disk it names has gone), the system is reset so it
+    boots as if there were none.
+ */
+bool WarmStart::Restore()
+{
+    if (!std::ifstream(path.c_str()).is_open())
+        return false;
+
+    try
+    {
+        mbee.LoadState(path.c_str());
+        return true;
+    }
+    catch (std::exception &)
+    {
+        mbee.Reset();
+        return false;
+    }
+}
+
+
+/*! The state is saved to a temporary file first and then renamed into place, so another
+    instance never restores a partly written state.  A failure to save is ignored, the next boot
+    will just try again.
+ */
+bool WarmStart::Check()
+{
+    if (mbee.GetTime() >= timeout)
+        return true;
+
+    if (check_pc && !z80->BreakpointHit())
+        return false;
+    if (!text.empty() && !TextOnScreen())
+    {
+        if (check_pc)
+            z80->SetBreakpoint(pc);  // Wait for the next time it gets there
+        return false;
+    }
+
+    std::ostringstream tmp;
+    tmp << path << "." << (void *)this << ".tmp";
+
+    try
+    {
+        mbee.SaveSnapshot(tmp.str().c_str(), true);
+        if (std::rename(tmp.str().c_str(), path.c_str()) != 0)
+            std::remove(tmp.str().c_str());  // Windows won't replace, but another instance got there first
+    }
+    catch (std::exception &)
+    {
+        std::remove(tmp.str().c_str());
+    }
+
+    return true;
+}
+
+
+bool WarmStart::TextOnScreen()
+{
+    const word size = CRTCMemory::cVideoRAMSize;
+
+    for (word start = 0; start + text.length() <= size; start++)
+    {
+        word i = 0;
+        while (i < text.length() && crtc_mem->GetCharCode(start + i) == (byte)text[i])
+            i++;
+        if (i == text.length())
+            return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,92 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WARMSTART_H
+#define WARMSTART_H
+
+#include <string>
+#include "Microbee.h"
+
+class CRTCMemory;
+class Z80CPU;
+class Hash64;
+
+
+/*! \brief Skips booting by restoring a state saved after an earlier boot
+ *
+ *  Enabled by a <warmstart> element in the <microbee> configuration, e.g.
+ *
+ *  \code
+ *  <warmstart cache="Cache" text="A>" />
+ *  \endcode
+ *
+ *  When the system boots, its state is saved into the cache directory (relative to the
+ *  configuration, and it must already exist) as soon as the boot is done.  That is when the Z80's
+ *  PC reaches the pc attribute (hex), which stops the slice there (see Z80CPU::SetBreakpoint()),
+ *  and/or the text attribute is in the video RAM at the end of a slice.  With both, the PC must
+ *  reach pc while the text is there.  If the boot isn't done by timeout milliseconds of emulated
+ *  time (default 60000), nothing is saved.  Later the saved state is restored instead of booting.
+ *
+ *  Saved states are named by a hash of the configuration and the contents of every file it names,
+ *  so a change to any of them means a new boot.  They are saved as compressed snapshots (see
+ *  Snapshot.h).  Old states are never removed.  The state is only what the system does on its
+ *  own, so nothing should be typed before the boot is done.
+ */
+class WarmStart
+{
+public:
+    /*! \throws ConfigError if \p config_ (the <warmstart> element) is invalid
+     */
+    WarmStart(Microbee &mbee_, const TiXmlElement &config_);
+    ~WarmStart();
+
+    //! Restores the saved state if there is one, otherwise returns false and the system must boot
+    bool Restore();
+
+    //! Called at the end of each slice while booting, returns true once the state is saved (or never will be)
+    bool Check();
+
+private:
+    Microbee &mbee;
+    std::string path;  //!< File the state is saved in
+
+    Z80CPU *z80;  //!< For the pc attribute
+    bool check_pc;
+    word pc;
+
+    CRTCMemory *crtc_mem;  //!< For the text attribute, NULL if none
+    std::string text;
+
+    Microbee::time_t timeout;  //!< Emulation time after which the boot is given up on
+
+    static const int cDefaultTimeoutMillis = 60000;
+    static const unsigned int cVersion = 1;  //!< Part of the key, change when the saved state changes meaning
+
+    //! Returns true if the text is anywhere in the video RAM
+    bool TextOnScreen();
+
+    //! Hashes the contents of the files named in \p el and its children into \p hash
+    void HashFiles(const TiXmlElement &el, Hash64 &hash);
+
+    WarmStart(const WarmStart &);
+    WarmStart& operator= (const WarmStart &);
+};
+
+
+#endif // WARMSTART_H
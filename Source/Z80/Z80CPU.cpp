@@ -50,6 +50,10 @@
 #include "stdafx.h"
 #include "Z80CPU.h"
 
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+
 
 #define BR (R1.br)
 #define WR (R1.wr)
@@ -59,9 +63,9 @@
  * --------------------------------------------------------- 
  */
 
-#define SETFLAG(flag) (BR.F |= (flag))
-#define RESFLAG(flag) (BR.F &= ~(flag))
-#define GETFLAG(flag) ((BR.F & (flag)) != 0)
+#define SETFLAG(flag) (syncFlags(), BR.F |= (flag))
+#define RESFLAG(flag) (syncFlags(), BR.F &= ~(flag))
+#define GETFLAG(flag) ((syncFlags(), BR.F & (flag)) != 0)
 
 #define VALFLAG(flag,val) { if (val) SETFLAG(flag); else RESFLAG(flag); }
 
@@ -72,12 +76,12 @@
  */
 
 #define COND_    (true)
-#define COND_Z   (GETFLAG(F_Z))
-#define COND_NZ  (!GETFLAG(F_Z))
-#define COND_C   (GETFLAG(F_C))
-#define COND_NC  (!GETFLAG(F_C))
-#define COND_M   (GETFLAG(F_S))
-#define COND_P   (!GETFLAG(F_S))
+#define COND_Z   (flagZ())
+#define COND_NZ  (!flagZ())
+#define COND_C   (flagC())
+#define COND_NC  (!flagC())
+#define COND_M   (flagS())
+#define COND_P   (!flagS())
 #define COND_PE  (GETFLAG(F_PV))
 #define COND_PO  (!GETFLAG(F_PV))
 
@@ -97,6 +101,24 @@
  */ 
 void Z80CPU::write8 (ushort addr, byte val)
 {
+    byte *page = write_page[addr >> PageShift];
+    if (page != NULL)
+    {
+        page[addr & (PageSize - 1)] = val;
+        return;
+    }
+
+    if (!page_blocks[addr >> PageShift].empty())
+    {
+        // Writing over cached code
+        if (page_invalidations[addr >> PageShift] < 255)
+            page_invalidations[addr >> PageShift]++;
+        InvalidatePage(addr >> PageShift);
+        write8(addr, val);
+        return;
+    }
+
+    device_writes++;
     HandlerEntry& he = mem_handlers[addr / mem_block_size];
     he.handler.mem->Write(addr - he.base, val);
 }
@@ -111,6 +133,10 @@ void Z80CPU::write16 (ushort addr, ushort val)
 
 byte Z80CPU::read8 (ushort addr)
 {
+    const byte *page = read_page[addr >> PageShift];
+    if (page != NULL)
+        return page[addr & (PageSize - 1)];
+
     HandlerEntry& he = mem_handlers[addr / mem_block_size];
     return he.handler.mem->Read(addr - he.base);
 }
@@ -122,17 +148,49 @@ Z80CPU::ushort Z80CPU::read16 (ushort addr)
 }
 
 
+// Versions of read8() and write8() for use when every page has direct pointers (see direct_map)
+inline byte Z80CPU::readDirect (ushort addr)
+{
+    return read_page[addr >> PageShift][addr & (PageSize - 1)];
+}
+
+
+inline void Z80CPU::writeDirect (ushort addr, byte val)
+{
+    write_page[addr >> PageShift][addr & (PageSize - 1)] = val;
+}
+
+
+inline Z80CPU::ushort Z80CPU::readDirect16 (ushort addr)
+{
+    return ((ushort)readDirect(addr) | (readDirect(addr + 1) << 8));
+}
+
+
+inline void Z80CPU::writeDirect16 (ushort addr, ushort val)
+{
+    writeDirect(addr, (byte)(val & 0xFF));
+    writeDirect(addr + 1, (byte)((val >> 8) & 0xFF));
+}
+
+
 byte Z80CPU::ioRead (ushort addr)
 {
     addr &= 0xFF;
     HandlerEntry& he = port_handlers[addr / port_block_size];
-    return he.handler.port->PortRead(addr - he.base);
+    const byte val = he.handler.port->PortRead(addr - he.base);
+
+    if (idle_skip)
+        CheckIdle(val, he.handler.port->PortStableUntil(addr - he.base));
+
+    return val;
 }
 
 
 void Z80CPU::ioWrite (ushort addr, byte val)
 {
     addr &= 0xFF;
+    device_writes++;
     HandlerEntry& he = port_handlers[addr / port_block_size];
     he.handler.port->PortWrite(addr - he.base, val);
 }
@@ -164,6 +222,10 @@ int Z80CPU::parityBit[256] =
 };
 
 
+// Flag tables generated by codegen/mktables: sz53pTable, incTable, decTable, addTable, subTable and daaTable
+#include "codegen/flags_table.c"
+
+
 void Z80CPU::adjustFlags (byte val)
 {
 	VALFLAG(F_5, (val & F_5) != 0);
@@ -173,23 +235,85 @@ void Z80CPU::adjustFlags (byte val)
 
 void Z80CPU::adjustFlagSZP (byte val)
 {
-	VALFLAG(F_S, (val & 0x80) != 0);
-	VALFLAG(F_Z, (val == 0));
-	VALFLAG(F_PV, parityBit[val]);
+    syncFlags();
+    BR.F = (BR.F & ~(F_S | F_Z | F_PV)) | (sz53pTable[val] & (F_S | F_Z | F_PV));
 }
 
 
-// Adjust flags after AND, OR, XOR
-void Z80CPU::adjustLogicFlag (int flagH)
+/* ---------------------------------------------------------
+ *  Lazy flags
+ * --------------------------------------------------------- 
+ *
+ * The common ALU operations don't update F, they just record their operands in lazy_flags.
+ * The flags are worked out by evalFlags() when something next needs them, which is often
+ * never, since the following ALU operation will replace them.
+ */
+
+void Z80CPU::evalFlags ()
 {
-    VALFLAG(F_S, (BR.A & 0x80) != 0);
-    VALFLAG(F_Z, (BR.A == 0));
-    VALFLAG(F_H, flagH);
-    VALFLAG(F_N, 0);
-    VALFLAG(F_C, 0);
-    VALFLAG(F_PV, parityBit[BR.A]);
+    switch (lazy_flags.op)
+    {
+    case LF_ADD:
+        BR.F = addTable[(lazy_flags.carry << 16) | (lazy_flags.a << 8) | lazy_flags.value];
+        break;
+
+    case LF_SUB:
+        BR.F = subTable[(lazy_flags.carry << 16) | (lazy_flags.a << 8) | lazy_flags.value];
+        break;
+
+    case LF_CP:
+        BR.F = (subTable[(lazy_flags.a << 8) | lazy_flags.value] & ~(F_5 | F_3)) | (lazy_flags.value & (F_5 | F_3));
+        break;
+
+    case LF_INC:
+        BR.F = (BR.F & F_C) | incTable[lazy_flags.value] | (lazy_flags.a & (F_5 | F_3));
+        break;
+
+    case LF_DEC:
+        BR.F = (BR.F & F_C) | decTable[lazy_flags.value] | (lazy_flags.a & (F_5 | F_3));
+        break;
 
-    adjustFlags(BR.A);
+    case LF_AND:
+        BR.F = sz53pTable[lazy_flags.res] | F_H;
+        break;
+
+    case LF_OR:
+        BR.F = sz53pTable[lazy_flags.res];
+        break;
+    }
+
+    lazy_flags.op = LF_NONE;
+}
+
+
+inline bool Z80CPU::flagZ ()
+{
+    return lazy_flags.op != LF_NONE ? lazy_flags.res == 0 : (BR.F & F_Z) != 0;
+}
+
+
+inline bool Z80CPU::flagS ()
+{
+    return lazy_flags.op != LF_NONE ? (lazy_flags.res & 0x80) != 0 : (BR.F & F_S) != 0;
+}
+
+
+inline bool Z80CPU::flagC ()
+{
+    switch (lazy_flags.op)
+    {
+    case LF_ADD:
+        return lazy_flags.a + lazy_flags.value + lazy_flags.carry > 0xFF;
+    case LF_SUB:
+        return lazy_flags.a < lazy_flags.value + lazy_flags.carry;
+    case LF_CP:
+        return lazy_flags.a < lazy_flags.value;
+    case LF_AND:
+    case LF_OR:
+        return false;
+    default:
+        return (BR.F & F_C) != 0;  // Up to date, or preserved by INC/DEC
+    }
 }
 
 
@@ -202,56 +326,56 @@ void Z80CPU::adjustLogicFlag (int flagH)
 /** Do an arithmetic operation (ADD, SUB, ADC, SBC y CP) */
 byte Z80CPU::doArithmetic (byte value, int withCarry, int isSub)
 {
-	ushort res; /* To detect carry */
-    ushort carry;
+    byte carry;
 
-    if (withCarry && GETFLAG(F_C))
+    if (withCarry && flagC())
         carry = 1;
     else
         carry = 0;
 
-	if (isSub)
-	{
-		res = BR.A - value - carry;
-		SETFLAG(F_N);
-		VALFLAG(F_H, (((BR.A & 0x0F) - (value & 0x0F) - carry) & 0x10) != 0);
-	    VALFLAG(F_PV, (((BR.A & 0x80) != (value & 0x80)) && ((BR.A & 0x80) != (res & 0x80))) != 0);
-	}
-	else
-	{
-		res = BR.A + value + carry;
-		RESFLAG(F_N);
-		VALFLAG(F_H, (((BR.A & 0x0F) + (value & 0x0F) + carry) & 0x10) != 0);
-	    VALFLAG(F_PV, (((BR.A & 0x80) == (value & 0x80)) && ((BR.A & 0x80) != (res & 0x80))) != 0);
-	}
-	VALFLAG(F_S, ((res & 0x80) != 0));
-	VALFLAG(F_C, ((res & 0x100) != 0));
-	VALFLAG(F_Z, ((res & 0xFF) == 0));
+    // All of F is replaced, so any pending flags can be dropped
+    lazy_flags.op = isSub ? LF_SUB : LF_ADD;
+    lazy_flags.a = BR.A;
+    lazy_flags.value = value;
+    lazy_flags.carry = carry;
+    lazy_flags.res = isSub ? BR.A - value - carry : BR.A + value + carry;
+
+    return lazy_flags.res;
+}
 
-	adjustFlags(BR.A);
 
-	return (byte)(res & 0xFF);
+//! As SUB, except that A is left alone and 5 and 3 are copied from \p value
+void Z80CPU::doCP (byte value)
+{
+    lazy_flags.op = LF_CP;
+    lazy_flags.a = BR.A;
+    lazy_flags.value = value;
+    lazy_flags.carry = 0;
+    lazy_flags.res = BR.A - value;
 }
 
 
 void Z80CPU::doAND (byte value)
 {
 	BR.A &= value;
-	adjustLogicFlag(1);
+    lazy_flags.op = LF_AND;
+    lazy_flags.res = BR.A;
 }
 
 
 void Z80CPU::doOR (byte value)
 {
 	BR.A |= value;
-	adjustLogicFlag(0);
+    lazy_flags.op = LF_OR;
+    lazy_flags.res = BR.A;
 }
 
 
 void Z80CPU::doXOR (byte value)
 {
 	BR.A ^= value;
-	adjustLogicFlag(0);
+    lazy_flags.op = LF_OR;  // Same flags as OR
+    lazy_flags.res = BR.A;
 }
 
 
@@ -292,127 +416,95 @@ byte Z80CPU::doSetRes (int bit, int pos, byte val)
 
 byte Z80CPU::doIncDec (byte val, int isDec)
 {
-    if (isDec)
+    syncFlags();  // C is preserved, so the previous flags are needed
+
+    lazy_flags.op = isDec ? LF_DEC : LF_INC;
+    lazy_flags.a = BR.A;
+    lazy_flags.value = val;
+    lazy_flags.res = isDec ? val - 1 : val + 1;
+
+    return lazy_flags.res;
+}
+
+
+/* The rotates and shifts set C from the bit shifted out, 5 and 3 from the result and reset
+ * H and N.  If adjFlags is set (always for the shifts), S, Z and P/V are set from the result,
+ * otherwise they are preserved.
+ */
+void Z80CPU::adjustShiftFlags (int adjFlags, byte val, byte carry)
+{
+    if (adjFlags)
     {
-        VALFLAG(F_PV, val == 128);  // val is unsigned, but considering signed overflow.  128u = -128s
-        val--;
-        VALFLAG(F_H, (val & 0x0F) == 0x0F);
+        lazy_flags.op = LF_NONE;  // All of F is replaced
+        BR.F = sz53pTable[val] | carry;
     }
     else
     {
-        VALFLAG(F_PV, val == 127);
-        val++;
-        VALFLAG(F_H, (val & 0x0F) == 0);
+        syncFlags();
+        BR.F = (BR.F & (F_S | F_Z | F_PV)) | (val & (F_5 | F_3)) | carry;
     }
-
-    VALFLAG(F_S, ((val & 0x80) != 0));
-    VALFLAG(F_Z, (val == 0));
-    VALFLAG(F_N, isDec);
-
-    adjustFlags(BR.A);
-
-    return val;
 }
 
 
 byte Z80CPU::doRLC (int adjFlags, byte val)
 {
-    VALFLAG(F_C, (val & 0x80) != 0);
-    val <<= 1;
-    if (GETFLAG(F_C))
-        val |= 0x01;
-
-    adjustFlags(val);
-    RESFLAG(F_H | F_N);
-
-    if (adjFlags)
-        adjustFlagSZP(val);
+    const byte carry = val >> 7;
+    val = (val << 1) | carry;
 
+    adjustShiftFlags(adjFlags, val, carry);
     return val;
 }
 
 
 byte Z80CPU::doRL (int adjFlags, byte val)
 {
-    int CY = GETFLAG(F_C);
-    VALFLAG(F_C, (val & 0x80) != 0);
-    val <<= 1;
-    val |= (byte)CY;
-
-    adjustFlags(val);
-    RESFLAG(F_H | F_N);
-
-    if (adjFlags)
-        adjustFlagSZP(val);
+    const byte carry = val >> 7;
+    val = (val << 1) | (flagC() ? 1 : 0);
 
+    adjustShiftFlags(adjFlags, val, carry);
     return val;
 }
 
 
 byte Z80CPU::doRRC (int adjFlags, byte val)
 {
-    VALFLAG(F_C, (val & 0x01) != 0);
-    val >>= 1;
-    if (GETFLAG(F_C))
-        val |= 0x80;
-
-    adjustFlags(val);
-    RESFLAG(F_H | F_N);
-
-    if (adjFlags)
-        adjustFlagSZP(val);
+    const byte carry = val & 0x01;
+    val = (val >> 1) | (carry << 7);
 
+    adjustShiftFlags(adjFlags, val, carry);
     return val;
 }
 
 
 byte Z80CPU::doRR (int adjFlags, byte val)
 {
-    int CY = GETFLAG(F_C);
-    VALFLAG(F_C, (val & 0x01));
-    val >>= 1;
-    val |= (CY << 7);
-
-    adjustFlags(val);
-    RESFLAG(F_H | F_N);
-
-    if (adjFlags)
-        adjustFlagSZP(val);
+    const byte carry = val & 0x01;
+    val = (val >> 1) | (flagC() ? 0x80 : 0);
 
+    adjustShiftFlags(adjFlags, val, carry);
     return val;
 }
 
 
 byte Z80CPU::doSL (byte val, int isArith)
 {
-    VALFLAG(F_C, (val & 0x80) != 0);
+    const byte carry = val >> 7;
     val <<= 1;
 
     if (!isArith)
         val |= 1;
 
-    adjustFlags(val);
-    RESFLAG(F_H | F_N);
-    adjustFlagSZP(val);
-
+    adjustShiftFlags(1, val, carry);
     return val;
 }
 
 
 byte Z80CPU::doSR (byte val, int isArith)
 {
-    byte b = val & 0x80;
-
-    VALFLAG(F_C, (val & 0x01) != 0);
-    val >>= 1;
-
-    if (isArith)
-        val |= b;
-
-    adjustFlags(val);
-    RESFLAG(F_H | F_N);
-    adjustFlagSZP(val);
+    const byte carry = val & 0x01;
+    val = (val >> 1) | (isArith ? val & 0x80 : 0);
 
+    adjustShiftFlags(1, val, carry);
     return val;
 }
 
@@ -437,65 +529,209 @@ Z80CPU::ushort Z80CPU::doPop ()
 
 void Z80CPU::doDAA ()
 {
-    byte lnib = BR.A & 0x0F;
+    syncFlags();
 
-    if (GETFLAG(F_N))
-    {
-        // Last op was subtract
+    const ushort af = daaTable[(((BR.F & F_H) ? 4 : 0) | (BR.F & (F_N | F_C))) << 8 | BR.A];
+    BR.A = af >> 8;
+    BR.F = af & 0xFF;
+}
 
-        if (BR.A >= 0x9A)
-            SETFLAG(F_C);  // A decimal borrow occurred
 
-        // Adjust the high nibble if a (decimal or hex) borrow occurred
-        if (GETFLAG(F_C))  // Carry can be set above or by a previous instruction
-            BR.A -= 0x60;
+/* Interrupts aren't emulated, so rather than wait for one HALT waits out the rest of the time
+ * slice (when the other devices run) as the NOPs that a halted Z80 executes, then carries on.
+ */
+void Z80CPU::doHALT ()
+{
+    if (idle_skip)
+        SkipIterations(opcodes_main.entries[0x76].cycles, 1, emu_time);
+}
 
-        // Low nibble
-        // If nibble is less than/equal to 9 and there was no half carry then everything is OK,
-        // otherwise an adjustment must be made.
-        if (lnib > 9 || GETFLAG(F_H))
-        {
-            // Half carry flag is set according to whether the *adjustment* caused a carry
-            // If this point is reached with H clear then the nibble must be greater than 9
-            // so it will stay clear, hence there is no need to explicitly set the flag only
-            // to reset it in certain cases.
-            if (lnib >= 0x06)
-                RESFLAG(F_H);
-            BR.A -= 0x06;
-        }
+
+/* ---------------------------------------------------------
+ *  Repeating block instructions
+ * --------------------------------------------------------- 
+ */
+
+/* LDIR and friends repeat by moving PC back onto themselves, so each iteration costs a full
+ * dispatch.  Their bodies call these to run as many iterations as the remaining cycles allow
+ * in one go.  Each iteration still costs RepeatCycles and increments R, so the end result is
+ * the same as one at a time.
+ *
+ * dir is 1 for the incrementing instructions and -1 for the decrementing ones.
+ */
+
+//! Returns how many more iterations, up to \p count, fit in the cycles left besides the one in progress
+unsigned int Z80CPU::repeatBudget (unsigned int count)
+{
+    // The instruction is fetched again after each iteration, so it needs to be somewhere we can check
+    const ushort addr = PC - 2;
+    if (cycles <= RepeatCycles || read_page[addr >> PageShift] == NULL || read_page[(ushort)(addr + 1) >> PageShift] == NULL)
+        return 0;
+
+    return std::min(count, (unsigned int)(cycles - 1) / RepeatCycles);
+}
+
+
+//! Returns true if the instruction being repeated, ED \p opcode, is still there to be fetched again
+bool Z80CPU::repeatIntact (byte opcode)
+{
+    const ushort addr = PC - 2;
+    return read_page[addr >> PageShift] != NULL && read_page[(ushort)(addr + 1) >> PageShift] != NULL &&
+        readDirect(addr) == 0xED && readDirect(addr + 1) == opcode;
+}
+
+
+/* Runs the iterations before the last, which is left to the body to set the flags.  The
+ * copying is done a page at a time while the source and destination are plain memory.  Writes
+ * to pages holding cached code (write_page is NULL) are left to the body so that the cache is
+ * invalidated.
+ */
+void Z80CPU::doRepeatLD (int dir)
+{
+    unsigned int n = repeatBudget((WR.BC != 0 ? WR.BC : 0x10000) - 1);
+    if (n == 0)
+        return;
+
+    // Storage holding this instruction, which mustn't be overwritten by the skipped iterations
+    const byte *op[2];
+    for (int i = 0; i < 2; i++)
+    {
+        const ushort addr = PC - 2 + i;
+        op[i] = read_page[addr >> PageShift] + (addr & (PageSize - 1));
     }
-    else
+
+    while (n > 0)
     {
-        // Last op was add
+        byte *src_page = read_page[WR.HL >> PageShift];
+        byte *dst_page = write_page[WR.DE >> PageShift];
+        if (src_page == NULL || dst_page == NULL)
+            break;
+
+        // Stop at the end of whichever page ends first
+        const unsigned int src_off = WR.HL & (PageSize - 1);
+        const unsigned int dst_off = WR.DE & (PageSize - 1);
+        unsigned int chunk = std::min(n, dir > 0 ? PageSize - src_off : src_off + 1);
+        chunk = std::min(chunk, dir > 0 ? PageSize - dst_off : dst_off + 1);
+
+        const byte *src = src_page + src_off;  // First byte copied
+        byte *dst = dst_page + dst_off;
+        for (int i = 0; i < 2; i++)
+        {
+            if (dir > 0 && op[i] >= dst && op[i] < dst + chunk)
+                chunk = op[i] - dst;
+            else if (dir < 0 && op[i] <= dst && op[i] > dst - chunk)
+                chunk = dst - op[i];
+        }
 
-        // Low nibble
-        // If nibble is less than/equal to 9 and there was no half carry then everything is OK,
-        // otherwise an adjustment must be made.
-        if (lnib > 9)
+        if (chunk == 0)
+            break;
+
+        if (dir > 0)
         {
-            BR.A += 0x06;
-            SETFLAG(F_H);  // Half carry flag is set according to whether the *adjustment* caused a carry
-            if (BR.A < 0x06)
-                SETFLAG(F_C);
+            // Overlapping so that each byte copied is copied again replicates the start of the source
+            if (dst == src + 1)
+                memset(dst, *src, chunk);
+            else if (dst > src && dst < src + chunk)
+                for (unsigned int i = 0; i < chunk; i++)
+                    dst[i] = src[i];
+            else
+                memmove(dst, src, chunk);
         }
-        else if (GETFLAG(F_H))
+        else
         {
-            BR.A += 0x06;
-            RESFLAG(F_H);  // Half carry flag is set according to whether the *adjustment* caused a carry
+            if (dst == src - 1)
+                memset(dst - chunk + 1, *src, chunk);
+            else if (dst < src && dst > src - chunk)
+                for (unsigned int i = 0; i < chunk; i++)
+                    *(dst - i) = *(src - i);
+            else
+                memmove(dst - chunk + 1, src - chunk + 1, chunk);
         }
 
-        // High nibble
-        // Same again but with high nibble and full carry.  Note that the adjustment of the
-        // Low nibble may have altered the high nibble so this must be done second.
-        if ((BR.A >> 4) > 9 || GETFLAG(F_C))
+        WR.HL += dir * (int)chunk;
+        WR.DE += dir * (int)chunk;
+        WR.BC -= chunk;
+        n -= chunk;
+        cycles -= (int)chunk * RepeatCycles;
+        R += chunk;
+    }
+}
+
+
+//! Skips the iterations before the byte matching A (or the last), a page at a time
+void Z80CPU::doRepeatCP (int dir)
+{
+    unsigned int n = repeatBudget((WR.BC != 0 ? WR.BC : 0x10000) - 1);
+
+    while (n > 0)
+    {
+        const byte *page = read_page[WR.HL >> PageShift];
+        if (page == NULL)
+            break;
+
+        const unsigned int off = WR.HL & (PageSize - 1);
+        const unsigned int chunk = std::min(n, dir > 0 ? PageSize - off : off + 1);
+        unsigned int skip;
+        if (dir > 0)
+        {
+            const byte *match = (const byte *)memchr(page + off, BR.A, chunk);
+            skip = match != NULL ? (unsigned int)(match - (page + off)) : chunk;
+        }
+        else
         {
-            BR.A += 0x60;
-            SETFLAG(F_C);
+            for (skip = 0; skip < chunk && page[off - skip] != BR.A; skip++)
+                ;
         }
+
+        WR.HL += dir * (int)skip;
+        WR.BC -= skip;
+        n -= skip;
+        cycles -= (int)skip * RepeatCycles;
+        R += skip;
+
+        if (skip < chunk)
+            break;  // The match ends the instruction, so it's left to the body
     }
+}
 
-    adjustFlagSZP(BR.A);
-	adjustFlags(BR.A);
+
+/* The port accesses can't be batched, and may remap memory, so these run whole iterations
+ * after the body has run the first, checking that the instruction is still there before each.
+ * This saves the dispatch, and the devices see the same cycle count at each access.
+ */
+void Z80CPU::doRepeatIN (int dir)
+{
+    unsigned int n = repeatBudget(BR.B);
+    const byte opcode = dir > 0 ? 0xB2 : 0xBA;
+
+    while (n-- > 0 && repeatIntact(opcode))
+    {
+        cycles -= RepeatCycles;  // For the previous iteration
+        R++;
+
+        if (dir > 0)
+            INI();
+        else
+            IND();
+    }
+}
+
+
+void Z80CPU::doRepeatOUT (int dir)
+{
+    unsigned int n = repeatBudget(BR.B);
+    const byte opcode = dir > 0 ? 0xB3 : 0xBB;
+
+    while (n-- > 0 && repeatIntact(opcode))
+    {
+        cycles -= RepeatCycles;  // For the previous iteration
+        R++;
+
+        if (dir > 0)
+            OUTI();
+        else
+            OUTD();
+    }
 }
 
 #include "codegen/opcodes_impl.c"
@@ -506,14 +742,56 @@ void Z80CPU::doDAA ()
  * --------------------------------------------------------- 
  */ 
 
-Microbee::time_t Z80CPU::Execute(Microbee::time_t time, Microbee::time_t micros)
+/*! Instructions are decoded by the nested switch generated into codegen/opcodes_switch.c, which
+ *  has each opcode body expanded at its case label.  Defining Z80_TABLE_DISPATCH selects the
+ *  original decoder instead, which walks the opcode tables and calls each opcode through a
+ *  member function pointer.  The two are interchangeable and are kept for comparison.
+ *
+ *  The decoder is instantiated twice by ExecuteLoop(): once for memory maps in which every page
+ *  is plain memory (see direct_map), and once for everything else.
+ */
+Microbee::time_t Z80CPU::Execute(Microbee::time_t time, Microbee::time_t ticks)
 {
-    emu_time = time + micros;  // Time once we're done
-    cycles += micros * freq / 1000000;  // Number of cycles to execute (+= because last loop may have executed too much)
+    const Microbee::time_t run = ticks + part_cycle;
+    part_cycle = run % ticks_per_cycle;
+    emu_time = time + ticks - part_cycle;  // Time once we're done
+    cycles += (int)(run / ticks_per_cycle);  // Number of cycles to execute (+= because last loop may have executed too much)
+    idle.pc = MemSize;  // The other devices have run since
+    breakpoint_hit = false;
 
 
-    while (cycles > 0)
+    while (cycles > 0 && !breakpoint_hit)
     {
+        if (direct_map && (!block_cache || breakpoint >= 0))
+            ExecuteLoop<true>();
+        else
+            ExecuteLoop<false>();
+    }
+
+    syncFlags();  // Leave F valid for anything inspecting the registers
+
+    return 0;  // Run again at next available opportunity
+}
+
+
+/*! With \p Direct set, the opcodes access memory straight through the page table without
+ *  checking for pages that need a handler, and the loop returns as soon as the memory map
+ *  changes so that this is no longer valid.
+ */
+template <bool Direct>
+void Z80CPU::ExecuteLoop()
+{
+#define read8(addr) (Direct ? readDirect(addr) : read8(addr))
+#define write8(addr, val) (Direct ? writeDirect(addr, val) : write8(addr, val))
+#define read16(addr) (Direct ? readDirect16(addr) : read16(addr))
+#define write16(addr, val) (Direct ? writeDirect16(addr, val) : write16(addr, val))
+
+    while (cycles > 0 && (!Direct || direct_map))
+    {
+        if (!Direct && block_cache && breakpoint < 0 && PageCacheable(PC >> PageShift) && ExecuteBlock())
+            continue;
+
+#ifdef Z80_TABLE_DISPATCH
 	    Z80OpcodeTable *current = &opcodes_main;
 	    Z80OpcodeEntry *entries = current->entries;
 	    Z80OpcodeFunc func;
@@ -550,9 +828,648 @@ Microbee::time_t Z80CPU::Execute(Microbee::time_t time, Microbee::time_t micros)
 
         R++;  // Memory refresh reg; emulated behaviour is not totally correct
         cycles -= entries[opcode].cycles;
+#else
+#include "codegen/opcodes_switch.c"
+
+        R++;  // Memory refresh reg; emulated behaviour is not totally correct
+#endif
+
+        if (PC == breakpoint)
+        {
+            breakpoint = -1;
+            breakpoint_hit = true;
+            break;
+        }
     }
 
-    return 0;  // Run again at next available opportunity
+#undef read8
+#undef write8
+#undef read16
+#undef write16
+}
+
+
+/* ---------------------------------------------------------
+ *  Block cache
+ * --------------------------------------------------------- 
+ */ 
+
+inline bool Z80CPU::TestCondition(byte cond)
+{
+    switch (cond)
+    {
+    case DO_NZ:  return COND_NZ;
+    case DO_Z:   return COND_Z;
+    case DO_NC:  return COND_NC;
+    case DO_C:   return COND_C;
+    case DO_PO:  return COND_PO;
+    case DO_PE:  return COND_PE;
+    case DO_P:   return COND_P;
+    case DO_M:   return COND_M;
+    default:     return true;
+    }
+}
+
+
+/*! Execution carries on into the block at the new PC until the cycles run out or there is no
+ *  block that can be cached there.  A block is left part way through if an instruction
+ *  invalidates cached code (which may include the block being executed), and execution resumes
+ *  from a new block at PC.  If a block has been compiled, the native code runs first and the
+ *  remaining ops (if any) are interpreted.
+ *
+ *  The inline kinds do exactly what the handlers of their instructions do, but with the operands
+ *  decoded in advance.  PC, the cycles and R are only brought up to date before the ops which
+ *  may look at them (those which call a handler or access memory, which may be a device), and
+ *  at the end.
+ */
+bool Z80CPU::ExecuteBlock()
+{
+    Z80Block *block = FindBlock(PC);
+    if (block == NULL)
+        return false;
+
+    int left = cycles;  // Cycles left once the ops run so far are accounted for
+    byte pending_r = 0;
+
+    #define REG8(i) (((byte *)&R1)[i])
+    #define REG16(i) (((ushort *)&R1)[i])
+
+    // Plain memory is accessed directly, as in ExecuteLoop<true>()
+    #define read8(addr) (read_page[(addr) >> PageShift] != NULL ? readDirect(addr) : read8(addr))
+    #define write8(addr, val) (write_page[(addr) >> PageShift] != NULL ? writeDirect(addr, val) : write8(addr, val))
+
+    do
+    {
+        const unsigned long generation = code_generation;
+        const Z80DecodedOp *op = &block->ops[0];
+        const Z80DecodedOp *end = op + block->ops.size();
+
+        if (jit)
+        {
+            if (block->native == NULL && ++block->executions == JITThreshold)
+                CompileBlock(block);
+
+            if (block->native != NULL)
+            {
+                // The native code stops under the same conditions as the loop below
+                cycles = left;
+                R += pending_r;
+                pending_r = 0;
+
+                op += block->native(this);
+                left = cycles;
+                if (generation != code_generation)
+                    continue;
+            }
+        }
+
+        for (; op != end && left > 0; op++)
+        {
+            const int op_cycles = op->cycles;
+
+            if (op->kind < DO_FIRST_MEMORY)
+            {
+                switch (op->kind)
+                {
+                case DO_LD_R_R:    REG8(op->dst) = REG8(op->src); break;
+                case DO_LD_R_N:    REG8(op->dst) = (byte)op->imm; break;
+                case DO_LD_RR_NN:  REG16(op->dst) = op->imm; break;
+                case DO_INC_RR:    ++REG16(op->dst); break;
+                case DO_DEC_RR:    --REG16(op->dst); break;
+                case DO_EX_DE_HL:  { const ushort tmp = WR.DE; WR.DE = WR.HL; WR.HL = tmp; } break;
+                case DO_INC_R:     REG8(op->dst) = doIncDec(REG8(op->dst), ID_INC); break;
+                case DO_DEC_R:     REG8(op->dst) = doIncDec(REG8(op->dst), ID_DEC); break;
+
+                case DO_ADD_R:     BR.A = doArithmetic(REG8(op->src), F1_ADD, F2_ADD); break;
+                case DO_ADC_R:     BR.A = doArithmetic(REG8(op->src), F1_ADC, F2_ADC); break;
+                case DO_SUB_R:     BR.A = doArithmetic(REG8(op->src), F1_SUB, F2_SUB); break;
+                case DO_SBC_R:     BR.A = doArithmetic(REG8(op->src), F1_SBC, F2_SBC); break;
+                case DO_AND_R:     doAND(REG8(op->src)); break;
+                case DO_XOR_R:     doXOR(REG8(op->src)); break;
+                case DO_OR_R:      doOR(REG8(op->src)); break;
+                case DO_CP_R:      doCP(REG8(op->src)); break;
+
+                case DO_ADD_N:     BR.A = doArithmetic((byte)op->imm, F1_ADD, F2_ADD); break;
+                case DO_ADC_N:     BR.A = doArithmetic((byte)op->imm, F1_ADC, F2_ADC); break;
+                case DO_SUB_N:     BR.A = doArithmetic((byte)op->imm, F1_SUB, F2_SUB); break;
+                case DO_SBC_N:     BR.A = doArithmetic((byte)op->imm, F1_SBC, F2_SBC); break;
+                case DO_AND_N:     doAND((byte)op->imm); break;
+                case DO_XOR_N:     doXOR((byte)op->imm); break;
+                case DO_OR_N:      doOR((byte)op->imm); break;
+                case DO_CP_N:      doCP((byte)op->imm); break;
+
+                case DO_RLCA:      BR.A = doRLC(0, BR.A); break;
+                case DO_RRCA:      BR.A = doRRC(0, BR.A); break;
+                case DO_RLA:       BR.A = doRL(0, BR.A); break;
+                case DO_RRA:       BR.A = doRR(0, BR.A); break;
+
+                case DO_JP:
+                case DO_JR:        PC = TestCondition(op->src) ? op->imm : op->pc + op->length; break;
+                case DO_DJNZ:      PC = --BR.B != 0 ? op->imm : op->pc + op->length; break;
+                }
+
+                left -= op_cycles;
+                pending_r++;  // Memory refresh reg; emulated behaviour is not totally correct
+            }
+            else
+            {
+                // Bring the cycles and R up to date in case a handler or device looks at them
+                cycles = left;
+                R += pending_r;
+                pending_r = 0;
+
+                // op can't be used after writing memory, as the write may delete its block
+                PC = op->pc + op->length;
+                switch (op->kind)
+                {
+                case DO_LD_R_MHL:  REG8(op->dst) = read8(WR.HL); break;
+                case DO_LD_MHL_R:  write8(WR.HL, REG8(op->src)); break;
+                case DO_LD_MHL_N:  write8(WR.HL, (byte)op->imm); break;
+                case DO_LD_A_MRR:  BR.A = read8(REG16(op->src)); break;
+                case DO_LD_MRR_A:  write8(REG16(op->dst), BR.A); break;
+                case DO_LD_A_MNN:  BR.A = read8(op->imm); break;
+                case DO_LD_MNN_A:  write8(op->imm, BR.A); break;
+                case DO_PUSH:      doPush(REG16(op->src)); break;
+                case DO_POP:       REG16(op->dst) = doPop(); break;
+                case DO_CALL:      { const ushort target = op->imm; doPush(PC); PC = target; } break;
+                case DO_RET:       PC = doPop(); break;
+
+                default:
+                    {
+                        const byte post = op->post;
+                        PC = op->pc + op->pre;
+                        if (op->func != NULL)
+                            (this->*(op->func))();
+                        PC += post;
+                    }
+                    break;
+                }
+
+                left = cycles - op_cycles;
+                pending_r++;
+                if (generation != code_generation)
+                    break;  // Carry on from a new block at PC
+            }
+        }
+
+        // The register ops other than jumps leave PC alone, so bring it up to date if the loop
+        // stopped after one
+        if (op == end)
+        {
+            if (end[-1].kind < DO_JP)
+                PC = end[-1].pc + end[-1].length;
+        }
+        else if (generation == code_generation)
+            PC = op->pc;
+    } while (left > 0 && (block = FindBlock(PC)) != NULL);
+
+    #undef REG8
+    #undef REG16
+    #undef read8
+    #undef write8
+
+    cycles = left;
+    R += pending_r;
+
+    return true;
+}
+
+
+Z80CPU::Z80Block *Z80CPU::BuildBlock(ushort addr)
+{
+    Z80Block *block = new Z80Block();
+    unsigned int pc = addr;
+
+    block->cycles = 0;
+    block->executions = 0;
+    block->native = NULL;
+
+    while (block->ops.size() < MaxBlockOps)
+    {
+        // Decode the instruction at pc in the same way as Execute() does, but without running it
+        Z80OpcodeTable *current = &opcodes_main;
+        Z80OpcodeEntry *entry;
+        unsigned int walked = 0;
+        int offset = 0;
+        bool cacheable = true;
+
+        do
+        {
+            const unsigned int opcode_addr = pc + walked + offset;
+            if (opcode_addr >= MemSize || !PageCacheable(opcode_addr >> PageShift))
+            {
+                cacheable = false;
+                break;
+            }
+
+            entry = &current->entries[read8(opcode_addr)];
+            walked++;
+
+            if (entry->func == NULL && entry->table != NULL)
+            {
+                current = entry->table;
+                offset = current->opcode_offset;
+            }
+            else
+                break;
+        } while (true);
+
+        const unsigned int length = entry->func != NULL ? entry->length : walked;  // Undefined opcodes just skip the bytes walked
+
+        if (cacheable)
+        {
+            // All of the instruction must be cacheable, not just the opcode
+            for (unsigned int page = pc >> PageShift; page <= (pc + length - 1) >> PageShift; page++)
+            {
+                if (page >= NumPages || !PageCacheable(page))
+                    cacheable = false;
+            }
+        }
+
+        if (!cacheable)
+            break;
+
+        Z80DecodedOp op;
+        op.func = entry->func;
+        op.kind = DO_HANDLER;
+        op.pre = (byte)(entry->func != NULL ? walked - offset : walked);
+        op.post = (byte)(entry->func != NULL ? offset : 0);
+        op.length = (byte)length;
+        op.dst = op.src = 0;
+        op.imm = 0;
+        op.pc = (ushort)pc;
+        op.port_access = AccessesPort(entry);
+        op.cycles = entry->cycles;
+
+        if (current == &opcodes_main && entry->func != NULL)
+            DecodeInline(pc, op);
+
+        block->ops.push_back(op);
+        block->cycles += op.cycles;
+        pc += length;
+
+        if (EndsBlock(entry))
+            break;
+    }
+
+    if (block->ops.empty())
+    {
+        delete block;
+        return NULL;
+    }
+
+    block->first_page = addr >> PageShift;
+    block->last_page = (pc - 1) >> PageShift;
+    for (unsigned int page = block->first_page; page <= block->last_page; page++)
+    {
+        page_blocks[page].push_back(addr);
+        if (mapped_write_page[page] != write_sink)  // No need to catch writes that will be discarded
+            write_page[page] = NULL;
+    }
+
+    blocks[addr] = block;
+    return block;
+}
+
+
+namespace
+{
+    // Indexes into the bytes and words of a Z80Regs, by the register fields of the opcodes
+    const Z80CPU::byte reg8_index[8] =  // B, C, D, E, H, L, (HL), A
+    {
+        offsetof(Z80CPU::Z80Regs, br.B), offsetof(Z80CPU::Z80Regs, br.C),
+        offsetof(Z80CPU::Z80Regs, br.D), offsetof(Z80CPU::Z80Regs, br.E),
+        offsetof(Z80CPU::Z80Regs, br.H), offsetof(Z80CPU::Z80Regs, br.L),
+        0, offsetof(Z80CPU::Z80Regs, br.A)
+    };
+
+    const Z80CPU::byte reg16_index[4] =  // BC, DE, HL, SP (or AF for PUSH and POP)
+    {
+        offsetof(Z80CPU::Z80Regs, wr.BC) / 2, offsetof(Z80CPU::Z80Regs, wr.DE) / 2,
+        offsetof(Z80CPU::Z80Regs, wr.HL) / 2, offsetof(Z80CPU::Z80Regs, wr.SP) / 2
+    };
+}
+
+
+/*! Only the registers B to A are run inline (not IX, IY or (HL) apart from the plain loads),
+ *  and PUSH AF and POP AF are left to their handlers as they need F to be up to date.  The
+ *  instruction's bytes must be in pages that may be cached.
+ */
+void Z80CPU::DecodeInline(unsigned int pc, Z80DecodedOp &op)
+{
+    const byte opcode = read8(pc);
+    const unsigned int r = (opcode >> 3) & 7, r2 = opcode & 7, rr = (opcode >> 4) & 3;
+
+    // Operands, which are only read if the instruction has them
+    #define OPERAND8() read8(pc + 1)
+    #define OPERAND16() read16(pc + 1)
+
+    if (opcode >= 0x40 && opcode < 0x80 && opcode != 0x76)
+    {
+        if (r2 == 6)
+        {
+            op.kind = DO_LD_R_MHL;
+            op.dst = reg8_index[r];
+        }
+        else if (r == 6)
+        {
+            op.kind = DO_LD_MHL_R;
+            op.src = reg8_index[r2];
+        }
+        else
+        {
+            op.kind = DO_LD_R_R;
+            op.dst = reg8_index[r];
+            op.src = reg8_index[r2];
+        }
+    }
+    else if (opcode >= 0x80 && opcode < 0xC0 && r2 != 6)
+    {
+        op.kind = DO_ADD_R + r;
+        op.src = reg8_index[r2];
+    }
+    else if ((opcode & 0xC7) == 0xC6)
+    {
+        op.kind = DO_ADD_N + r;
+        op.imm = OPERAND8();
+    }
+    else if ((opcode & 0xE7) == 0x07)
+        op.kind = DO_RLCA + r;
+    else if ((opcode & 0xC7) == 0x06)
+    {
+        op.kind = r == 6 ? DO_LD_MHL_N : DO_LD_R_N;
+        op.dst = reg8_index[r];
+        op.imm = OPERAND8();
+    }
+    else if ((opcode & 0xC6) == 0x04 && r != 6)
+    {
+        op.kind = (opcode & 1) ? DO_DEC_R : DO_INC_R;
+        op.dst = reg8_index[r];
+    }
+    else if ((opcode & 0xCF) == 0x01)
+    {
+        op.kind = DO_LD_RR_NN;
+        op.dst = reg16_index[rr];
+        op.imm = OPERAND16();
+    }
+    else if ((opcode & 0xCF) == 0x03 || (opcode & 0xCF) == 0x0B)
+    {
+        op.kind = (opcode & 0x08) ? DO_DEC_RR : DO_INC_RR;
+        op.dst = reg16_index[rr];
+    }
+    else if (opcode == 0x0A || opcode == 0x1A)
+    {
+        op.kind = DO_LD_A_MRR;
+        op.src = reg16_index[rr];
+    }
+    else if (opcode == 0x02 || opcode == 0x12)
+    {
+        op.kind = DO_LD_MRR_A;
+        op.dst = reg16_index[rr];
+    }
+    else if (opcode == 0x3A || opcode == 0x32)
+    {
+        op.kind = opcode == 0x3A ? DO_LD_A_MNN : DO_LD_MNN_A;
+        op.imm = OPERAND16();
+    }
+    else if ((opcode & 0xCF) == 0xC5 && opcode != 0xF5)
+    {
+        op.kind = DO_PUSH;
+        op.src = reg16_index[rr];
+    }
+    else if ((opcode & 0xCF) == 0xC1 && opcode != 0xF1)
+    {
+        op.kind = DO_POP;
+        op.dst = reg16_index[rr];
+    }
+    else if (opcode == 0xC3 || (opcode & 0xC7) == 0xC2)
+    {
+        op.kind = DO_JP;
+        op.src = opcode == 0xC3 ? DO_ALWAYS : DO_NZ + r;
+        op.imm = OPERAND16();
+    }
+    else if (opcode == 0x18 || opcode == 0x20 || opcode == 0x28 || opcode == 0x30 || opcode == 0x38)
+    {
+        op.kind = DO_JR;
+        op.src = opcode == 0x18 ? DO_ALWAYS : DO_NZ + (r - 4);
+        op.imm = (ushort)(pc + 2 + (signed char)OPERAND8());
+    }
+    else if (opcode == 0x10)
+    {
+        op.kind = DO_DJNZ;
+        op.imm = (ushort)(pc + 2 + (signed char)OPERAND8());
+    }
+    else if (opcode == 0xCD)
+    {
+        op.kind = DO_CALL;
+        op.imm = OPERAND16();
+    }
+    else if (opcode == 0xC9)
+        op.kind = DO_RET;
+    else if (opcode == 0xEB)
+        op.kind = DO_EX_DE_HL;
+
+    #undef OPERAND8
+    #undef OPERAND16
+}
+
+
+void Z80CPU::InvalidatePage(unsigned int page)
+{
+    std::vector<ushort> starts;
+    starts.swap(page_blocks[page]);
+
+    for (std::vector<ushort>::iterator it = starts.begin(); it != starts.end(); it++)
+    {
+        Z80Block *block = blocks[*it];
+
+        // Blocks spanning two pages are listed in both, so remove it from the other
+        for (unsigned int other = block->first_page; other <= block->last_page; other++)
+        {
+            std::vector<ushort> &others = page_blocks[other];
+            if (other == page)
+                continue;
+
+            others.erase(std::remove(others.begin(), others.end(), *it), others.end());
+            if (others.empty())
+                write_page[other] = mapped_write_page[other];
+        }
+
+        delete block;
+        blocks[*it] = NULL;
+    }
+
+    write_page[page] = mapped_write_page[page];
+    code_generation++;
+}
+
+
+void Z80CPU::FlushCodeCache()
+{
+    for (unsigned int page = 0; page < NumPages; page++)
+    {
+        if (!page_blocks[page].empty())
+            InvalidatePage(page);
+    }
+
+    memset(page_invalidations, 0, sizeof(page_invalidations));
+}
+
+
+bool Z80CPU::SetEngine(const std::string &engine)
+{
+    if (engine != "interpreter" && engine != "blocks" && engine != "jit")
+        return false;
+
+    FlushCodeCache();
+    ShutdownJIT();
+
+    block_cache = engine != "interpreter";
+    jit = engine == "jit" && InitJIT();  // Where native code isn't supported, as blocks
+    blocks.assign(block_cache ? MemSize : 0, NULL);
+
+    return true;
+}
+
+
+bool Z80CPU::EndsBlock(const Z80OpcodeEntry *entry)
+{
+    static const char *const enders[] =
+    {
+        "JP", "JR", "CALL", "RET", "RETI", "RETN", "RST", "DJNZ", "HALT", "EI", "DI",
+        "LDIR", "LDDR", "CPIR", "CPDR",
+        NULL
+    };
+
+    return MnemonicIn(entry, enders) || AccessesPort(entry);  // Port writes may remap memory
+}
+
+
+bool Z80CPU::AccessesPort(const Z80OpcodeEntry *entry)
+{
+    static const char *const port_ops[] =
+    {
+        "IN", "INI", "INIR", "IND", "INDR", "OUT", "OUTI", "OUTD", "OTIR", "OTDR",
+        NULL
+    };
+
+    return MnemonicIn(entry, port_ops);
+}
+
+
+bool Z80CPU::MnemonicIn(const Z80OpcodeEntry *entry, const char *const *names)
+{
+    if (entry->format == NULL)
+        return false;
+
+    const size_t len = strcspn(entry->format, " ");
+    for (const char *const *n = names; *n != NULL; n++)
+    {
+        if (strlen(*n) == len && strncmp(entry->format, *n, len) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+
+/* ---------------------------------------------------------
+ *  Idle detection
+ * --------------------------------------------------------- 
+ */
+
+/*! Reads at other PCs within MaxIdlePeriod cycles are taken to be part of the same loop, and
+ *  only contribute to when it may stop being idle.  Memory is only compared (by hashing) once
+ *  the registers match, since that is expensive.  So a loop is skipped the third time around.
+ */
+void Z80CPU::CheckIdle(byte value, Microbee::time_t stable_until)
+{
+    if (PC != idle.pc)
+    {
+        if (idle.pc != MemSize && idle.cycles - cycles <= MaxIdlePeriod)
+            idle.stable_until = std::min(idle.stable_until, stable_until);
+        else
+            StartIdleCheck(value, stable_until);
+        return;
+    }
+
+    syncFlags();
+
+    if (value != idle.value || device_writes != idle.device_writes || idle.cycles - cycles > MaxIdlePeriod ||
+        memcmp(&R1, &idle.r1, sizeof(R1)) != 0 || memcmp(&R2, &idle.r2, sizeof(R2)) != 0 ||
+        I != idle.i || IFF1 != idle.iff1 || IFF2 != idle.iff2 || IM != idle.im)
+    {
+        StartIdleCheck(value, stable_until);
+        return;
+    }
+
+    const unsigned long hash = HashMemory();
+    if (idle.hashed && hash == idle.memory_hash)
+        SkipIterations(idle.cycles - cycles, R - idle.r, std::min(idle.stable_until, stable_until));
+
+    StartIdleCheck(value, stable_until);
+    idle.hashed = true;
+    idle.memory_hash = hash;
+}
+
+
+void Z80CPU::StartIdleCheck(byte value, Microbee::time_t stable_until)
+{
+    syncFlags();
+
+    idle.pc = PC;
+    idle.value = value;
+    idle.r1 = R1;
+    idle.r2 = R2;
+    idle.i = I;
+    idle.iff1 = IFF1;
+    idle.iff2 = IFF2;
+    idle.im = IM;
+    idle.device_writes = device_writes;
+    idle.cycles = cycles;
+    idle.r = R;
+    idle.stable_until = stable_until;
+    idle.hashed = false;
+}
+
+
+/*! Only memory that can be written without going through a handler needs to be included, as
+ *  writes through a handler are counted in device_writes.
+ */
+unsigned long Z80CPU::HashMemory() const
+{
+    unsigned long hash = 0;
+
+    for (unsigned int page = 0; page < NumPages; page++)
+    {
+        const byte *p = mapped_write_page[page];
+        if (p == NULL || p == write_sink)
+            continue;
+
+        for (unsigned int i = 0; i < PageSize; i++)
+            hash = hash * 31 + p[i];
+    }
+
+    return hash;
+}
+
+
+/*! Leaves at least one iteration's worth of cycles, so that the loop carries on from where it
+ *  was for the rest of the time slice.
+ */
+void Z80CPU::SkipIterations(int period, byte r_delta, Microbee::time_t until)
+{
+    if (period <= 0 || until <= GetTime())
+        return;
+
+    // Cycles left at time until
+    const Microbee::time_t limit = until < emu_time ? (emu_time - until) / ticks_per_cycle + 1 : 1;
+    if (cycles <= limit)
+        return;
+
+    const int n = (int)((cycles - limit) / period);
+    cycles -= n * period;
+    R += n * r_delta;
 }
 
 
@@ -635,12 +1552,16 @@ void Z80CPU::Reset()
 {
 	PC = 0x0000;
 	BR.F = 0;
+    lazy_flags.op = LF_NONE;
 	IM = 0;
 	IFF1 = IFF2 = 0;
 
     emu_time = mbee.GetTime();
+    part_cycle = 0;
     cycles = 0;
 
+    FlushCodeCache();
+
 
 #if 0   // For DAA operation comparison
     printf("A,...,,..H,,.C.,,.CH,,N..,,N.H,,NC.,,NCH,,\n");
@@ -709,22 +1630,64 @@ void Z80CPU::Z80NMI ()
 }
 
 
-NullMemory Z80CPU::null_mem = NullMemory(Z80CPU::MemSize);
-NullPort Z80CPU::null_port = NullPort(Z80CPU::PortSize);
-
-
-/*! \p config_ must specify the attribute freq on the <device> */
+/*! \p config_ must specify the attribute freq on the <device>, which must divide
+ *  Microbee::cTicksPerSecond so that each cycle is a whole number of ticks.  The optional
+ *  attribute engine selects how instructions are executed: "interpreter" (the default) decodes
+ *  every instruction as it is run, "blocks" enables the block cache, and "jit" additionally
+ *  compiles frequently run blocks to native code.  Where native code isn't supported "jit"
+ *  behaves as "blocks".  The optional attribute idle selects whether polling loops and HALT
+ *  are skipped ("skip", the default) or run instruction by instruction ("run").
+ */
 Z80CPU::Z80CPU(Microbee &mbee_, const TiXmlElement &config_) :
 mbee(mbee_),
+breakpoint(-1), breakpoint_hit(false),
+null_mem(MemSize), null_port(PortSize),
 mem_block_size(MemSize), mem_handlers(1, HandlerEntry(&null_mem, 0x0000)), 
-port_block_size(PortSize), port_handlers(1, HandlerEntry(&null_port, 0x00))
+direct_map(false),
+port_block_size(PortSize), port_handlers(1, HandlerEntry(&null_port, 0x00)),
+block_cache(false),
+code_generation(0),
+jit(false), jit_buffer(NULL), jit_used(0),
+idle_skip(true), device_writes(0)
 {
+    lazy_flags.op = LF_NONE;
+    idle.pc = MemSize;
+
     int f;
     if (config_.Attribute("freq", &f) == NULL)
         throw ConfigError(&config_, "Z80CPU missing freq attribute");
     if (f <= 0)
         throw ConfigError(&config_, "Z80CPU freq attribute must be positive");
-    freq = f;
+    if (Microbee::cTicksPerSecond % f != 0)
+        throw ConfigError(&config_, "Z80CPU freq attribute must divide the master clock rate (108 MHz)");
+    ticks_per_cycle = Microbee::cTicksPerSecond / f;
+
+    const char *engine = config_.Attribute("engine");
+    if (engine != NULL && !SetEngine(engine))
+        throw ConfigError(&config_, "Z80CPU engine attribute must be interpreter, blocks or jit");
+
+    const char *idle_attr = config_.Attribute("idle");
+    if (idle_attr != NULL)
+    {
+        std::string idle_str = std::string(idle_attr);
+        if (idle_str == "run")
+            idle_skip = false;
+        else if (idle_str != "skip")
+            throw ConfigError(&config_, "Z80CPU idle attribute must be skip or run");
+    }
+
+    memset(read_page, 0, sizeof(read_page));
+    memset(write_page, 0, sizeof(write_page));
+    memset(mapped_write_page, 0, sizeof(mapped_write_page));
+    memset(page_invalidations, 0, sizeof(page_invalidations));
+    MapPages(0, MemSize, &null_mem, 0x0000);
+}
+
+
+Z80CPU::~Z80CPU()
+{
+    FlushCodeCache();
+    ShutdownJIT();
 }
 
 
@@ -734,7 +1697,8 @@ port_block_size(PortSize), port_handlers(1, HandlerEntry(&null_port, 0x00))
  *  requests for a specified region of the address space.  The vector mem_handlers is used to map 
  *  addresses to handlers.  Elements in mem_handlers are arranged in the same order as the memory
  *  address space, and each element covers a range of mem_block_size.  This allows the read/write
- *  requests to be processed quickly.
+ *  requests to be processed quickly.  Pages wholly covered by the handler are also entered into
+ *  the page table so that plain memories can be accessed without a virtual call.
  */
 void Z80CPU::RegMemoryDevice(word addr, MemoryDevice* handler)
 {
@@ -780,8 +1744,97 @@ void Z80CPU::RegMemoryDevice(word addr, MemoryDevice* handler)
         mem_handlers[i].handler.mem = handler;
         mem_handlers[i].base = addr;
     }
+
+    MapPages(start, end, handler, addr);
+}
+
+
+/*! Pages that are only partially covered by [\p start, \p end) are left to the handlers in
+ *  mem_handlers, as are pages for which \p handler doesn't provide direct storage.
+ */
+void Z80CPU::MapPages(unsigned int start, unsigned int end, MemoryDevice *handler, word base)
+{
+    for (unsigned int page = start >> PageShift; page < (end + PageSize - 1) >> PageShift; page++)
+    {
+        const unsigned int page_start = page << PageShift;
+
+        if (page_start < start || page_start + PageSize > end)
+        {
+            if (!page_blocks[page].empty())
+                InvalidatePage(page);
+
+            read_page[page] = NULL;
+            write_page[page] = mapped_write_page[page] = NULL;
+            continue;
+        }
+
+        byte *read_ptr = handler->GetReadPage(page_start - base);
+        if (read_ptr != read_page[page] && !page_blocks[page].empty())
+            InvalidatePage(page);  // Different memory is now visible here
+
+        read_page[page] = read_ptr;
+
+        if (handler->IgnoresWrites())
+            mapped_write_page[page] = write_sink;
+        else
+            mapped_write_page[page] = handler->GetWritePage(page_start - base);
+
+        if (page_blocks[page].empty() || mapped_write_page[page] == write_sink)
+            write_page[page] = mapped_write_page[page];
+        else
+            write_page[page] = NULL;  // Still holds cached code
+    }
+
+    UpdateDirectMap();
 }
 
+void Z80CPU::SaveMemoryMap(MemoryMap &map) const
+{
+    map.mem_block_size = mem_block_size;
+    map.mem_handlers = mem_handlers;
+    memcpy(map.read_page, read_page, sizeof(map.read_page));
+    memcpy(map.write_page, mapped_write_page, sizeof(map.write_page));
+}
+
+
+/*! Copying \p map's handlers reuses the storage of mem_handlers once it has grown to the size
+ *  of the largest map, so switching between saved maps doesn't allocate.  As in MapPages(), any
+ *  cached code in pages which now show different memory is invalidated.
+ */
+void Z80CPU::SelectMemoryMap(const MemoryMap &map)
+{
+    mem_block_size = map.mem_block_size;
+    mem_handlers = map.mem_handlers;
+
+    for (unsigned int page = 0; page < NumPages; page++)
+    {
+        if (map.read_page[page] != read_page[page] && !page_blocks[page].empty())
+            InvalidatePage(page);
+
+        read_page[page] = map.read_page[page];
+        mapped_write_page[page] = map.write_page[page];
+
+        if (page_blocks[page].empty() || mapped_write_page[page] == write_sink)
+            write_page[page] = mapped_write_page[page];
+        else
+            write_page[page] = NULL;  // Still holds cached code
+    }
+
+    UpdateDirectMap();
+}
+
+
+void Z80CPU::UpdateDirectMap()
+{
+    direct_map = true;
+    for (unsigned int page = 0; page < NumPages; page++)
+    {
+        if (read_page[page] == NULL || mapped_write_page[page] == NULL)
+            direct_map = false;
+    }
+}
+
+
 // TODO: Factor the code from RegMemoryDevice and RegPortDevice
 // TODO: Put appropriate const tags on parameters
 void Z80CPU::RegPortDevice(word addr, PortDevice* handler)
@@ -834,11 +1887,13 @@ void Z80CPU::RegPortDevice(word addr, PortDevice* handler)
 
 Microbee::time_t Z80CPU::GetTime()
 {
-    return emu_time - (Microbee::time_t)cycles * 1000000 / freq;  // We've got 'cycles' left to run, so back in time we go
+    return emu_time - cycles * ticks_per_cycle;  // We've got 'cycles' left to run, so back in time we go
 }
 
 void Z80CPU::SaveState(BinaryWriter& writer)
 {
+    syncFlags();
+
     this->SaveRegs(writer, this->R1);
     this->SaveRegs(writer, this->R2);
     writer.WriteWord(this->PC);
@@ -847,10 +1902,16 @@ void Z80CPU::SaveState(BinaryWriter& writer)
     writer.WriteByte(this->IFF1);
     writer.WriteByte(this->IFF2);
     writer.WriteByte(this->IM);
+
+    // Timing, so a restored machine continues on the same schedule (absent from older saves)
+    writer.WriteQWord(this->emu_time);
+    writer.WriteQWord(this->part_cycle);
+    writer.WriteDWord(this->cycles);
 }
 
 void Z80CPU::RestoreState(BinaryReader& reader)
 {
+    lazy_flags.op = LF_NONE;
     this->RestoreRegs(reader, this->R1);
     this->RestoreRegs(reader, this->R2);
     this->PC = reader.ReadWord();
@@ -859,6 +1920,13 @@ void Z80CPU::RestoreState(BinaryReader& reader)
     this->IFF1 = reader.ReadByte();
     this->IFF2 = reader.ReadByte();
     this->IM = reader.ReadByte();
+
+    if (!reader.AtEnd())
+    {
+        this->emu_time = reader.ReadQWord();
+        this->part_cycle = reader.ReadQWord();
+        this->cycles = (int)reader.ReadDWord();
+    }
 }
 
 void Z80CPU::SaveRegs(BinaryWriter& writer, const Z80Regs& regs)
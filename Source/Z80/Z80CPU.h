@@ -59,6 +59,12 @@
 class Microbee;
 
 
+// The native code backend (engine="jit") generates x86-64 code for the System V ABI
+#if defined(__x86_64__) && defined(__linux__) && defined(__GNUC__)
+#define Z80_JIT
+#endif
+
+
 class Z80CPU : public Device
 {
 public:
@@ -97,7 +103,7 @@ public:
 	static const byte F_S  = 128;  /**< Sign */
 
 
-    Z80Regs	R1;		/**< Main register set (R) */
+    Z80Regs	R1;		/**< Main register set (R).  F is only up to date outside Execute() */
     Z80Regs R2;		/**< Alternate register set (R') */
     ushort	PC;		/**< Program counter */
     byte	R;		/**< Refresh */
@@ -113,6 +119,7 @@ public:
 
     //! Construct based on XML \p config_ (primarily used by DeviceFactory)
     Z80CPU(Microbee &mbee_, const TiXmlElement &config_);
+    ~Z80CPU();
 
 
     //! Register \p handler at \p addr in the memory address space
@@ -120,15 +127,36 @@ public:
     //! Register \p handler at \p addr in the port address space
     void RegPortDevice(word addr, PortDevice* handler);
 
+    class MemoryMap;
+
+    //! Copies the current memory address space mapping into \p map
+    void SaveMemoryMap(MemoryMap &map) const;
+    //! Replaces the memory address space mapping with \p map (as filled in by SaveMemoryMap())
+    void SelectMemoryMap(const MemoryMap &map);
+
     /** Resets the processor. */
     void Reset();
 
-    Microbee::time_t Execute(Microbee::time_t time, Microbee::time_t micros);
+    Microbee::time_t Execute(Microbee::time_t time, Microbee::time_t ticks);
 
     virtual bool Executable() { return true; }
 
     Microbee::time_t GetTime();
 
+    //! Returns the length of a CPU clock cycle in master clock ticks
+    Microbee::time_t GetTicksPerCycle() const { return ticks_per_cycle; }
+
+    /*! \brief Stops Execute() the first time an instruction leaves the PC at \p addr
+     *
+     *  The rest of the cycles are carried into the next Execute().  Cached blocks are bypassed
+     *  while it is set, so that the PC is checked after every instruction.
+     */
+    void SetBreakpoint(word addr) { breakpoint = addr; }
+    //! Removes the breakpoint, if it hasn't been reached
+    void ClearBreakpoint() { breakpoint = -1; }
+    //! Returns true if the last Execute() stopped at the breakpoint
+    bool BreakpointHit() const { return breakpoint_hit; }
+
 
     /** Decode the next instruction to be executed.
      * dump and decode can be NULL if such information is not needed
@@ -154,15 +182,34 @@ public:
     virtual void SaveState(BinaryWriter& writer);
     virtual void RestoreState(BinaryReader& reader);
 
+    /*! \brief Discards all cached blocks
+     *
+     *  Must be called if memory is modified other than by the CPU (e.g. by restoring the
+     *  state of a RAM device).
+     */
+    void FlushCodeCache();
+
+    /*! \brief Selects how instructions are executed: "interpreter", "blocks" or "jit" (as the
+     *         engine attribute of the configuration does)
+     *
+     *  Returns false, leaving the engine as it was, if \p engine isn't one of them.  Any cached
+     *  code is discarded.
+     */
+    bool SetEngine(const std::string &engine);
+
 private:
     Microbee &mbee;
 
-    unsigned long freq;  //!< CPU frequency in Hz
+    Microbee::time_t ticks_per_cycle;  //!< Length of a CPU clock cycle in master clock ticks (from the freq attribute)
 
-    Microbee::time_t emu_time;  //!< Current emulation time
+    Microbee::time_t emu_time;  //!< Emulation time once the cycles left have been run
+    Microbee::time_t part_cycle;  //!< Ticks of the last slice short of a whole cycle, carried into the next
 
     int cycles;  //!< cycles left to run (signed in case the previous execution overran)
 
+    int breakpoint;  //!< Address Execute() stops at (see SetBreakpoint()), -1 if none
+    bool breakpoint_hit;  //!< True if the last Execute() stopped at the breakpoint
+
     void SaveRegs(BinaryWriter& writer, const Z80Regs& regs);
     void RestoreRegs(BinaryReader& reader, Z80Regs& regs);
 
@@ -181,15 +228,39 @@ private:
       word base;
     };
 
+    NullMemory null_mem;  //!< Handles memory accesses that no device has been registered for
+    NullPort null_port;  //!< Handles port accesses that no device has been registered for
+
     unsigned int mem_block_size;  //**< Each block of mem_block_size in the address space can have a different handler
     std::vector<HandlerEntry> mem_handlers;
 
-    unsigned int port_block_size;  //**< Each block of port_block_size in the address space can have a different handler
-    std::vector<HandlerEntry> port_handlers;
+    /*! \brief Page table for fast memory access
+     *
+     *  The address space is split into NumPages pages of PageSize bytes.  For each page,
+     *  read_page and write_page hold a host pointer to the storage backing that page (as
+     *  supplied by MemoryDevice::GetReadPage() / GetWritePage()), or NULL if the access must
+     *  go through the handler in mem_handlers.  Pages belonging to devices that ignore writes
+     *  have their write_page set to write_sink.
+     */
+    static const unsigned int PageShift = 8;
+    static const unsigned int PageSize = 1 << PageShift;
+    static const unsigned int NumPages = MemSize / PageSize;
 
+    byte *read_page[NumPages];   //!< Direct read pointers, indexed by addr >> PageShift
+    byte *write_page[NumPages];  //!< Direct write pointers, indexed by addr >> PageShift
+    byte write_sink[PageSize];  //!< Discards writes to read-only pages (per instance, so instances on other threads don't contend for it)
 
-    static NullMemory null_mem;
-    static NullPort null_port;
+    //! Rebuilds the page table entries covering [\p start, \p end) from \p handler registered at \p base
+    void MapPages(unsigned int start, unsigned int end, MemoryDevice *handler, word base);
+
+    bool direct_map;  //!< True if every page has direct read and write pointers (ignoring the block cache)
+    //! Recalculates direct_map from the page table
+    void UpdateDirectMap();
+
+    byte *mapped_write_page[NumPages];  //!< Write pointers as supplied by the devices; write_page is NULL instead while a page holds cached code
+
+    unsigned int port_block_size;  //**< Each block of port_block_size in the address space can have a different handler
+    std::vector<HandlerEntry> port_handlers;
 
 
     /* ---------------------------------------------------------
@@ -240,6 +311,14 @@ private:
     static const int F2_SUB = 1;
 
     static int parityBit[256];
+
+    // Flag lookup tables (generated into codegen/flags_table.c)
+    static const byte sz53pTable[256];  //!< S, Z, 5, 3 and P/V (parity) for a value
+    static const byte incTable[256];  //!< S, Z, H, P/V and N after INC of a value
+    static const byte decTable[256];  //!< S, Z, H, P/V and N after DEC of a value
+    static const byte addTable[2 * 256 * 256];  //!< F after ADD/ADC, indexed by carry << 16 | A << 8 | value
+    static const byte subTable[2 * 256 * 256];  //!< F after SUB/SBC/CP, indexed by carry << 16 | A << 8 | value
+    static const ushort daaTable[8 * 256];  //!< AF after DAA, indexed by (H << 2 | N << 1 | C) << 8 | A
  
 
     typedef enum
@@ -260,6 +339,7 @@ private:
     	
 	    int operand_type;
         int cycles;
+        int length;  //!< Length of the instruction in bytes, including prefixes and operands
 	    const char *format;	
     	
         Z80OpcodeTable *table;
@@ -276,18 +356,254 @@ private:
 #include "codegen/opcodes_decl.h"
 #include "codegen/opcodes_table_decl.h"
 
+
+    /* ---------------------------------------------------------
+     *  Block cache
+     * --------------------------------------------------------- 
+     *
+     * When enabled (engine="blocks" in the config), straight-line runs of instructions are 
+     * decoded once into a Z80Block, which records the handler for each instruction along with
+     * the PC adjustments that the table walk in Execute() would have made.  Executing a cached
+     * block skips the prefix walk entirely.  The most common unprefixed instructions (register
+     * loads, 8-bit ALU operations, plain memory loads and stores, jumps, calls and returns) are
+     * also decoded into a Z80DecodedKind with their register and immediate operands, and are run
+     * by ExecuteBlock() without calling a handler or fetching any operands.
+     *
+     * Only code in pages with direct read pointers (i.e. plain RAM/ROM) is cached.  While a page
+     * holds cached code its write_page entry is cleared, so that writes to it take the slow path
+     * in write8(), which invalidates the page's blocks.  Remapping a page also invalidates them.
+     * Pages whose code has been overwritten MaxPageInvalidations times (self-modifying code, or
+     * variables kept next to the code) are no longer cached, since every write would mean
+     * decoding the page's blocks again.
+     */
+
+    //! How a Z80DecodedOp is run.  Ops from DO_FIRST_MEMORY on may access memory (and so devices).
+    enum Z80DecodedKind
+    {
+        DO_LD_R_R,    //!< LD dst,src
+        DO_LD_R_N,    //!< LD dst,imm
+        DO_LD_RR_NN,  //!< LD dst,imm (dst is a word register)
+        DO_INC_RR,    //!< INC dst (dst is a word register)
+        DO_DEC_RR,    //!< DEC dst (dst is a word register)
+        DO_EX_DE_HL,
+        DO_INC_R,     //!< INC dst
+        DO_DEC_R,     //!< DEC dst
+        DO_ADD_R, DO_ADC_R, DO_SUB_R, DO_SBC_R, DO_AND_R, DO_XOR_R, DO_OR_R, DO_CP_R,  //!< ALU op with src, in the order of the opcodes
+        DO_ADD_N, DO_ADC_N, DO_SUB_N, DO_SBC_N, DO_AND_N, DO_XOR_N, DO_OR_N, DO_CP_N,  //!< ALU op with imm
+        DO_RLCA, DO_RRCA, DO_RLA, DO_RRA,  //!< Rotate A, in the order of the opcodes
+        DO_JP,        //!< JP to imm if condition src holds
+        DO_JR,        //!< JR to imm (the target) if condition src holds
+        DO_DJNZ,      //!< DJNZ to imm (the target)
+
+        DO_FIRST_MEMORY,
+        DO_LD_R_MHL = DO_FIRST_MEMORY,  //!< LD dst,(HL)
+        DO_LD_MHL_R,  //!< LD (HL),src
+        DO_LD_MHL_N,  //!< LD (HL),imm
+        DO_LD_A_MRR,  //!< LD A,(src) (src is a word register)
+        DO_LD_MRR_A,  //!< LD (dst),A (dst is a word register)
+        DO_LD_A_MNN,  //!< LD A,(imm)
+        DO_LD_MNN_A,  //!< LD (imm),A
+        DO_PUSH,      //!< PUSH src (a word register other than AF)
+        DO_POP,       //!< POP dst (a word register other than AF)
+        DO_CALL,      //!< CALL imm
+        DO_RET,
+        DO_HANDLER    //!< Anything else, which is run by calling func
+    };
+
+    // Conditions of DO_JP and DO_JR, in the order of the opcodes after DO_ALWAYS
+    enum
+    {
+        DO_ALWAYS,
+        DO_NZ, DO_Z, DO_NC, DO_C, DO_PO, DO_PE, DO_P, DO_M
+    };
+
+    struct Z80DecodedOp
+    {
+        Z80OpcodeFunc func;  //!< Handler, or NULL for an undefined opcode (executes as a NOP)
+        byte kind;  //!< A Z80DecodedKind
+        byte pre;   //!< Amount PC is advanced before calling func (opcode bytes less the table's opcode_offset)
+        byte post;  //!< Amount PC is advanced after calling func (the table's opcode_offset)
+        byte length;  //!< Length of the instruction, which PC is advanced by when it is run inline
+        byte dst, src;  //!< Register operands when run inline, as indexes into the bytes (or words) of R1
+        ushort imm;  //!< Immediate operand when run inline
+        ushort pc;   //!< Address of the instruction
+        bool port_access;  //!< True if the instruction reads or writes a port
+        int cycles;
+    };
+
+    //! Native code for the leading ops of a block, returns the number of ops it ran
+    typedef unsigned int (*Z80NativeCode) (Z80CPU *cpu);
+
+    struct Z80Block
+    {
+        std::vector<Z80DecodedOp> ops;
+        int cycles;  //!< Total cycles for all ops in the block
+        unsigned int first_page, last_page;  //!< Pages holding the block's code
+        unsigned int executions;  //!< Number of times the block has been run (counted until it is compiled)
+        Z80NativeCode native;  //!< Compiled code, or NULL if the block is interpreted
+    };
+
+    static const unsigned int MaxBlockOps = 64;
+    static const unsigned int MaxPageInvalidations = 8;  //!< Writes over cached code after which a page is no longer cached
+
+    bool block_cache;  //!< True if the block cache is enabled
+    std::vector<Z80Block *> blocks;  //!< Cached blocks, indexed by start address
+    std::vector<ushort> page_blocks[NumPages];  //!< Start addresses of the blocks which contain code from each page
+    unsigned long code_generation;  //!< Incremented whenever cached code is invalidated
+    byte page_invalidations[NumPages];  //!< Number of times code in each page has been overwritten (saturating)
+
+    //! Executes the block at PC and those following it, returns false if the code at PC can't be cached
+    bool ExecuteBlock();
+    //! Returns true if condition \p cond (DO_ALWAYS etc.) holds
+    bool TestCondition(byte cond);
+    //! Decodes the block starting at \p addr, returns NULL if the code at \p addr can't be cached
+    Z80Block *BuildBlock(ushort addr);
+    //! Returns the block at \p addr (building it if required), or NULL if the code at \p addr can't be cached
+    Z80Block *FindBlock(ushort addr)
+    {
+        // Blocks are deleted as soon as their pages can't be cached
+        if (blocks[addr] != NULL)
+            return blocks[addr];
+        return PageCacheable(addr >> PageShift) ? BuildBlock(addr) : NULL;
+    }
+    //! Sets the kind and operands of \p op if the unprefixed instruction at \p pc can be run inline
+    void DecodeInline(unsigned int pc, Z80DecodedOp &op);
+    //! Returns true if code from \p page may be cached
+    bool PageCacheable(unsigned int page) const { return read_page[page] != NULL && page_invalidations[page] < MaxPageInvalidations; }
+    //! Discards the blocks which contain code from \p page
+    void InvalidatePage(unsigned int page);
+    //! Returns true if \p entry may transfer control (or remap memory) and so must end a block
+    static bool EndsBlock(const Z80OpcodeEntry *entry);
+    //! Returns true if \p entry reads or writes a port
+    static bool AccessesPort(const Z80OpcodeEntry *entry);
+    //! Returns true if the mnemonic of \p entry is one of the NULL terminated list \p names
+    static bool MnemonicIn(const Z80OpcodeEntry *entry, const char *const *names);
+
+
+    /* ---------------------------------------------------------
+     *  Native code (see Z80JIT.cpp)
+     * --------------------------------------------------------- 
+     *
+     * With engine="jit", blocks which have been run JITThreshold times are translated into x86-64
+     * code.  The inline kinds of op are generated as x86-64 instructions (apart from a few which
+     * need the flags) and the rest call their handlers directly, leaving PC, R and the cycle
+     * count as the interpreter would.  Ports are left to the interpreter: compilation stops at
+     * the first op which accesses a port, and ExecuteBlock() runs the remainder of the block.
+     *
+     * Pages whose cached code keeps getting overwritten (self-modifying code) aren't cached at
+     * all (see MaxPageInvalidations), so they are never compiled either.
+     */
+
+    static const unsigned int JITThreshold = 16;
+    static const size_t JITBufferSize = 4 * 1024 * 1024;
+
+    bool jit;  //!< True if hot blocks are compiled to native code
+    byte *jit_buffer;  //!< Executable memory holding the native code
+    size_t jit_used;  //!< Bytes of jit_buffer in use
+
+    //! Allocates jit_buffer, returns false if native code isn't supported
+    bool InitJIT();
+    //! Frees jit_buffer
+    void ShutdownJIT();
+    //! Generates native code for \p block, leaving block->native NULL if it can't be compiled
+    void CompileBlock(Z80Block *block);
+
+
+    /* ---------------------------------------------------------
+     *  Idle detection
+     * --------------------------------------------------------- 
+     *
+     * Polling loops (such as waiting for a key) are detected at their port reads.  If the CPU
+     * gets back to the same port read with the same registers and memory, reads the same value,
+     * and hasn't written to a device in the meantime, every further time around the loop will be
+     * the same until one of the ports it reads changes (see PortDevice::PortStableUntil()).  Whole
+     * iterations are then skipped up to that point, or to the end of the time slice, by just
+     * counting off their cycles.  HALT waits out the time slice in the same way.  Either way
+     * Execute() returns early and the host can sleep for the rest of the slice.
+     */
+
+    struct IdleCheck
+    {
+        unsigned int pc;  //!< PC at the port read being checked, or MemSize if none
+        byte value;  //!< Value read
+        Z80Regs r1, r2;
+        byte i, iff1, iff2, im;
+        unsigned long device_writes;
+        int cycles;  //!< Cycles left at the port read
+        byte r;
+        Microbee::time_t stable_until;  //!< Earliest time that a port read since may change
+        bool hashed;  //!< True once memory_hash has been calculated
+        unsigned long memory_hash;
+    };
+
+    static const int MaxIdlePeriod = 2000;  //!< Longest loop (in cycles) that is checked
+
+    bool idle_skip;  //!< True if idle loops and HALT are skipped
+    IdleCheck idle;
+    unsigned long device_writes;  //!< Number of writes to ports and memory handlers
+
+    //! Checks for an idle loop at a port read which returned \p value, see PortDevice::PortStableUntil() for \p stable_until
+    void CheckIdle(byte value, Microbee::time_t stable_until);
+    //! Makes the current port read the one to check
+    void StartIdleCheck(byte value, Microbee::time_t stable_until);
+    //! Returns a hash of the memory with direct read pointers
+    unsigned long HashMemory() const;
+    //! Skips whole iterations of \p period cycles, each incrementing R by \p r_delta, while the time is before \p until
+    void SkipIterations(int period, byte r_delta, Microbee::time_t until);
+
+    //! Runs the decoder until the cycles run out, \p Direct selects the version for a direct_map
+    template <bool Direct> void ExecuteLoop();
+
     void write8 (ushort addr, byte val);
     void write16 (ushort addr, ushort val);
     byte read8 (ushort addr);
     ushort read16 (ushort addr);
+    byte readDirect (ushort addr);
+    void writeDirect (ushort addr, byte val);
+    ushort readDirect16 (ushort addr);
+    void writeDirect16 (ushort addr, ushort val);
     byte ioRead (ushort addr);
     void ioWrite (ushort addr, byte val);
 
     void adjustFlags (byte val);
     void adjustFlagSZP (byte val);
-    void adjustLogicFlag (int flagH);
+    void adjustShiftFlags (int adjFlags, byte val, byte carry);
+
+    /* Lazy flags: the ALU operations which replace most of F record their operands here instead */
+    enum
+    {
+        LF_NONE,  // F is up to date
+        LF_ADD,   // ADD/ADC of value (plus carry) to a
+        LF_SUB,   // SUB/SBC of value (plus carry) from a
+        LF_CP,    // CP of value from a, which differs from SUB only in where 5 and 3 come from
+        LF_INC,   // INC of value, a is the accumulator at the time
+        LF_DEC,   // DEC of value, a is the accumulator at the time
+        LF_AND,   // AND
+        LF_OR     // OR or XOR
+    };
+
+    struct LazyFlags
+    {
+        byte op;
+        byte a;
+        byte value;
+        byte carry;
+        byte res;  //!< Result of the operation
+    };
+
+    LazyFlags lazy_flags;
+
+    //! Brings F up to date, must be called before F is accessed other than through the flag macros
+    void syncFlags () { if (lazy_flags.op != LF_NONE) evalFlags(); }
+    void evalFlags ();
+
+    // Individual flags, without bringing F up to date
+    bool flagZ ();
+    bool flagS ();
+    bool flagC ();
 
     byte doArithmetic (byte value, int withCarry, int isSub);
+    void doCP (byte value);
 
     void doAND (byte value);
     void doOR (byte value);
@@ -309,6 +625,37 @@ private:
     ushort doPop ();
 
     void doDAA ();
+    void doHALT ();
+
+    /* Repeating block instructions (LDIR etc.) run several iterations at a time through these */
+    static const int RepeatCycles = 5;  //!< Cycles per iteration of a repeating block instruction (see codegen/opcodes.lst)
+
+    unsigned int repeatBudget (unsigned int count);
+    bool repeatIntact (byte opcode);
+
+    void doRepeatLD (int dir);
+    void doRepeatCP (int dir);
+    void doRepeatIN (int dir);
+    void doRepeatOUT (int dir);
+};
+
+
+/*! \brief A complete mapping of the Z80CPU memory address space
+ *
+ *  Devices which switch between a fixed set of mappings (such as MemMapper) can register the
+ *  handlers for each one once, save the result, then switch between them with
+ *  Z80CPU::SelectMemoryMap() rather than registering the handlers again each time.  The
+ *  handlers must provide the same pages (see MemoryDevice::GetReadPage()) for as long as
+ *  the map is in use.
+ */
+class Z80CPU::MemoryMap
+{
+    friend class Z80CPU;
+
+    unsigned int mem_block_size;
+    std::vector<HandlerEntry> mem_handlers;
+    byte *read_page[NumPages];
+    byte *write_page[NumPages];  //!< As supplied by the devices (i.e. Z80CPU::mapped_write_page)
 };
 
 
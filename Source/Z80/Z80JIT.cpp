@@ -0,0 +1,600 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2007 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "stdafx.h"
+#include "Z80CPU.h"
+
+#include <cstring>
+
+#ifdef Z80_JIT
+#include <cstddef>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+
+#ifdef Z80_JIT
+
+namespace
+{
+    //! Appends x86-64 instructions to a buffer
+    class CodeWriter
+    {
+    public:
+        CodeWriter(Z80CPU::byte *start_) : start(start_), pos(start_) {}
+
+        Z80CPU::byte *Start() const { return start; }
+        Z80CPU::byte *Pos() const { return pos; }
+        size_t Size() const { return pos - start; }
+
+        void Byte(unsigned int b) { *pos++ = (Z80CPU::byte)b; }
+        void Word(uint16_t w) { memcpy(pos, &w, sizeof(w)); pos += sizeof(w); }
+        void Dword(uint32_t d) { memcpy(pos, &d, sizeof(d)); pos += sizeof(d); }
+        void Qword(uint64_t q) { memcpy(pos, &q, sizeof(q)); pos += sizeof(q); }
+
+        //! Emits the ModRM byte and displacement for [rbx + \p disp], with \p reg in the reg field
+        void Mem(unsigned int reg, int32_t disp) { Byte(0x80 | (reg << 3) | 3); Dword(disp); }
+
+        //! Emits a jcc rel32 with opcode 0F \p cc, returning the location of the displacement to patch
+        Z80CPU::byte *Jcc(unsigned int cc) { Byte(0x0F); Byte(cc); Dword(0); return pos - 4; }
+        //! Emits a jmp rel32, returning the location of the displacement to patch
+        Z80CPU::byte *Jmp() { Byte(0xE9); Dword(0); return pos - 4; }
+
+        //! Points the rel32 at \p disp to the current location
+        void Patch(Z80CPU::byte *disp) { PatchTo(disp, pos); }
+
+        //! Points the rel32 at \p disp to \p target
+        static void PatchTo(Z80CPU::byte *disp, const Z80CPU::byte *target)
+        {
+            const int32_t rel = (int32_t)(target - (disp + 4));
+            memcpy(disp, &rel, sizeof(rel));
+        }
+
+    private:
+        Z80CPU::byte *start;
+        Z80CPU::byte *pos;
+    };
+
+    const unsigned int JCC_E = 0x84;
+    const unsigned int JCC_NE = 0x85;
+    const unsigned int JCC_LE = 0x8E;
+
+    //! Upper bound on the code generated for each op, including its exit
+    const size_t MaxOpCodeSize = 160;
+    //! Upper bound on the prologue and epilogue
+    const size_t MaxFrameCodeSize = 48;
+
+    /*! Gets the address of the member function \p func into \p addr, returns false if it can't be
+     *  called directly.  Only non-virtual members have an address (Itanium C++ ABI member function
+     *  pointers are an address and a this adjustment).
+     */
+    template <class Func>
+    bool MemberAddress(Func func, uint64_t &addr)
+    {
+        struct
+        {
+            uintptr_t ptr;
+            ptrdiff_t adj;
+        } member;
+
+        if (sizeof(func) != sizeof(member))
+            return false;
+
+        memcpy(&member, &func, sizeof(member));
+        if ((member.ptr & 1) != 0 || member.adj != 0)
+            return false;
+
+        addr = member.ptr;
+        return true;
+    }
+
+    //! Emits a call to the member function at \p addr, with this (rbx) as the first argument
+    void CallMember(CodeWriter &code, uint64_t addr)
+    {
+        // mov rdi, rbx; mov rax, addr; call rax
+        code.Byte(0x48); code.Byte(0x89); code.Byte(0xDF);
+        code.Byte(0x48); code.Byte(0xB8); code.Qword(addr);
+        code.Byte(0xFF); code.Byte(0xD0);
+    }
+}
+
+
+bool Z80CPU::InitJIT()
+{
+    // The buffer is only made executable once code has been written to it (see CompileBlock())
+    void *buffer = mmap(NULL, JITBufferSize, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer == MAP_FAILED)
+        return false;
+
+    jit_buffer = (byte *)buffer;
+    jit_used = 0;
+    return true;
+}
+
+
+void Z80CPU::ShutdownJIT()
+{
+    if (jit_buffer != NULL)
+        munmap(jit_buffer, JITBufferSize);
+
+    jit_buffer = NULL;
+}
+
+
+/*! The generated function takes the Z80CPU as its only argument and does the equivalent of the
+ *  interpreter loop in ExecuteBlock() for each op.  It returns early (with the number of ops
+ *  run) if the cycles run out or the code generation changes.  The cycles left are kept in a
+ *  register and R is only incremented before handlers are called and on the way out, while PC
+ *  is set by the jumps and handlers and on the way out.
+ *
+ *  The register and ALU ops, the plain loads and stores and the unconditional, Z and NZ jumps
+ *  are generated inline, with the loads and stores calling read8() or write8() when the page
+ *  isn't plain memory.  The other ops call their handlers, which must be non-virtual members
+ *  (as the generated opcode functions are).
+ *
+ *  The code is written while its pages of jit_buffer are writable and not executable, and
+ *  they're then made executable and read only.  When jit_buffer is full all native code is
+ *  discarded and the buffer is reused.
+ */
+void Z80CPU::CompileBlock(Z80Block *block)
+{
+    // Compile up to (but not including) the first port access
+    unsigned int num_ops = 0;
+    while (num_ops < block->ops.size() && !block->ops[num_ops].port_access)
+        num_ops++;
+
+    if (num_ops == 0)
+        return;
+
+    uint64_t eval_flags_addr, read8_addr, write8_addr;
+    if (!MemberAddress(&Z80CPU::evalFlags, eval_flags_addr) ||
+        !MemberAddress(&Z80CPU::read8, read8_addr) ||
+        !MemberAddress(&Z80CPU::write8, write8_addr))
+        return;
+
+    std::vector<uint64_t> handlers(num_ops, 0);
+    for (unsigned int i = 0; i < num_ops; i++)
+    {
+        if (block->ops[i].func != NULL && !MemberAddress(block->ops[i].func, handlers[i]))
+            return;
+    }
+
+    if (jit_used + MaxFrameCodeSize + num_ops * MaxOpCodeSize > JITBufferSize)
+    {
+        // Out of space, so start again
+        for (std::vector<Z80Block *>::iterator it = blocks.begin(); it != blocks.end(); it++)
+        {
+            if (*it != NULL)
+                (*it)->native = NULL;
+        }
+
+        jit_used = 0;
+    }
+
+    // Make the pages the code may be written to writable
+    const size_t page_size = sysconf(_SC_PAGESIZE);
+    byte *const protect_start = jit_buffer + (jit_used & ~(page_size - 1));
+    const size_t protect_size = (jit_buffer + jit_used + MaxFrameCodeSize + num_ops * MaxOpCodeSize - protect_start + page_size - 1) & ~(page_size - 1);
+    if (mprotect(protect_start, protect_size, PROT_READ | PROT_WRITE) != 0)
+        return;
+
+    #define OFFSET(member) ((int32_t)((byte *)&(member) - (byte *)this))
+    const int32_t pc_offset = OFFSET(PC);
+    const int32_t r_offset = OFFSET(R);
+    const int32_t cycles_offset = OFFSET(cycles);
+    const int32_t generation_offset = OFFSET(code_generation);
+    const int32_t regs_offset = OFFSET(R1);
+    const int32_t a_offset = OFFSET(R1.br.A);
+    const int32_t f_offset = OFFSET(R1.br.F);
+    const int32_t b_offset = OFFSET(R1.br.B);
+    const int32_t de_offset = OFFSET(R1.wr.DE);
+    const int32_t hl_offset = OFFSET(R1.wr.HL);
+    const int32_t lf_op_offset = OFFSET(lazy_flags.op);
+    const int32_t lf_a_offset = OFFSET(lazy_flags.a);
+    const int32_t lf_value_offset = OFFSET(lazy_flags.value);
+    const int32_t lf_carry_offset = OFFSET(lazy_flags.carry);
+    const int32_t lf_res_offset = OFFSET(lazy_flags.res);
+    const int32_t read_page_offset = OFFSET(read_page);
+    const int32_t write_page_offset = OFFSET(write_page);
+    #undef OFFSET
+
+    // Where each op leaves the native code if it stops there
+    struct Exit
+    {
+        std::vector<byte *> jumps;  //!< Displacements to point at the exit
+        unsigned int pending_r;     //!< Increments of R not yet stored
+        bool set_pc;                //!< True if PC must be set to the following op
+    };
+    std::vector<Exit> exits(num_ops);
+
+    CodeWriter code(jit_buffer + jit_used);
+
+    // push rbx; push r12; push r13 (which leaves the stack 16 byte aligned for calls)
+    code.Byte(0x53);
+    code.Byte(0x41); code.Byte(0x54);
+    code.Byte(0x41); code.Byte(0x55);
+
+    // mov rbx, rdi (this); mov r12, [rbx + code_generation]; mov r13d, [rbx + cycles]
+    code.Byte(0x48); code.Byte(0x89); code.Byte(0xFB);
+    code.Byte(0x4C); code.Byte(0x8B); code.Mem(4, generation_offset);
+    code.Byte(0x44); code.Byte(0x8B); code.Mem(5, cycles_offset);
+
+    unsigned int pending_r = 0;
+
+    for (unsigned int i = 0; i < num_ops; i++)
+    {
+        const Z80DecodedOp &op = block->ops[i];
+        const int32_t dst8 = regs_offset + op.dst, src8 = regs_offset + op.src;
+        const int32_t dst16 = regs_offset + op.dst * 2, src16 = regs_offset + op.src * 2;
+        const ushort next_pc = op.pc + op.length;
+        bool call_handler = false, check_generation = false;
+
+        exits[i].set_pc = true;
+
+        switch (op.kind)
+        {
+        case DO_LD_R_R:
+            // mov al, [src]; mov [dst], al
+            code.Byte(0x8A); code.Mem(0, src8);
+            code.Byte(0x88); code.Mem(0, dst8);
+            break;
+
+        case DO_LD_R_N:
+            // mov byte [dst], imm
+            code.Byte(0xC6); code.Mem(0, dst8); code.Byte(op.imm);
+            break;
+
+        case DO_LD_RR_NN:
+            // mov word [dst], imm
+            code.Byte(0x66); code.Byte(0xC7); code.Mem(0, dst16); code.Word(op.imm);
+            break;
+
+        case DO_INC_RR:
+        case DO_DEC_RR:
+            // inc/dec word [dst]
+            code.Byte(0x66); code.Byte(0xFF); code.Mem(op.kind == DO_INC_RR ? 0 : 1, dst16);
+            break;
+
+        case DO_EX_DE_HL:
+            // mov eax, [DE]; rol eax, 16; mov [DE], eax (HL follows DE)
+            code.Byte(0x8B); code.Mem(0, de_offset);
+            code.Byte(0xC1); code.Byte(0xC0); code.Byte(16);
+            code.Byte(0x89); code.Mem(0, de_offset);
+            break;
+
+        case DO_INC_R:
+        case DO_DEC_R:
+            {
+                // C is preserved, so the previous flags are needed (see doIncDec()):
+                // cmp byte [lazy_flags.op], LF_NONE; je skip; call evalFlags; skip:
+                code.Byte(0x80); code.Mem(7, lf_op_offset); code.Byte(LF_NONE);
+                byte *const skip = code.Jcc(JCC_E);
+                CallMember(code, eval_flags_addr);
+                code.Patch(skip);
+
+                // mov al, [A]; mov [lazy_flags.a], al; mov al, [dst]; mov [lazy_flags.value], al
+                code.Byte(0x8A); code.Mem(0, a_offset);
+                code.Byte(0x88); code.Mem(0, lf_a_offset);
+                code.Byte(0x8A); code.Mem(0, dst8);
+                code.Byte(0x88); code.Mem(0, lf_value_offset);
+
+                // inc/dec al; mov [lazy_flags.res], al; mov [dst], al; mov byte [lazy_flags.op], LF_INC/LF_DEC
+                code.Byte(0xFE); code.Byte(op.kind == DO_INC_R ? 0xC0 : 0xC8);
+                code.Byte(0x88); code.Mem(0, lf_res_offset);
+                code.Byte(0x88); code.Mem(0, dst8);
+                code.Byte(0xC6); code.Mem(0, lf_op_offset); code.Byte(op.kind == DO_INC_R ? LF_INC : LF_DEC);
+            }
+            break;
+
+        case DO_ADD_R: case DO_SUB_R: case DO_AND_R: case DO_XOR_R: case DO_OR_R: case DO_CP_R:
+        case DO_ADD_N: case DO_SUB_N: case DO_AND_N: case DO_XOR_N: case DO_OR_N: case DO_CP_N:
+            {
+                const unsigned int alu = op.kind >= DO_ADD_N ? op.kind - DO_ADD_N : op.kind - DO_ADD_R;
+
+                // mov al, [A]; mov cl, [src] or mov cl, imm
+                code.Byte(0x8A); code.Mem(0, a_offset);
+                if (op.kind >= DO_ADD_N)
+                {
+                    code.Byte(0xB1); code.Byte(op.imm);
+                }
+                else
+                {
+                    code.Byte(0x8A); code.Mem(1, src8);
+                }
+
+                static const byte alu_opcodes[8] = { 0x00, 0, 0x28, 0, 0x20, 0x30, 0x08, 0x28 };  // add, sub, and, xor, or, sub (for CP) al, cl
+                if (alu == DO_AND_R - DO_ADD_R || alu == DO_XOR_R - DO_ADD_R || alu == DO_OR_R - DO_ADD_R)
+                {
+                    // op al, cl; mov [A], al; mov [lazy_flags.res], al; mov byte [lazy_flags.op], LF_AND/LF_OR
+                    code.Byte(alu_opcodes[alu]); code.Byte(0xC8);
+                    code.Byte(0x88); code.Mem(0, a_offset);
+                    code.Byte(0x88); code.Mem(0, lf_res_offset);
+                    code.Byte(0xC6); code.Mem(0, lf_op_offset); code.Byte(alu == DO_AND_R - DO_ADD_R ? LF_AND : LF_OR);
+                }
+                else
+                {
+                    // As doArithmetic() or doCP() without a carry:
+                    // mov [lazy_flags.a], al; mov [lazy_flags.value], cl; mov byte [lazy_flags.carry], 0
+                    code.Byte(0x88); code.Mem(0, lf_a_offset);
+                    code.Byte(0x88); code.Mem(1, lf_value_offset);
+                    code.Byte(0xC6); code.Mem(0, lf_carry_offset); code.Byte(0);
+
+                    // op al, cl; mov [lazy_flags.res], al; (mov [A], al;) mov byte [lazy_flags.op], LF_ADD/LF_SUB/LF_CP
+                    code.Byte(alu_opcodes[alu]); code.Byte(0xC8);
+                    code.Byte(0x88); code.Mem(0, lf_res_offset);
+                    if (alu != DO_CP_R - DO_ADD_R)
+                    {
+                        code.Byte(0x88); code.Mem(0, a_offset);
+                    }
+                    code.Byte(0xC6); code.Mem(0, lf_op_offset);
+                    code.Byte(alu == DO_ADD_R - DO_ADD_R ? LF_ADD : alu == DO_SUB_R - DO_ADD_R ? LF_SUB : LF_CP);
+                }
+            }
+            break;
+
+        case DO_JP:
+        case DO_JR:
+            if (op.src == DO_ALWAYS)
+            {
+                // mov word [PC], imm
+                code.Byte(0x66); code.Byte(0xC7); code.Mem(0, pc_offset); code.Word(op.imm);
+            }
+            else if (op.src == DO_Z || op.src == DO_NZ)
+            {
+                // Get Z as flagZ() does into al:
+                // cmp byte [lazy_flags.op], LF_NONE; jne lazy; test byte [F], F_Z; setnz al; jmp done;
+                // lazy: cmp byte [lazy_flags.res], 0; sete al; done:
+                code.Byte(0x80); code.Mem(7, lf_op_offset); code.Byte(LF_NONE);
+                byte *const lazy = code.Jcc(JCC_NE);
+                code.Byte(0xF6); code.Mem(0, f_offset); code.Byte(F_Z);
+                code.Byte(0x0F); code.Byte(0x95); code.Byte(0xC0);
+                byte *const done = code.Jmp();
+                code.Patch(lazy);
+                code.Byte(0x80); code.Mem(7, lf_res_offset); code.Byte(0);
+                code.Byte(0x0F); code.Byte(0x94); code.Byte(0xC0);
+                code.Patch(done);
+
+                // test al, al; mov word [PC], next_pc; jcc skip; mov word [PC], imm; skip:
+                code.Byte(0x84); code.Byte(0xC0);
+                code.Byte(0x66); code.Byte(0xC7); code.Mem(0, pc_offset); code.Word(next_pc);
+                byte *const skip = code.Jcc(op.src == DO_Z ? JCC_E : JCC_NE);
+                code.Byte(0x66); code.Byte(0xC7); code.Mem(0, pc_offset); code.Word(op.imm);
+                code.Patch(skip);
+            }
+            else
+                call_handler = true;
+
+            exits[i].set_pc = false;
+            break;
+
+        case DO_DJNZ:
+            {
+                // dec byte [B]; mov word [PC], next_pc; je skip; mov word [PC], imm; skip:
+                code.Byte(0xFE); code.Mem(1, b_offset);
+                code.Byte(0x66); code.Byte(0xC7); code.Mem(0, pc_offset); code.Word(next_pc);
+                byte *const skip = code.Jcc(JCC_E);
+                code.Byte(0x66); code.Byte(0xC7); code.Mem(0, pc_offset); code.Word(op.imm);
+                code.Patch(skip);
+                exits[i].set_pc = false;
+            }
+            break;
+
+        case DO_LD_R_MHL:
+        case DO_LD_A_MRR:
+        case DO_LD_A_MNN:
+            {
+                // Address into esi: movzx esi, word [HL/src] or mov esi, imm
+                if (op.kind == DO_LD_A_MNN)
+                {
+                    code.Byte(0xBE); code.Dword(op.imm);
+                }
+                else
+                {
+                    code.Byte(0x0F); code.Byte(0xB7);
+                    code.Mem(6, op.kind == DO_LD_R_MHL ? hl_offset : src16);
+                }
+
+                // mov eax, esi; shr eax, PageShift; mov rdx, [rbx + rax * 8 + read_page]; test rdx, rdx; je slow
+                code.Byte(0x89); code.Byte(0xF0);
+                code.Byte(0xC1); code.Byte(0xE8); code.Byte(PageShift);
+                code.Byte(0x48); code.Byte(0x8B); code.Byte(0x94); code.Byte(0xC3); code.Dword(read_page_offset);
+                code.Byte(0x48); code.Byte(0x85); code.Byte(0xD2);
+                byte *const slow = code.Jcc(JCC_E);
+
+                // movzx ecx, sil; mov al, [rdx + rcx]; jmp done
+                code.Byte(0x40); code.Byte(0x0F); code.Byte(0xB6); code.Byte(0xCE);
+                code.Byte(0x8A); code.Byte(0x04); code.Byte(0x0A);
+                byte *const done = code.Jmp();
+
+                // slow: mov [rbx + cycles], r13d; call read8
+                code.Patch(slow);
+                code.Byte(0x44); code.Byte(0x89); code.Mem(5, cycles_offset);
+                CallMember(code, read8_addr);
+
+                // done: mov [dst/A], al
+                code.Patch(done);
+                code.Byte(0x88); code.Mem(0, op.kind == DO_LD_R_MHL ? dst8 : a_offset);
+            }
+            break;
+
+        case DO_LD_MHL_R:
+        case DO_LD_MHL_N:
+        case DO_LD_MRR_A:
+        case DO_LD_MNN_A:
+            {
+                // Value into cl: mov cl, [src/A] or mov cl, imm
+                if (op.kind == DO_LD_MHL_N)
+                {
+                    code.Byte(0xB1); code.Byte(op.imm);
+                }
+                else
+                {
+                    code.Byte(0x8A); code.Mem(1, op.kind == DO_LD_MHL_R ? src8 : a_offset);
+                }
+
+                // Address into esi: movzx esi, word [HL/dst] or mov esi, imm
+                if (op.kind == DO_LD_MNN_A)
+                {
+                    code.Byte(0xBE); code.Dword(op.imm);
+                }
+                else
+                {
+                    code.Byte(0x0F); code.Byte(0xB7);
+                    code.Mem(6, op.kind == DO_LD_MRR_A ? dst16 : hl_offset);
+                }
+
+                // mov eax, esi; shr eax, PageShift; mov rax, [rbx + rax * 8 + write_page]; test rax, rax; je slow
+                code.Byte(0x89); code.Byte(0xF0);
+                code.Byte(0xC1); code.Byte(0xE8); code.Byte(PageShift);
+                code.Byte(0x48); code.Byte(0x8B); code.Byte(0x84); code.Byte(0xC3); code.Dword(write_page_offset);
+                code.Byte(0x48); code.Byte(0x85); code.Byte(0xC0);
+                byte *const slow = code.Jcc(JCC_E);
+
+                // movzx edx, sil; mov [rax + rdx], cl; jmp done
+                code.Byte(0x40); code.Byte(0x0F); code.Byte(0xB6); code.Byte(0xD6);
+                code.Byte(0x88); code.Byte(0x0C); code.Byte(0x10);
+                byte *const done = code.Jmp();
+
+                // slow: mov [rbx + cycles], r13d; movzx edx, cl; call write8; mov r13d, [rbx + cycles]
+                code.Patch(slow);
+                code.Byte(0x44); code.Byte(0x89); code.Mem(5, cycles_offset);
+                code.Byte(0x0F); code.Byte(0xB6); code.Byte(0xD1);
+                CallMember(code, write8_addr);
+                code.Byte(0x44); code.Byte(0x8B); code.Mem(5, cycles_offset);
+
+                code.Patch(done);
+                check_generation = true;  // The write may have been over cached code
+            }
+            break;
+
+        default:
+            call_handler = true;
+            break;
+        }
+
+        if (call_handler)
+        {
+            // Bring R and the cycles up to date in case the handler looks at them:
+            // add byte [rbx + R], pending_r; mov [rbx + cycles], r13d
+            if (pending_r != 0)
+            {
+                code.Byte(0x80); code.Mem(0, r_offset); code.Byte(pending_r);
+                pending_r = 0;
+            }
+            code.Byte(0x44); code.Byte(0x89); code.Mem(5, cycles_offset);
+
+            // mov word [rbx + PC], pc + pre
+            code.Byte(0x66); code.Byte(0xC7); code.Mem(0, pc_offset); code.Word(op.pc + op.pre);
+
+            if (op.func != NULL)
+                CallMember(code, handlers[i]);
+
+            if (op.post != 0)
+            {
+                // add word [rbx + PC], post
+                code.Byte(0x66); code.Byte(0x83); code.Mem(0, pc_offset); code.Byte(op.post);
+            }
+
+            // mov r13d, [rbx + cycles]
+            code.Byte(0x44); code.Byte(0x8B); code.Mem(5, cycles_offset);
+
+            exits[i].set_pc = false;
+            check_generation = true;
+        }
+
+        pending_r++;
+        exits[i].pending_r = pending_r;
+
+        // sub r13d, op.cycles
+        code.Byte(0x41); code.Byte(0x81); code.Byte(0xED); code.Dword(op.cycles);
+
+        if (i + 1 < num_ops)
+        {
+            // jle exit; (cmp [rbx + code_generation], r12; jne exit)
+            exits[i].jumps.push_back(code.Jcc(JCC_LE));
+            if (check_generation)
+            {
+                code.Byte(0x4C); code.Byte(0x39); code.Mem(4, generation_offset);
+                exits[i].jumps.push_back(code.Jcc(JCC_NE));
+            }
+        }
+    }
+
+    // The exits, with the last op's falling through from the code above, then the epilogue
+    byte *epilogue = NULL;
+    for (unsigned int n = 0; n < num_ops; n++)
+    {
+        const unsigned int i = (n + num_ops - 1) % num_ops;  // The last op first
+        const Z80DecodedOp &op = block->ops[i];
+
+        if (n != 0 && exits[i].jumps.empty())
+            continue;
+
+        for (std::vector<byte *>::iterator it = exits[i].jumps.begin(); it != exits[i].jumps.end(); it++)
+            code.Patch(*it);
+
+        // add byte [rbx + R], pending_r; mov [rbx + cycles], r13d; (mov word [rbx + PC], next_pc;) mov eax, ops run
+        code.Byte(0x80); code.Mem(0, r_offset); code.Byte(exits[i].pending_r);
+        code.Byte(0x44); code.Byte(0x89); code.Mem(5, cycles_offset);
+        if (exits[i].set_pc)
+        {
+            code.Byte(0x66); code.Byte(0xC7); code.Mem(0, pc_offset); code.Word(op.pc + op.length);
+        }
+        code.Byte(0xB8); code.Dword(i + 1);
+
+        if (n == 0)
+        {
+            // pop r13; pop r12; pop rbx; ret
+            epilogue = code.Pos();
+            code.Byte(0x41); code.Byte(0x5D);
+            code.Byte(0x41); code.Byte(0x5C);
+            code.Byte(0x5B);
+            code.Byte(0xC3);
+        }
+        else
+            CodeWriter::PatchTo(code.Jmp(), epilogue);
+    }
+
+    if (mprotect(protect_start, protect_size, PROT_READ | PROT_EXEC) != 0)
+        return;
+
+    jit_used += (code.Size() + 15) & ~(size_t)15;
+    block->native = (Z80NativeCode)code.Start();
+}
+
+#else
+
+bool Z80CPU::InitJIT()
+{
+    return false;
+}
+
+
+void Z80CPU::ShutdownJIT()
+{
+}
+
+
+void Z80CPU::CompileBlock(Z80Block *)
+{
+}
+
+#endif
@@ -56,6 +56,8 @@
 #define OPCODES_HEADER	"opcodes_decl.h"
 #define OPCODES_IMPL	"opcodes_impl.c"
 #define OPCODES_TABLE	"opcodes_table.c"
+#define OPCODES_SWITCH	"opcodes_switch.c"
+#define FLAGS_TABLE		"flags_table.c"
 
 
 /* =========================================================
@@ -250,17 +252,84 @@ int printCall (char *s, FILE *code)
 }
 
 
+/** Finds the spec pattern that matches the whole of the opcode line */
+Item *findItem (char *line, regmatch_t *matches)
+{
+	int i;
+	
+	for (i = 0; i < nItems; i++)
+	{
+		if (regexec(&items[i].re, line, MAX_MATCH, matches, REG_EXTENDED) == 0)
+		{	
+			if (matches[0].rm_so == 0 && matches[0].rm_eo == strlen(line))	/* Match only entire line (fixes problem with INC HL being matched to INC H */
+				return &items[i];
+		}
+	}
+	
+	fatal2(line, " didn't match anything");
+	return NULL;
+}
+
+
+/** Copies a spec line to dst, replacing %1, %2... with the matched parts of the opcode line */
+void substParams (char *dst, char *src, char *line, regmatch_t *matches)
+{
+	char parm[5], subst[20];
+	int i;
+	
+	strncpy(dst, src, MAX_LINE);
+	strcpy(parm, "%0");
+	
+	for (i = 1; i < MAX_MATCH; i++)
+	{
+		parm[1] = i + '0';
+		strncpy(subst, &line[matches[i].rm_so], matches[i].rm_eo - matches[i].rm_so);
+		subst[matches[i].rm_eo - matches[i].rm_so] = 0;
+		
+		substStr(dst, parm, subst);
+	}
+}
+
+
+/** Substitutes submatches in each output line of the item and prints the code, prefixing each line with indent */
+void printBody (Item *item, char *line, regmatch_t *matches, char *indent, FILE *code)
+{
+	char tmp[MAX_LINE];
+	char **cmds;
+	
+	/* Code that accesses F directly (rather than through the flag macros) needs it up to date */
+	for (cmds = item->line; *cmds; cmds++)
+	{
+		substParams(tmp, *cmds, line, matches);
+		if (strstr(tmp, "BR.F") || strstr(tmp, "wr.AF") || strstr(tmp, "WR.AF"))
+		{
+			fprintf(code, "%s\tsyncFlags();\n", indent);
+			break;
+		}
+	}
+	
+	cmds = item->line;
+	while (*cmds)
+	{
+		fprintf(code, "%s", indent);
+		if (!printCall(*cmds, code))
+		{
+			substParams(tmp, *cmds, line, matches);
+			fprintf(code, "%s\n", tmp);
+		}
+		
+		cmds++;	
+	}
+}
+
+
 /** Reads the opcode list and generates output code based on the spec */
 void generateCodeTable (FILE *opcodes, FILE *code)
 {
 	char line[MAX_LINE];
 	char last[MAX_LINE];
-	char tmp[MAX_LINE];
 	char name[MAX_LINE];
-	char parm[5], subst[20];
-	int i;
 	char *p, *q;
-	char **cmds;
 	regmatch_t matches[MAX_MATCH];
 	Item *item;
 
@@ -283,53 +352,13 @@ void generateCodeTable (FILE *opcodes, FILE *code)
 		strcpy(last, line);
 			
 		/* Find the appropriate pattern */
-		for (i = 0; i < nItems; i++)
-		{
-			if (regexec(&items[i].re, line, MAX_MATCH, matches, REG_EXTENDED) == 0)
-			{	
-				if (matches[0].rm_so == 0 && matches[0].rm_eo == strlen(line))	/* Match only entire line (fixes problem with INC HL being matched to INC H */
-				{
-					/*printf("%s : match %s\n", &line, items[i].pat);*/
-					break;
-				}
-			}
-		}
-		
-		if (i >= nItems)
-        {
-			fatal2(line, " didn't match anything");
-            continue;
-        }
-			
-		item = &items[i];
+		item = findItem(line, matches);
 		
 		/* Print function stub */
 		fixName(line, name);
         fprintf(code, "void Z80CPU::%s ()\n{\n", name);
 				
-		/* Substitute submatches in each output line and print the code */
-		cmds = item->line;
-		strcpy(parm, "%0");
-		while (*cmds)
-		{
-			if (!printCall(*cmds, code))
-			{
-				strncpy(tmp, *cmds, MAX_LINE);
-				q = tmp;
-		
-				for (i = 1; i < MAX_MATCH; i++)
-				{
-					parm[1] = i + '0';
-					strncpy(subst, &line[matches[i].rm_so], matches[i].rm_eo - matches[i].rm_so);
-					subst[matches[i].rm_eo - matches[i].rm_so] = 0;
-					
-					substStr(tmp, parm, subst);
-				}
-				fprintf(code, "%s\n", tmp);
-			}
-			
-			cmds++;	
-		}
+		printBody(item, line, matches, "", code);
 		
 		fprintf(code, "}\n\n\n");
 	} while(1);
@@ -406,9 +435,11 @@ struct Z80OpcodeTable;
 typedef struct
 {
 	char *func;		/*	Z80OpcodeFunc *func;*/
+	char *mnemonic;	/* Opcode as listed in opcodes.lst, used by the switch generator */
 	
 	int operand_type;
     int cycles;
+	int length;		/* Total instruction length in bytes, including prefixes and operands */
 	char *format;	
 	
 	struct Z80OpcodeTable *table;
@@ -585,6 +616,7 @@ void scanOpcodes(FILE *opcodes, Z80OpcodeTable *mainTable)
 	Z80OpcodeTable *current;
 	Z80OpcodeEntry *ent;
 	int opType;
+	int len;
 	
 	rewind(opcodes);	
 	do
@@ -603,11 +635,14 @@ void scanOpcodes(FILE *opcodes, Z80OpcodeTable *mainTable)
 		current = mainTable;		
 		cur = line;
 		opType = OP_NONE;
+		len = 0;
 		do
 		{
 			cur = nextToken(cur, &code, &tt);
+			len += (tt == TT_NN ? 2 : 1);
 			if (tt == TT_END)
 			{
+				len--;
 				break;
 			}
 			else if (tt == TT_OPCODE)
@@ -620,6 +655,7 @@ void scanOpcodes(FILE *opcodes, Z80OpcodeTable *mainTable)
 				
 				ent = &current->entries[code];
 				ent->func = strdup(name);
+				ent->mnemonic = strdup(&line[OPCODE_OFFSET]);
 				ent->format = strdup(fmt);				
 			}
 			else if (tt == TT_NN)
@@ -638,6 +674,7 @@ void scanOpcodes(FILE *opcodes, Z80OpcodeTable *mainTable)
 		
 		ent->operand_type = opType;
         ent->cycles = cyc;
+		ent->length = len;
 			
 	} while (1);
 }
@@ -662,11 +699,12 @@ void outputTable(Z80OpcodeTable *table, FILE *file)
 		if (opc->format)
 			sprintf(fmt, "\"%s\"", opc->format);
 
-		fprintf(file, "\t{ %s%-20s, %-9s, %-4i, %-20s, %s%s }%s\n",
+		fprintf(file, "\t{ %s%-20s, %-9s, %-4i, %-2i, %-20s, %s%s }%s\n",
                                                 (opc->func ? "&Z80CPU::" : ""),
 												(opc->func ? opc->func : "NULL"),
 												OpTypeName[opc->operand_type],
                                                 opc->cycles,
+												opc->length,
 												fmt,
 												(tbl ? "&opcodes_" : ""),
 												(tbl ? tbl->name : "NULL"),
@@ -688,32 +726,293 @@ void outputTable(Z80OpcodeTable *table, FILE *file)
 }
 	
 
-void generateParserTables(FILE *opcodes, FILE *table)
+/* =========================================================
+ *  Switch decoder generator
+ * ========================================================= */
+
+/** 
+ * Outputs a nested switch equivalent to walking the table tree in Z80CPU::Execute().  Each
+ * opcode body is expanded in place at its case label, and subtracts its cycles directly.
+ */
+void outputSwitch(Z80OpcodeTable *table, FILE *file, int depth)
+{
+	int i;
+	Z80OpcodeEntry *opc;
+	char indent[MAX_LINE];
+	char line[MAX_LINE];
+	regmatch_t matches[MAX_MATCH];
+	Item *item;
+	
+	for (i = 0; i < depth; i++)
+		indent[i] = '\t';
+	indent[depth] = 0;
+	
+	if (table->opcode_offset)
+		fprintf(file, "%sswitch (read8(PC++ + %d))\n%s{\n", indent, table->opcode_offset, indent);
+	else
+		fprintf(file, "%sswitch (read8(PC++))\n%s{\n", indent, indent);
+	
+	for (i = 0, opc = table->entries; i < 256; i++, opc++)
+	{
+		if (opc->table)
+		{
+			fprintf(file, "%scase 0x%02X:\n", indent, i);
+			outputSwitch((Z80OpcodeTable *)opc->table, file, depth + 1);
+			fprintf(file, "%s\tbreak;\n\n", indent);
+		}
+		else if (opc->func)
+		{
+			fprintf(file, "%scase 0x%02X:  /* %s */\n%s\t{\n", indent, i, opc->mnemonic, indent);
+			if (table->opcode_offset)
+				fprintf(file, "%s\t\tPC -= %d;\n", indent, table->opcode_offset);
+			
+			strcpy(line, opc->mnemonic);
+			item = findItem(line, matches);
+			strcat(indent, "\t");
+			printBody(item, line, matches, indent, file);
+			indent[depth] = 0;
+			
+			if (table->opcode_offset)
+				fprintf(file, "%s\t\tPC += %d;\n", indent, table->opcode_offset);
+			fprintf(file, "%s\t}\n%s\tcycles -= %d;\n%s\tbreak;\n\n", indent, indent, opc->cycles, indent);
+		}
+	}
+	
+	fprintf(file, "%sdefault:  /* NOP */\n%s\tbreak;\n%s}\n", indent, indent, indent);
+}
+
+
+void generateParserTables(FILE *opcodes, FILE *table, FILE *sw)
 {
 	Z80OpcodeTable *mainTable = createTableTree(opcodes, table);
 	scanOpcodes(opcodes, mainTable);
 	fprintf(table, "\n\n");
 	outputTable(mainTable, table);
+	
+	printf("Outputting switch decoder...");
+	outputSwitch(mainTable, sw, 0);
+	printf("done\n");
 }
 
 
 void generateParser(void)
 {
-	FILE *table, *opcodes;
+	FILE *table, *opcodes, *sw;
 	
 	opcodes = openOrDie(OPCODES_LIST, "rb");
 	table = openOrDie(OPCODES_TABLE, "wb");
+	sw = openOrDie(OPCODES_SWITCH, "wb");
 	
-	generateParserTables(opcodes, table);
+	generateParserTables(opcodes, table, sw);
 	
+	fclose(sw);
 	fclose(table);
 	fclose(opcodes);
 }
 
 
+/* =========================================================
+ *  Flag tables generator
+ * ========================================================= 
+ *
+ * The flags produced by the ALU operations are looked up in tables rather than worked
+ * out bit by bit.  The functions here follow the flag helpers in Z80CPU.cpp exactly.
+ */
+
+#define F_C		1
+#define F_N		2
+#define F_PV	4
+#define F_3		8
+#define F_H		16
+#define F_5		32
+#define F_Z		64
+#define F_S		128
+
+/** S, Z, 5, 3 and P/V (parity) for val */
+int flagsSZ53P (int val)
+{
+	int f = val & (F_S | F_5 | F_3);
+	int bits = 0, i;
+	
+	if (val == 0)
+		f |= F_Z;
+	for (i = 0; i < 8; i++)
+		bits += (val >> i) & 1;
+	if ((bits & 1) == 0)
+		f |= F_PV;
+	return f;
+}
+
+
+/** All of F after ADD/ADC (isSub = 0) or SUB/SBC/CP (isSub = 1) */
+int flagsArithmetic (int a, int value, int carry, int isSub)
+{
+	unsigned short res;
+	int f = 0;
+	
+	if (isSub)
+	{
+		res = a - value - carry;
+		f |= F_N;
+		if ((((a & 0x0F) - (value & 0x0F) - carry) & 0x10) != 0)
+			f |= F_H;
+		if ((a & 0x80) != (value & 0x80) && (a & 0x80) != (res & 0x80))
+			f |= F_PV;
+	}
+	else
+	{
+		res = a + value + carry;
+		if ((((a & 0x0F) + (value & 0x0F) + carry) & 0x10) != 0)
+			f |= F_H;
+		if ((a & 0x80) == (value & 0x80) && (a & 0x80) != (res & 0x80))
+			f |= F_PV;
+	}
+	if (res & 0x80)
+		f |= F_S;
+	if (res & 0x100)
+		f |= F_C;
+	if ((res & 0xFF) == 0)
+		f |= F_Z;
+	
+	return f | (a & (F_5 | F_3));  /* 5 and 3 come from the accumulator before the operation */
+}
+
+
+/** S, Z, H, P/V and N after INC/DEC of val (C is unaffected, 5 and 3 come from the accumulator) */
+int flagsIncDec (int val, int isDec)
+{
+	int f = 0;
+	
+	if (isDec)
+	{
+		if (val == 0x80)
+			f |= F_PV;
+		val = (val - 1) & 0xFF;
+		if ((val & 0x0F) == 0x0F)
+			f |= F_H;
+		f |= F_N;
+	}
+	else
+	{
+		if (val == 0x7F)
+			f |= F_PV;
+		val = (val + 1) & 0xFF;
+		if ((val & 0x0F) == 0)
+			f |= F_H;
+	}
+	
+	return f | (flagsSZ53P(val) & (F_S | F_Z));
+}
+
+
+/** AF after DAA, given A and the N, H and C flags in f */
+int afDAA (int a, int f)
+{
+	int lnib = a & 0x0F;
+	
+	if (f & F_N)
+	{
+		if (a >= 0x9A)
+			f |= F_C;
+		if (f & F_C)
+			a = (a - 0x60) & 0xFF;
+		if (lnib > 9 || (f & F_H))
+		{
+			if (lnib >= 0x06)
+				f &= ~F_H;
+			a = (a - 0x06) & 0xFF;
+		}
+	}
+	else
+	{
+		if (lnib > 9)
+		{
+			a = (a + 0x06) & 0xFF;
+			f |= F_H;
+			if (a < 0x06)
+				f |= F_C;
+		}
+		else if (f & F_H)
+		{
+			a = (a + 0x06) & 0xFF;
+			f &= ~F_H;
+		}
+		
+		if ((a >> 4) > 9 || (f & F_C))
+		{
+			a = (a + 0x60) & 0xFF;
+			f |= F_C;
+		}
+	}
+	
+	f = (f & (F_N | F_H | F_C)) | flagsSZ53P(a);
+	return (a << 8) | f;
+}
+
+
+void outputFlagTable (FILE *file, char *type, char *name, char *size, int *values, int count)
+{
+	int i;
+	
+	fprintf(file, "const Z80CPU::%s Z80CPU::%s[%s] =\n{", type, name, size);
+	for (i = 0; i < count; i++)
+	{
+		if (i % 16 == 0)
+			fprintf(file, "\n\t");
+		fprintf(file, strcmp(type, "byte") == 0 ? "0x%02X," : "0x%04X,", values[i]);
+	}
+	fprintf(file, "\n};\n\n\n");
+}
+
+
+void generateFlagTables (void)
+{
+	FILE *file;
+	int *values;
+	int i;
+	
+	printf("Generating flag tables...");
+	file = openOrDie(FLAGS_TABLE, "wb");
+	values = (int *)malloc(2 * 256 * 256 * sizeof(int));
+	if (values == NULL)
+		fatal("Out of memory");
+	
+	for (i = 0; i < 256; i++)
+		values[i] = flagsSZ53P(i);
+	outputFlagTable(file, "byte", "sz53pTable", "256", values, 256);
+	
+	for (i = 0; i < 256; i++)
+		values[i] = flagsIncDec(i, 0);
+	outputFlagTable(file, "byte", "incTable", "256", values, 256);
+	
+	for (i = 0; i < 256; i++)
+		values[i] = flagsIncDec(i, 1);
+	outputFlagTable(file, "byte", "decTable", "256", values, 256);
+	
+	/* Indexed by carry << 16 | a << 8 | value */
+	for (i = 0; i < 2 * 256 * 256; i++)
+		values[i] = flagsArithmetic((i >> 8) & 0xFF, i & 0xFF, i >> 16, 0);
+	outputFlagTable(file, "byte", "addTable", "2 * 256 * 256", values, 2 * 256 * 256);
+	
+	for (i = 0; i < 2 * 256 * 256; i++)
+		values[i] = flagsArithmetic((i >> 8) & 0xFF, i & 0xFF, i >> 16, 1);
+	outputFlagTable(file, "byte", "subTable", "2 * 256 * 256", values, 2 * 256 * 256);
+	
+	/* Indexed by (H << 2 | N << 1 | C) << 8 | A */
+	for (i = 0; i < 8 * 256; i++)
+		values[i] = afDAA(i & 0xFF, ((i >> 8) & 1 ? F_C : 0) | ((i >> 9) & 1 ? F_N : 0) | ((i >> 10) & 1 ? F_H : 0));
+	outputFlagTable(file, "ushort", "daaTable", "8 * 256", values, 8 * 256);
+	
+	free(values);
+	fclose(file);
+	printf("done\n");
+}
+
+
 int main (void)
 {
 	generateCode();
 	generateParser();
+	generateFlagTables();
 	return 0;
 }
@@ -212,32 +212,26 @@ EXX
 	R2.wr.HL = tmp;
 
 HALT
-	/* What should we do here? */
+	doHALT();
 
 
 #
 # Compare
 #
 CP \(HL\)
-	byte val = read8(WR.HL);
-	doArithmetic(val, 0, 1);	
-	adjustFlags(val);
+	doCP(read8(WR.HL));
 
 CP \((IX|IY)\+d\)
-	byte val = read8(WR.%1 + (signed char)(read8(PC++)));
-	doArithmetic(val, 0, 1);	
-	adjustFlags(val);
+	doCP(read8(WR.%1 + (signed char)(read8(PC++))));
 
 CP (A|B|C|D|E|H|L|IXh|IXl|IYh|IYl)
-	doArithmetic(BR.%1, 0, 1);	
-	adjustFlags(BR.%1);
+	doCP(BR.%1);
 
 CP n
-	byte val = read8(PC++);
-	doArithmetic(val, 0, 1);	
-	adjustFlags(val);
+	doCP(read8(PC++));
 
 CPDR
+	doRepeatCP(-1);
 	byte carry = GETFLAG(F_C);
 	%CP (HL)
 	WR.HL--;
@@ -258,6 +252,7 @@ CPD
 	
 
 CPIR
+	doRepeatCP(1);
 	byte carry = GETFLAG(F_C);
 	%CP (HL)
 	WR.HL++;
@@ -321,6 +316,7 @@ IN A,\(n\)
 
 INDR
 	%IND
+	doRepeatIN(-1);
 	if (BR.B)
 		PC -= 2;  // Still going
 	else
@@ -338,6 +334,7 @@ IND
 	
 INIR
 	%INI
+	doRepeatIN(1);
 	if (BR.B)
 		PC -= 2;  // Still going
 	else
@@ -449,6 +446,7 @@ LD (BC|DE|HL|SP|IX|IY),nn
 	
 
 LDIR
+	doRepeatLD(1);
 	%LDI
 	if (WR.BC)
 		PC -= 2;  // Repeat this opcode
@@ -466,6 +464,7 @@ LDI
 	VALFLAG(F_PV, WR.BC != 0);
 
 LDDR
+	doRepeatLD(-1);
 	%LDD
 	if (WR.BC)
 		PC -= 2;  // Repeat this opcode
@@ -498,6 +497,7 @@ OUTI
 
 OTIR
 	%OUTI
+	doRepeatOUT(1);
 	if (BR.B)
 		PC -= 2;  // Still going
 	else
@@ -514,6 +514,7 @@ OUTD
 
 OTDR
 	%OUTD
+	doRepeatOUT(-1);
 	if (BR.B)
 		PC -= 2;  // Still going
 	else
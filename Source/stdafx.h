@@ -30,7 +30,9 @@
 
 #include <stdio.h>
 
+#ifndef NANOWASP_HEADLESS  // Defined when building the emulation core without wxWidgets
 #include <wx/wx.h>
+#endif
 
 #include "Exceptions.h"
 
@@ -59,6 +61,12 @@ enum
     ID_LoadDiskB,
     ID_CreateDisk,
     ID_SaveState,
+    ID_Rewind,
+    ID_Speed1,
+    ID_Speed2,
+    ID_Speed4,
+    ID_Speed8,
+    ID_SpeedUnlimited,
 };
 
 
@@ -37,6 +37,20 @@ unsigned short BinaryReader::ReadWord()
     return result;
 }
 
+unsigned int BinaryReader::ReadDWord()
+{
+    unsigned int result = this->ReadWord();
+    result |= (unsigned int)this->ReadWord() << 16;
+    return result;
+}
+
+unsigned long long BinaryReader::ReadQWord()
+{
+    unsigned long long result = this->ReadDWord();
+    result |= (unsigned long long)this->ReadDWord() << 32;
+    return result;
+}
+
 bool BinaryReader::ReadBool()
 {
     return this->ReadByte() != 0;
@@ -46,3 +60,8 @@ void BinaryReader::ReadBuffer(unsigned char* buffer, int length)
 {
     this->stream.read((char*)buffer, length);
 }
+
+bool BinaryReader::AtEnd()
+{
+    return this->stream.peek() == std::istream::traits_type::eof();
+}
@@ -21,6 +21,8 @@
 #define BINARYREADER_H
 
 #include <iostream>
+#include <streambuf>
+#include <cstddef>
 
 
 /*! \brief Reads binary data from a stream
@@ -36,11 +38,36 @@ public:
     // TODO: Check that stream is not in a error state at the end of each of these methods.
     unsigned char ReadByte();
     unsigned short ReadWord();
+    unsigned int ReadDWord();
+    unsigned long long ReadQWord();
     bool ReadBool();
     void ReadBuffer(unsigned char* buffer, int length);
+
+    /*! \brief Returns true if there is nothing more to read
+     *
+     *  Lets a reader accept data written before more fields were appended to it.
+     */
+    bool AtEnd();
     
 private:
     std::istream& stream;
 };
 
+
+/*! \brief A stream buffer for reading a block of memory in place
+ *
+ *  Lets a BinaryReader read from memory (e.g. a mapped file) without it being copied into a
+ *  string first.  The memory must outlive the buffer.
+ */
+class MemoryStreamBuf : public std::streambuf
+{
+public:
+    MemoryStreamBuf(const unsigned char *data, size_t size)
+    {
+        // The get area is only read from
+        char *p = (char *)data;
+        setg(p, p, p + size);
+    }
+};
+
 #endif // BINARYREADER_H
@@ -35,6 +35,18 @@ void BinaryWriter::WriteWord(unsigned short w)
     this->WriteByte(w >> 8);
 }
 
+void BinaryWriter::WriteDWord(unsigned int d)
+{
+    this->WriteWord(d & 0xFFFF);
+    this->WriteWord(d >> 16);
+}
+
+void BinaryWriter::WriteQWord(unsigned long long q)
+{
+    this->WriteDWord((unsigned int)(q & 0xFFFFFFFF));
+    this->WriteDWord((unsigned int)(q >> 32));
+}
+
 void BinaryWriter::WriteBool(bool b)
 {
     this->WriteByte(b ? 1 : 0);
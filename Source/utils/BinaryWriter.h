@@ -36,6 +36,8 @@ public:
     // TODO: Check that stream is not in a error state at the end of each of these methods.
     void WriteByte(unsigned char b);
     void WriteWord(unsigned short w);
+    void WriteDWord(unsigned int d);
+    void WriteQWord(unsigned long long q);
     void WriteBool(bool b);
     void WriteBuffer(const unsigned char* buffer, int length);
     
@@ -0,0 +1,63 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstddef>
+#include <string>
+
+
+/*! \brief A 64-bit FNV-1a hash
+ *
+ *  For recognising data that has been seen before (e.g. that a cached state was made from the
+ *  same files), not for security.
+ */
+class Hash64
+{
+public:
+    Hash64() : value(cOffsetBasis) {}
+
+    //! Adds \p len bytes at \p data to the hash
+    void Add(const void *data, size_t len)
+    {
+        const unsigned char *p = (const unsigned char *)data;
+        for (size_t i = 0; i < len; i++)
+            value = (value ^ p[i]) * cPrime;
+    }
+
+    void Add(const std::string &s) { Add(s.data(), s.length()); }
+
+    void AddNumber(unsigned long long n)
+    {
+        for (int i = 0; i < 8; i++, n >>= 8)
+            value = (value ^ (n & 0xFF)) * cPrime;
+    }
+
+    unsigned long long Value() const { return value; }
+
+private:
+    unsigned long long value;
+
+    static const unsigned long long cOffsetBasis = 14695981039346656037ULL;
+    static const unsigned long long cPrime = 1099511628211ULL;
+};
+
+#endif // HASH_H
@@ -0,0 +1,121 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "MappedFile.h"
+
+#include <fstream>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+MappedFile::MappedFile(const char *filename) :
+    data(NULL),
+    size(0),
+    mapped(false),
+    handle(NULL)
+{
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file != INVALID_HANDLE_VALUE)
+    {
+        LARGE_INTEGER len;
+        if (GetFileSizeEx(file, &len) && len.QuadPart > 0)
+        {
+            HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mapping != NULL)
+            {
+                data = (unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                if (data != NULL)
+                {
+                    size = (size_t)len.QuadPart;
+                    mapped = true;
+                    handle = mapping;
+                }
+                else
+                    CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);  // The mapping keeps the file open
+    }
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd >= 0)
+    {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED)
+            {
+                data = (unsigned char *)p;
+                size = st.st_size;
+                mapped = true;
+            }
+        }
+        close(fd);  // The mapping keeps the file open
+    }
+#endif
+
+    if (mapped)
+        return;
+
+    // Couldn't be mapped, so read it
+    std::ifstream file(filename, std::ios::in | std::ios::binary);
+    if (!file.is_open())
+        return;
+
+    file.seekg(0, std::ios::end);
+    std::streamoff len = file.tellg();
+    file.seekg(0, std::ios::beg);
+    if (len <= 0)
+        return;
+
+    data = new unsigned char[(size_t)len];
+    size = (size_t)len;
+    if (!file.read((char *)data, len))
+    {
+        delete [] data;
+        data = NULL;
+        size = 0;
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    if (!mapped)
+    {
+        delete [] data;
+        return;
+    }
+
+#if defined(_WIN32)
+    UnmapViewOfFile(data);
+    CloseHandle((HANDLE)handle);
+#else
+    munmap(data, size);
+#endif
+}
@@ -0,0 +1,54 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+
+
+/*! \brief A whole file mapped read-only into memory
+ *
+ *  Pages are only read from the file as they're touched.  If the host can't map the file it is
+ *  read into memory instead, so Data() is always usable once IsOpen() is true.
+ */
+class MappedFile
+{
+public:
+    explicit MappedFile(const char *filename);
+    ~MappedFile();
+
+    //! Returns false if the file couldn't be opened
+    bool IsOpen() const { return data != NULL; }
+
+    const unsigned char *Data() const { return data; }
+    size_t Size() const { return size; }
+
+private:
+    unsigned char *data;  //!< Contents, NULL if not open (or empty)
+    size_t size;
+    bool mapped;  //!< True if data is mapped, false if it's on the heap
+    void *handle;  //!< Host mapping handle (Windows only)
+
+    MappedFile(const MappedFile &);
+    MappedFile& operator= (const MappedFile &);
+};
+
+#endif // MAPPEDFILE_H
@@ -0,0 +1,121 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Pacer.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#pragma comment(lib, "winmm.lib")
+#elif defined(__APPLE__)
+#include <mach/mach_time.h>
+#include <time.h>
+#else
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+
+Pacer::Pacer() :
+    deadline(0)
+{
+#ifdef _WIN32
+    timeBeginPeriod(1);  // Otherwise Sleep() is only good to the 15.6 ms scheduler tick
+#endif
+}
+
+Pacer::~Pacer()
+{
+#ifdef _WIN32
+    timeEndPeriod(1);
+#endif
+}
+
+void Pacer::Start()
+{
+    this->deadline = Now();
+}
+
+void Pacer::Wait(long long nanos)
+{
+    this->deadline += nanos;
+
+    long long now = Now();
+    if (now - this->deadline > cMaxLag)
+    {
+        this->deadline = now;  // Too far behind to catch up, carry on from here
+        return;
+    }
+
+    if (this->deadline - now > cSpinTime)
+        SleepFor(this->deadline - now - cSpinTime);
+
+    while (Now() < this->deadline)
+        ;  // Spin out the remainder
+}
+
+long long Pacer::Now()
+{
+#if defined(_WIN32)
+    static LARGE_INTEGER freq;
+    if (freq.QuadPart == 0)
+        QueryPerformanceFrequency(&freq);
+
+    LARGE_INTEGER count;
+    QueryPerformanceCounter(&count);
+    return count.QuadPart / freq.QuadPart * 1000000000LL + count.QuadPart % freq.QuadPart * 1000000000LL / freq.QuadPart;
+#elif defined(__APPLE__)
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0)
+        mach_timebase_info(&timebase);
+
+    return (long long)(mach_absolute_time() * timebase.numer / timebase.denom);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#endif
+}
+
+bool Pacer::SetAffinity(int cpu)
+{
+#if defined(_WIN32)
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0;
+#elif defined(__APPLE__)
+    (void)cpu;
+    return false;  // Mac OS X only takes affinity hints, which don't pin a thread
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#endif
+}
+
+void Pacer::SleepFor(long long nanos)
+{
+#ifdef _WIN32
+    Sleep((DWORD)(nanos / 1000000));
+#else
+    struct timespec ts;
+    ts.tv_sec = (time_t)(nanos / 1000000000LL);
+    ts.tv_nsec = (long)(nanos % 1000000000LL);
+    nanosleep(&ts, NULL);
+#endif
+}
@@ -0,0 +1,66 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PACER_H
+#define PACER_H
+
+
+/*! \brief Paces a loop against the host's monotonic clock
+ *
+ *  Each period is measured from the end of the previous one rather than from when Wait() is
+ *  called, so a late wakeup or a slow period is made up over the following periods instead of
+ *  accumulating.  Waits sleep until shortly before the deadline and spin for the rest, because
+ *  the host's sleep is only good to around a millisecond.
+ */
+class Pacer
+{
+public:
+    Pacer();
+    ~Pacer();
+
+    //! Starts the first period now
+    void Start();
+
+    /*! \brief Waits until the end of a period \p nanos long
+     *
+     *  If the host has fallen more than cMaxLag behind (e.g. it was busy elsewhere) the lost time
+     *  is dropped, rather than running flat out to catch up.
+     */
+    void Wait(long long nanos);
+
+    //! Returns the host's monotonic time in nanoseconds
+    static long long Now();
+
+    /*! \brief Restricts the calling thread to host CPU \p cpu
+     *
+     *  \returns false if the host doesn't support this
+     */
+    static bool SetAffinity(int cpu);
+
+private:
+    long long deadline;  //!< Host time that the current period ends
+
+    static const long long cSpinTime = 1000000;  //!< Time before the deadline to stop sleeping and spin (1 ms)
+    static const long long cMaxLag = 100000000;  //!< Furthest behind the host may fall before the time is dropped (100 ms)
+
+    //! Sleeps for about \p nanos, but no longer
+    static void SleepFor(long long nanos);
+};
+
+#endif // PACER_H
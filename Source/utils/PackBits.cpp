@@ -0,0 +1,89 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "PackBits.h"
+
+#include <cstring>
+
+
+void PackBits::Pack(const unsigned char *src, size_t len, std::vector<unsigned char> &dest)
+{
+    size_t i = 0;
+    while (i < len)
+    {
+        // Length of the run starting here
+        size_t run = 1;
+        while (i + run < len && run < 128 && src[i + run] == src[i])
+            run++;
+
+        if (run >= 3)
+        {
+            dest.push_back((unsigned char)(257 - run));
+            dest.push_back(src[i]);
+            i += run;
+            continue;
+        }
+
+        // Literals up to the next run of three or more
+        size_t lit = 0;
+        while (i + lit < len && lit < 128)
+        {
+            if (i + lit + 2 < len && src[i + lit] == src[i + lit + 1] && src[i + lit] == src[i + lit + 2])
+                break;
+            lit++;
+        }
+
+        dest.push_back((unsigned char)(lit - 1));
+        dest.insert(dest.end(), src + i, src + i + lit);
+        i += lit;
+    }
+}
+
+
+bool PackBits::Unpack(const unsigned char *src, size_t len, unsigned char *dest, size_t dest_len)
+{
+    const unsigned char *end = src + len;
+    size_t out = 0;
+
+    while (src < end)
+    {
+        const unsigned char n = *src++;
+
+        if (n < 128)
+        {
+            const size_t lit = n + 1;
+            if ((size_t)(end - src) < lit || dest_len - out < lit)
+                return false;
+            memcpy(dest + out, src, lit);
+            src += lit;
+            out += lit;
+        }
+        else if (n > 128)
+        {
+            const size_t run = 257 - n;
+            if (src == end || dest_len - out < run)
+                return false;
+            memset(dest + out, *src++, run);
+            out += run;
+        }
+    }
+
+    return out == dest_len;
+}
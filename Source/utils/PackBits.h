@@ -0,0 +1,46 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef PACKBITS_H
+#define PACKBITS_H
+
+#include <cstddef>
+#include <vector>
+
+
+/*! \brief PackBits run-length encoding
+ *
+ *  A control byte n of 0 - 127 is followed by n + 1 literal bytes, and one of 129 - 255 by a
+ *  byte to repeat 257 - n times.  It only pays off on data with runs in it (like mostly empty
+ *  memory), but it's very fast and never grows data by more than one byte in 128.
+ */
+namespace PackBits
+{
+    //! Appends the encoding of \p len bytes at \p src to \p dest
+    void Pack(const unsigned char *src, size_t len, std::vector<unsigned char> &dest);
+
+    /*! \brief Decodes \p len bytes at \p src into exactly \p dest_len bytes at \p dest
+     *
+     *  Returns false if the encoding is damaged or doesn't decode to exactly \p dest_len bytes.
+     */
+    bool Unpack(const unsigned char *src, size_t len, unsigned char *dest, size_t dest_len);
+}
+
+#endif // PACKBITS_H
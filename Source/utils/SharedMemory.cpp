@@ -0,0 +1,157 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "SharedMemory.h"
+
+#include <cstring>
+#include <cstdio>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+#ifdef _WIN32
+
+SharedMemory::SharedMemory(size_t size_) :
+    data(NULL),
+    size(RoundUp(size_ > 0 ? size_ : 1)),
+    handle(NULL)
+{
+    unsigned long long s = size;
+    HANDLE mapping = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                       (DWORD)(s >> 32), (DWORD)(s & 0xFFFFFFFF), NULL);
+    if (mapping != NULL)
+    {
+        data = (unsigned char *)MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, size);
+        if (data != NULL)
+            handle = mapping;
+        else
+            CloseHandle(mapping);
+    }
+
+    if (data == NULL)
+        data = new unsigned char[size]();  // Pagefile backed sections are already zeroed
+}
+
+SharedMemory::~SharedMemory()
+{
+    if (handle != NULL)
+    {
+        UnmapViewOfFile(data);
+        CloseHandle((HANDLE)handle);
+    }
+    else
+        delete [] data;
+}
+
+unsigned char *SharedMemory::MapCopy(size_t offset, size_t length) const
+{
+    if (handle == NULL || offset % PageSize() != 0 || offset + length > size)
+        return NULL;
+
+    unsigned long long o = offset;
+    return (unsigned char *)MapViewOfFile((HANDLE)handle, FILE_MAP_COPY,
+                                          (DWORD)(o >> 32), (DWORD)(o & 0xFFFFFFFF), length);
+}
+
+void SharedMemory::Unmap(unsigned char *view, size_t)
+{
+    UnmapViewOfFile(view);
+}
+
+size_t SharedMemory::PageSize()
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwAllocationGranularity;  // Views must start on this, not just a page boundary
+}
+
+#else
+
+SharedMemory::SharedMemory(size_t size_) :
+    data(NULL),
+    size(RoundUp(size_ > 0 ? size_ : 1)),
+    handle(NULL)
+{
+    // Name is only needed long enough to open the object, after that only the descriptor refers to it
+    char name[64];
+    snprintf(name, sizeof(name), "/nanowasp-%ld-%p", (long)getpid(), (void *)this);
+
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    if (fd >= 0)
+    {
+        shm_unlink(name);
+
+        void *p = MAP_FAILED;
+        if (ftruncate(fd, size) == 0)
+            p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+        if (p != MAP_FAILED)
+        {
+            data = (unsigned char *)p;
+            handle = new int(fd);
+        }
+        else
+            close(fd);
+    }
+
+    if (data == NULL)
+        data = new unsigned char[size]();  // ftruncate() zero fills the shared object
+}
+
+SharedMemory::~SharedMemory()
+{
+    if (handle != NULL)
+    {
+        munmap(data, size);
+        close(*(int *)handle);
+        delete (int *)handle;
+    }
+    else
+        delete [] data;
+}
+
+unsigned char *SharedMemory::MapCopy(size_t offset, size_t length) const
+{
+    if (handle == NULL || offset % PageSize() != 0 || offset + length > size)
+        return NULL;
+
+    void *p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, *(int *)handle, offset);
+    return p != MAP_FAILED ? (unsigned char *)p : NULL;
+}
+
+void SharedMemory::Unmap(unsigned char *view, size_t length)
+{
+    munmap(view, length);
+}
+
+size_t SharedMemory::PageSize()
+{
+    long n = sysconf(_SC_PAGESIZE);
+    return n > 0 ? (size_t)n : 4096;
+}
+
+#endif
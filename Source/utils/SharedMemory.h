@@ -0,0 +1,73 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SHAREDMEMORY_H
+#define SHAREDMEMORY_H
+
+#include <cstddef>
+
+
+/*! \brief A block of host memory that can be mapped copy-on-write
+ *
+ *  Each MapCopy() view starts out sharing the block's pages with every other view.  The host
+ *  only copies a page when a view writes to it, so many views of a large block cost little more
+ *  than the pages they actually change.  Writing to the block itself through Data() after views
+ *  have been made is undefined (the views may or may not see it).
+ *
+ *  If the host can't provide shareable memory the block is allocated from the heap instead and
+ *  MapCopy() always fails, so callers must be prepared to copy.
+ */
+class SharedMemory
+{
+public:
+    //! Allocates a zeroed block of at least \p size_ bytes (rounded up to whole pages)
+    explicit SharedMemory(size_t size_);
+    ~SharedMemory();
+
+    unsigned char *Data() { return data; }
+    const unsigned char *Data() const { return data; }
+    size_t Size() const { return size; }
+
+    /*! \brief Maps a private copy-on-write view of part of the block
+     *
+     *  \p offset must be a multiple of PageSize().  Returns NULL if the view can't be made.
+     *  The view must be released with Unmap().
+     */
+    unsigned char *MapCopy(size_t offset, size_t length) const;
+
+    //! Releases a view returned by MapCopy()
+    static void Unmap(unsigned char *view, size_t length);
+
+    //! The granularity of views, offsets passed to MapCopy() must be a multiple of this
+    static size_t PageSize();
+
+    //! Rounds \p n up to a multiple of PageSize()
+    static size_t RoundUp(size_t n) { return (n + PageSize() - 1) / PageSize() * PageSize(); }
+
+private:
+    unsigned char *data;  //!< The whole block mapped shared (or on the heap)
+    size_t size;
+    void *handle;         //!< Host handle for the block, NULL if it is on the heap
+
+    SharedMemory(const SharedMemory &);
+    SharedMemory& operator= (const SharedMemory &);
+};
+
+#endif // SHAREDMEMORY_H
@@ -0,0 +1,167 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Thread.h"
+
+#include <cstddef>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+
+#ifdef _WIN32
+
+Mutex::Mutex() :
+    impl(new CRITICAL_SECTION)
+{
+    InitializeCriticalSection((CRITICAL_SECTION *)impl);
+}
+
+Mutex::~Mutex()
+{
+    DeleteCriticalSection((CRITICAL_SECTION *)impl);
+    delete (CRITICAL_SECTION *)impl;
+}
+
+void Mutex::Lock()
+{
+    EnterCriticalSection((CRITICAL_SECTION *)impl);
+}
+
+void Mutex::Unlock()
+{
+    LeaveCriticalSection((CRITICAL_SECTION *)impl);
+}
+
+#else
+
+Mutex::Mutex() :
+    impl(new pthread_mutex_t)
+{
+    pthread_mutex_init((pthread_mutex_t *)impl, NULL);
+}
+
+Mutex::~Mutex()
+{
+    pthread_mutex_destroy((pthread_mutex_t *)impl);
+    delete (pthread_mutex_t *)impl;
+}
+
+void Mutex::Lock()
+{
+    pthread_mutex_lock((pthread_mutex_t *)impl);
+}
+
+void Mutex::Unlock()
+{
+    pthread_mutex_unlock((pthread_mutex_t *)impl);
+}
+
+#endif
+
+
+long AtomicExchange(volatile long *target, long value)
+{
+#ifdef _WIN32
+    return InterlockedExchange(target, value);
+#else
+    return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+
+Thread::Thread() :
+    handle(NULL)
+{
+}
+
+Thread::~Thread()
+{
+}
+
+bool Thread::Start()
+{
+#ifdef _WIN32
+    this->handle = (void *)_beginthreadex(NULL, 0, Entry, this, 0, NULL);
+    return this->handle != NULL;
+#else
+    pthread_t *thread = new pthread_t;
+    if (pthread_create(thread, NULL, Entry, this) != 0)
+    {
+        delete thread;
+        return false;
+    }
+
+    this->handle = thread;
+    return true;
+#endif
+}
+
+void Thread::Join()
+{
+    if (this->handle == NULL)
+        return;
+
+#ifdef _WIN32
+    WaitForSingleObject((HANDLE)this->handle, INFINITE);
+    CloseHandle((HANDLE)this->handle);
+#else
+    pthread_join(*(pthread_t *)this->handle, NULL);
+    delete (pthread_t *)this->handle;
+#endif
+
+    this->handle = NULL;
+}
+
+void Thread::YieldCPU()
+{
+#ifdef _WIN32
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
+unsigned int Thread::HardwareThreads()
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (unsigned int)n : 1;
+#endif
+}
+
+#ifdef _WIN32
+unsigned __stdcall Thread::Entry(void *thread)
+#else
+void *Thread::Entry(void *thread)
+#endif
+{
+    ((Thread *)thread)->Run();
+    return 0;
+}
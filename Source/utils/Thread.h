@@ -0,0 +1,110 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef THREAD_H
+#define THREAD_H
+
+
+/*! \brief A mutual exclusion lock
+ *
+ *  The emulation core doesn't use wxWidgets, so it has its own minimal threading primitives on
+ *  top of the host's (Win32 or POSIX threads).
+ */
+class Mutex
+{
+public:
+    Mutex();
+    ~Mutex();
+
+    void Lock();
+    void Unlock();
+
+private:
+    void *impl;  //!< Host lock
+
+    // Private copy constuctor and assigment operator to prevent copies
+    Mutex(const Mutex &);
+    Mutex& operator= (const Mutex &);
+};
+
+
+/*! \brief Sets \p target to \p value and returns its old value, as one atomic operation
+ *
+ *  Also a full memory barrier, so a thread that sees \p value also sees everything written
+ *  before it was set.
+ */
+long AtomicExchange(volatile long *target, long value);
+
+
+//! Holds a Mutex locked for the life of the MutexLocker
+class MutexLocker
+{
+public:
+    explicit MutexLocker(Mutex &m) : mutex(m) { mutex.Lock(); }
+    ~MutexLocker() { mutex.Unlock(); }
+
+private:
+    Mutex &mutex;
+
+    MutexLocker(const MutexLocker &);
+    MutexLocker& operator= (const MutexLocker &);
+};
+
+
+/*! \brief A host thread running Run()
+ *
+ *  The thread must be joined with Join() before the Thread is destroyed.
+ */
+class Thread
+{
+public:
+    Thread();
+    virtual ~Thread();
+
+    //! Starts the thread, returns false if the host couldn't create it
+    bool Start();
+
+    //! Waits for Run() to return
+    void Join();
+
+    //! Gives up the rest of the calling thread's time slice
+    static void YieldCPU();
+
+    //! Returns the number of threads the host can run at once (at least 1)
+    static unsigned int HardwareThreads();
+
+protected:
+    //! Called in the new thread
+    virtual void Run() = 0;
+
+private:
+    void *handle;  //!< Host thread, NULL if not running
+
+    //! Host thread entry point, runs \p thread's Run()
+#ifdef _WIN32
+    static unsigned __stdcall Entry(void *thread);
+#else
+    static void *Entry(void *thread);
+#endif
+
+    Thread(const Thread &);
+    Thread& operator= (const Thread &);
+};
+
+#endif // THREAD_H
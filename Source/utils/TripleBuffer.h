@@ -0,0 +1,72 @@
+/*  Nanowasp - A Microbee emulator
+ *  Copyright (C) 2000-2011 David G. Churchill
+ *
+ *  This file is part of Nanowasp.
+ *
+ *  Nanowasp is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nanowasp is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include "Thread.h"
+
+
+/*! \brief Passes the latest of a series of values from one thread to another without locking
+ *
+ *  There are three values: the writer fills Back() while the reader uses Front(), and the third
+ *  holds the last value published.  Publish() and Update() each swap one of their own with that
+ *  one atomically, so neither thread ever waits for the other.  Values the reader doesn't get
+ *  to before the next is published are skipped.
+ *
+ *  Only one thread may write and only one may read.
+ */
+template <typename T> class TripleBuffer
+{
+public:
+    TripleBuffer() : back(0), middle(1), front(2) {}
+
+    //! Returns the value for the writer to fill in
+    T &Back() { return values[back]; }
+
+    //! Publishes Back() to the reader, then Back() is another value to fill in
+    void Publish() { back = AtomicExchange(&middle, back | cFresh) & cIndex; }
+
+    //! Makes the last value published the Front(), returns false if there isn't a new one
+    bool Update()
+    {
+        if ((middle & cFresh) == 0)
+            return false;
+
+        front = AtomicExchange(&middle, front) & cIndex;
+        return true;
+    }
+
+    //! Returns the value for the reader to use
+    const T &Front() const { return values[front]; }
+
+private:
+    T values[3];
+    long back;  //!< Index of the writer's value
+    volatile long middle;  //!< Index of the value last published, with cFresh if the reader hasn't taken it
+    long front;  //!< Index of the reader's value
+
+    static const long cIndex = 3;
+    static const long cFresh = 4;
+
+    TripleBuffer(const TripleBuffer &);
+    TripleBuffer& operator= (const TripleBuffer &);
+};
+
+#endif // TRIPLEBUFFER_H